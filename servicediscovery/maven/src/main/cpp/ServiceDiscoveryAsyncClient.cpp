@@ -21,6 +21,7 @@
  */
 
 #include <ezbake/ezdiscovery/ServiceDiscoveryAsyncClient.h>
+#include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 
 
@@ -29,18 +30,52 @@ namespace ezbake { namespace ezdiscovery {
 using namespace org::apache::zookeeper;
 
 
+void ServiceDiscoveryAsyncClient::close() {
+    //no retry may be sent once our handle goes; a later init starts with a fresh timer
+    _retryTimer->stop();
+    _retryTimer = ::boost::make_shared<RetryTimer>();
+    ServiceDiscoveryClient::close();
+}
+
+
 void ServiceDiscoveryAsyncClient::registerEndpoint(const ::std::string& serviceName,
-        const ::std::string& point, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback) {
-    registerEndpoint(JUST_SERVICE_APP_NAME, serviceName, point, callback);
+        const ::std::string& point, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+        RegistrationMode mode) {
+    registerEndpoint(JUST_SERVICE_APP_NAME, serviceName, point, callback, mode);
 }
 
 
 void ServiceDiscoveryAsyncClient::registerEndpoint(const ::std::string& appName,
         const ::std::string& serviceName, const ::std::string& point,
-        ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback) {
+        ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback, RegistrationMode mode) {
     validateHostAndPort(point); //validate the host and port for the point
 
-    createPath(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point), callback);
+    createPath(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point), callback, mode);
+}
+
+
+void ServiceDiscoveryAsyncClient::registerEphemeralEndpoint(const ::std::string& serviceName,
+        const ::std::string& point, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+        RegistrationMode mode) {
+    registerEphemeralEndpoint(JUST_SERVICE_APP_NAME, serviceName, point, callback, mode);
+}
+
+
+void ServiceDiscoveryAsyncClient::registerEphemeralEndpoint(const ::std::string& appName,
+        const ::std::string& serviceName, const ::std::string& point,
+        ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback, RegistrationMode mode) {
+    validateHostAndPort(point); //validate the host and port for the point
+    ::std::string path = makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point);
+
+    //track it first, so that a session that expires while we create it is covered too.
+    //the path delegate forgets it again if the registration fails
+    trackEphemeral(path);
+    try {
+        createPath(path, callback, mode, CreateMode::Ephemeral);
+    } catch (...) {
+        untrackEphemeral(path);
+        throw;
+    }
 }
 
 
@@ -54,9 +89,12 @@ void ServiceDiscoveryAsyncClient::unregisterEndpoint(const ::std::string& appNam
         const ::std::string& serviceName, const ::std::string& point,
         ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback) {
     ::std::string path = makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point);
+    untrackEphemeral(path);
 
     //delete the endpoint
-    if (ReturnCode::Ok != _handle.remove(path, -1, callback)) {
+    ::boost::shared_ptr<RemoveDelegate> delegate = ::boost::make_shared<RemoveDelegate>(*this, callback);
+    ReturnCode::type rc = _handle.remove(path, -1, delegate);
+    if (ReturnCode::Ok != rc && !delegate->retry(rc, path)) {
         THROW_EXCEPTION(ServiceDiscoveryException,
                 "Error in unregistering endpoint. ZK error: error in dispatching request");
     }
@@ -91,6 +129,44 @@ void ServiceDiscoveryAsyncClient::getEndpoints(const ::std::string& appName, con
 }
 
 
+void ServiceDiscoveryAsyncClient::getEndpoints(const ::std::string& serviceName,
+            ::boost::shared_ptr<ServiceDiscoveryFlatListCallback> callback) {
+    return getEndpoints(JUST_SERVICE_APP_NAME, serviceName, callback);
+}
+
+
+void ServiceDiscoveryAsyncClient::getEndpoints(const ::std::string& appName, const ::std::string& serviceName,
+        ::boost::shared_ptr<ServiceDiscoveryFlatListCallback> callback) {
+    return getChildrenFlat(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH), callback);
+}
+
+
+void ServiceDiscoveryAsyncClient::getEndpointCount(const ::std::string& serviceName,
+        ::boost::shared_ptr<ServiceDiscoveryCountCallback> callback) {
+    getEndpointCount(JUST_SERVICE_APP_NAME, serviceName, callback);
+}
+
+
+void ServiceDiscoveryAsyncClient::getEndpointCount(const ::std::string& appName,
+        const ::std::string& serviceName, ::boost::shared_ptr<ServiceDiscoveryCountCallback> callback) {
+    //the count comes from the Stat of the endpoints node, no need to list the children
+    checkPathExists(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH), callback);
+}
+
+
+void ServiceDiscoveryAsyncClient::getRegistrySnapshot(
+        ::boost::shared_ptr<ServiceDiscoveryRegistryCallback> callback, unsigned int maxConcurrency) {
+    void (ServiceDiscoveryRegistryCallback::*crawled)(ReturnCode::type, RegistrySnapshot&) =
+            &ServiceDiscoveryRegistryCallback::process;
+
+    //retries share our timer, so none is sent once we go
+    if (ReturnCode::Ok != crawlRegistry(maxConcurrency, _retryTimer, ::boost::bind(crawled, callback, _1, _2))) {
+        THROW_EXCEPTION(ServiceDiscoveryException,
+                "Error in getting the registry snapshot. ZK error: error in dispatching request");
+    }
+}
+
+
 void ServiceDiscoveryAsyncClient::setSecurityIdForApplication(const ::std::string& applicationName,
         const ::std::string& securityId, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback) {
     createPath(makeZKPath(applicationName,
@@ -123,27 +199,52 @@ void ServiceDiscoveryAsyncClient::isServiceCommon(const ::std::string& serviceNa
     return checkPathExists(makeZKPath(JUST_SERVICE_APP_NAME, serviceName), callback);
 }
 
+
+void ServiceDiscoveryAsyncClient::setLastKnownReads(unsigned int maxPaths, unsigned int maxAgeMs) {
+    _existsKnown->configure(maxPaths, maxAgeMs);
+    _childrenKnown->configure(maxPaths, maxAgeMs);
+    _flatKnown->configure(maxPaths, maxAgeMs);
+}
+
+
 void ServiceDiscoveryAsyncClient::checkPathExists(const ::std::string& path,
         ::boost::shared_ptr<ServiceDiscoveryCallback> callback) {
+    Calls::Group group = _existsCalls->join(path, callback);
+    if (!group) {
+        //the outstanding read of this path will answer the callback too
+        return;
+    }
 
-    if (ReturnCode::Ok != _handle.exists(path,
-                                         ::boost::shared_ptr<Watch>(),
-                                         callback)) {
+    ::boost::shared_ptr<ExistsFlight> flight =
+            ::boost::make_shared<ExistsFlight>(retries(), _existsCalls, group, _existsKnown);
+    ReturnCode::type rc = _handle.exists(path, ::boost::shared_ptr<Watch>(), flight);
+    if (ReturnCode::Ok != rc && !flight->recover(rc, path)) {
+        //fail any callback that joined meanwhile, and report the error to ours
+        Calls::Waiters waiters;
+        _existsCalls->complete(path, group, waiters);
+        for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+            if (*it != callback) {
+                (*it)->process(rc, path, data::Stat());
+            }
+        }
         THROW_EXCEPTION(ServiceDiscoveryException,
                 "Error in checking path existence. ZK error: error in dispatching request");
     }
 }
 
 void ServiceDiscoveryAsyncClient::createPath(const std::string& path,
-        ::boost::shared_ptr<ServiceDiscoveryCallback> callback) {
+        ::boost::shared_ptr<ServiceDiscoveryCallback> callback, RegistrationMode mode,
+        CreateMode::type createMode) {
 
-    //Don't handle callback from remove. If the node doesn't exists, we are going to create it
-    _handle.remove(path, -1, ::boost::shared_ptr<RemoveCallback>());
+    if (mode == REPLACE_EXISTING) {
+        //Don't handle callback from remove. If the node doesn't exists, we are going to create it
+        _handle.remove(path, -1, ::boost::shared_ptr<RemoveCallback>());
+    }
 
     //pass creation of nodes along path to our delegate
     ::boost::shared_ptr<CreatePathDelegate> delegate =
             ::boost::make_shared<CreatePathDelegate>(*this, path,
-                    ::boost::dynamic_pointer_cast<ServiceDiscoveryOpCallback>(callback));
+                    ::boost::dynamic_pointer_cast<ServiceDiscoveryOpCallback>(callback), mode, createMode);
 
     //use a shared_ptr to invoke the createPath method as the createPath method uses the
     //shared_ptr to hold a reference to the delegate object event after this current function
@@ -154,15 +255,303 @@ void ServiceDiscoveryAsyncClient::createPath(const std::string& path,
 
 void ServiceDiscoveryAsyncClient::getChildren(const std::string& path,
         ::boost::shared_ptr<ServiceDiscoveryCallback> callback) {
-    if (ReturnCode::Ok != _handle.getChildren(path,
-                                              ::boost::shared_ptr<Watch>(),
-                                              callback)) {
+    Calls::Group group = _childrenCalls->join(path, callback);
+    if (!group) {
+        //the outstanding read of this path will answer the callback too
+        return;
+    }
+
+    ::boost::shared_ptr<ChildrenFlight> flight =
+            ::boost::make_shared<ChildrenFlight>(retries(), _childrenCalls, group, _childrenKnown);
+    ReturnCode::type rc = _handle.getChildren(path, ::boost::shared_ptr<Watch>(), flight);
+    if (ReturnCode::Ok != rc && !flight->recover(rc, path)) {
+        Calls::Waiters waiters;
+        _childrenCalls->complete(path, group, waiters);
+        for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+            if (*it != callback) {
+                (*it)->process(rc, path, ::std::vector< ::std::string>(), data::Stat());
+            }
+        }
+        THROW_EXCEPTION(ServiceDiscoveryException,
+                "Error in getting nodes. ZK error: error in dispatching request");
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::getChildrenFlat(const std::string& path,
+        ::boost::shared_ptr<ServiceDiscoveryCallback> callback) {
+    Calls::Group group = _flatCalls->join(path, callback);
+    if (!group) {
+        //the outstanding read of this path will answer the callback too
+        return;
+    }
+
+    ::boost::shared_ptr<FlatFlight> flight =
+            ::boost::make_shared<FlatFlight>(retries(), _flatCalls, group, _flatKnown);
+    ReturnCode::type rc = _handle.getChildrenFlat(path, ::boost::shared_ptr<Watch>(), flight);
+    if (ReturnCode::Ok != rc && !flight->recover(rc, path)) {
+        Calls::Waiters waiters;
+        _flatCalls->complete(path, group, waiters);
+        for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+            if (*it != callback) {
+                FlatStringList children;
+                (*it)->process(rc, path, children, data::Stat());
+            }
+        }
         THROW_EXCEPTION(ServiceDiscoveryException,
                 "Error in getting nodes. ZK error: error in dispatching request");
     }
 }
 
 
+void ServiceDiscoveryAsyncClient::written(const ::std::string& path) {
+    _existsCalls->written(path);
+    _childrenCalls->written(path);
+    _flatCalls->written(path);
+}
+
+
+bool ServiceDiscoveryAsyncClient::Retries::retry(ReturnCode::type rc,
+        const ::boost::function<void ()>& send) {
+    unsigned int delayMs = 0;
+    if (!_policy->retryAfter(_attempts, rc, delayMs)) {
+        if (!isSessionLoss(rc)) {
+            _attempts = 1;
+        }
+        return false;
+    }
+    if (!_timer->schedule(delayMs, send)) {
+        //the client is going away
+        return false;
+    }
+    ++_attempts;
+    return true;
+}
+
+
+bool ServiceDiscoveryAsyncClient::ExistsFlight::recover(ReturnCode::type rc, const ::std::string& path) {
+    if (_retries.retry(rc, ::boost::bind(&ExistsFlight::send, shared_from_this(), path))) {
+        return true;
+    }
+    data::Stat known;
+    if (isSessionLoss(rc) && _known->recall(path, known)) {
+        //answer from the last known result until the session is back
+        deliverStale(path, known);
+        return true;
+    }
+    return false;
+}
+
+
+void ServiceDiscoveryAsyncClient::ExistsFlight::send(const ::std::string& path) {
+    ReturnCode::type rc = _retries.handle().exists(path, ::boost::shared_ptr<Watch>(), shared_from_this());
+    if (ReturnCode::Ok != rc) {
+        process(rc, path, data::Stat());
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ExistsFlight::process(ReturnCode::type rc,
+        const ::std::string& path, const data::Stat& stat) {
+    if (!recover(rc, path)) {
+        deliver(rc, path, stat);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ExistsFlight::deliver(ReturnCode::type rc,
+        const ::std::string& path, const data::Stat& stat) {
+    _known->record(path, rc, stat);
+
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        (*it)->process(rc, path, stat);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ExistsFlight::deliverStale(const ::std::string& path,
+        const data::Stat& stat) {
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        (*it)->stale(stat);
+    }
+}
+
+
+bool ServiceDiscoveryAsyncClient::ChildrenFlight::recover(ReturnCode::type rc, const ::std::string& path) {
+    if (_retries.retry(rc, ::boost::bind(&ChildrenFlight::send, shared_from_this(), path))) {
+        return true;
+    }
+    ::std::vector< ::std::string> known;
+    if (isSessionLoss(rc) && _known->recall(path, known)) {
+        //answer from the last known result until the session is back
+        deliverStale(path, known);
+        return true;
+    }
+    return false;
+}
+
+
+void ServiceDiscoveryAsyncClient::ChildrenFlight::send(const ::std::string& path) {
+    ReturnCode::type rc = _retries.handle().getChildren(path, ::boost::shared_ptr<Watch>(),
+            shared_from_this());
+    if (ReturnCode::Ok != rc) {
+        process(rc, path, ::std::vector< ::std::string>(), data::Stat());
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ChildrenFlight::process(ReturnCode::type rc,
+        const ::std::string& path, const ::std::vector< ::std::string>& children,
+        const data::Stat& stat) {
+    if (!recover(rc, path)) {
+        deliver(rc, path, children, stat);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ChildrenFlight::process(ReturnCode::type rc,
+        const ::std::string& path, ::std::vector< ::std::string>&& children,
+        const data::Stat& stat) {
+    if (!recover(rc, path)) {
+        deliver(rc, path, ::std::move(children), stat);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ChildrenFlight::deliver(ReturnCode::type rc,
+        const ::std::string& path, const ::std::vector< ::std::string>& children,
+        const data::Stat& stat) {
+    _known->record(path, rc, children);
+
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        (*it)->process(rc, path, children, stat);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ChildrenFlight::deliver(ReturnCode::type rc,
+        const ::std::string& path, ::std::vector< ::std::string>&& children,
+        const data::Stat& stat) {
+    _known->record(path, rc, children);
+
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    //the last callback may take the children, the others see them read-only
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (i + 1 < waiters.size()) {
+            waiters[i]->process(rc, path, static_cast<const ::std::vector< ::std::string>&>(children), stat);
+        } else {
+            waiters[i]->process(rc, path, ::std::move(children), stat);
+        }
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::ChildrenFlight::deliverStale(const ::std::string& path,
+        const ::std::vector< ::std::string>& children) {
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    for (Calls::Waiters::const_iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        (*it)->stale(children);
+    }
+}
+
+
+bool ServiceDiscoveryAsyncClient::FlatFlight::recover(ReturnCode::type rc, const ::std::string& path) {
+    if (_retries.retry(rc, ::boost::bind(&FlatFlight::send, shared_from_this(), path))) {
+        return true;
+    }
+    FlatStringList known;
+    if (isSessionLoss(rc) && _known->recall(path, known)) {
+        //answer from the last known result until the session is back
+        deliverStale(path, known);
+        return true;
+    }
+    return false;
+}
+
+
+void ServiceDiscoveryAsyncClient::FlatFlight::send(const ::std::string& path) {
+    ReturnCode::type rc = _retries.handle().getChildrenFlat(path, ::boost::shared_ptr<Watch>(),
+            shared_from_this());
+    if (ReturnCode::Ok != rc) {
+        FlatStringList children;
+        process(rc, path, children, data::Stat());
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::FlatFlight::process(ReturnCode::type rc,
+        const ::std::string& path, FlatStringList& children, const data::Stat& stat) {
+    if (!recover(rc, path)) {
+        deliver(rc, path, children, stat);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::FlatFlight::deliver(ReturnCode::type rc,
+        const ::std::string& path, FlatStringList& children, const data::Stat& stat) {
+    _known->record(path, rc, children);
+
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    //callbacks may swap the list out, so all but the last get their own copy
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (i + 1 < waiters.size()) {
+            FlatStringList copy(children);
+            waiters[i]->process(rc, path, copy, stat);
+        } else {
+            waiters[i]->process(rc, path, children, stat);
+        }
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::FlatFlight::deliverStale(const ::std::string& path,
+        FlatStringList& children) {
+    Calls::Waiters waiters;
+    _calls->complete(path, _group, waiters);
+    //callbacks may swap the list out, so all but the last get their own copy
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        if (i + 1 < waiters.size()) {
+            FlatStringList copy(children);
+            waiters[i]->stale(copy);
+        } else {
+            waiters[i]->stale(children);
+        }
+    }
+}
+
+
+bool ServiceDiscoveryAsyncClient::RemoveDelegate::retry(ReturnCode::type rc, const ::std::string& path) {
+    return _retries.retry(rc, ::boost::bind(&RemoveDelegate::send, shared_from_this(), path));
+}
+
+
+void ServiceDiscoveryAsyncClient::RemoveDelegate::send(const ::std::string& path) {
+    ReturnCode::type rc = _retries.handle().remove(path, -1, shared_from_this());
+    if (ReturnCode::Ok != rc) {
+        process(rc, path);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::RemoveDelegate::process(ReturnCode::type rc, const ::std::string& path) {
+    if (!retry(rc, path)) {
+        if (rc == ReturnCode::Ok) {
+            _client.written(path);
+        }
+        _callback->process(rc, path);
+    }
+}
+
+
 void ServiceDiscoveryAsyncClient::CreatePathDelegate::createPath() {
     //check for invalid node along path
     std::size_t pos = _principalPath.find("//", 1);
@@ -175,7 +564,11 @@ void ServiceDiscoveryAsyncClient::CreatePathDelegate::createPath() {
 
     if (0 == pathNodes.size()) {
         //invalid path. Report error to principal callback
-        _principalCallback->process(ServiceDiscoveryCallback::ERROR);
+        fail();
+    } else if (_mode == IF_ABSENT) {
+        //try the full path first: if it is already there that is the only request
+        _probing = true;
+        createPath(_principalPath);
     } else {
         //create first node along path
         createPath(PATH_DELIM + pathNodes[0]);
@@ -189,24 +582,61 @@ void ServiceDiscoveryAsyncClient::CreatePathDelegate::createPath(const std::stri
      * All parent nodes of path must exist for success.
      */
 
-    if (ReturnCode::Ok != _client._handle.create(path, "",
-            SD_DEFAULT_ACL, CreateMode::Persistent, shared_from_this())) {
+    CreateMode::type mode = (path == _principalPath) ? _createMode : CreateMode::Persistent;
+    ReturnCode::type rc = _client._handle.create(path, "", SD_DEFAULT_ACL, mode, shared_from_this());
+    if (ReturnCode::Ok != rc && !retry(rc, path)) {
         /*
          * Error in dispatching call to create, inform our principal callback of error and abort
          * creating the path
          */
-        _principalCallback->process(ServiceDiscoveryCallback::ERROR);
+        fail();
     }
 }
 
 
+bool ServiceDiscoveryAsyncClient::CreatePathDelegate::retry(ReturnCode::type rc, const std::string& path) {
+    void (CreatePathDelegate::*create)(const std::string&) = &CreatePathDelegate::createPath;
+    if (!_retries.retry(rc, ::boost::bind(create, shared_from_this(), path))) {
+        return false;
+    }
+    if (path == _principalPath) {
+        //the lost attempt may have created it
+        _retried = true;
+    }
+    return true;
+}
+
+
 void  ServiceDiscoveryAsyncClient::CreatePathDelegate::process(ReturnCode::type rc,
         const std::string& pathRequested, const std::string& pathCreated) {
 
-    if (rc != org::apache::zookeeper::ReturnCode::Ok &&
+    if (rc == org::apache::zookeeper::ReturnCode::Ok) {
+        //before anyone hears of it, so that their reads see it
+        _client.written(pathRequested);
+    }
+
+    if (retry(rc, pathRequested)) {
+        //lost with the connection, the node is requested again
+    }
+    else if (_probing && rc == org::apache::zookeeper::ReturnCode::NoNode) {
+        //a parent of the full path is missing. Create the path from the top
+        _probing = false;
+        createPath(PATH_DELIM + splitPath(_principalPath).at(0));
+    }
+    else if (rc != org::apache::zookeeper::ReturnCode::Ok &&
         rc != org::apache::zookeeper::ReturnCode::NodeExists) {
         //error reported by ZooKeeper. Forward to our principal callback
-        _principalCallback->process(ServiceDiscoveryCallback::ERROR);
+        fail();
+    }
+    else if (pathRequested == _principalPath && rc == org::apache::zookeeper::ReturnCode::NodeExists) {
+        //the full path is already there: what we asked for, unless we removed it to replace it
+        if (!(_mode == IF_ABSENT || _retried)) {
+            fail();
+        } else if (_createMode == CreateMode::Ephemeral) {
+            checkOwner();
+        } else {
+            _principalCallback->process(ServiceDiscoveryCallback::OK);
+        }
     }
     else if (pathCreated == _principalPath) {
         //this is last node along path. Full path was created. Return result to principal callback.
@@ -214,11 +644,11 @@ void  ServiceDiscoveryAsyncClient::CreatePathDelegate::process(ReturnCode::type
     }
     else if ((rc == org::apache::zookeeper::ReturnCode::Ok) && (pathCreated != pathRequested)){
         //Since we did not request for a sequential node, the path requested must match that created
-        _principalCallback->process(ServiceDiscoveryCallback::ERROR);
+        fail();
     }
     else if ((rc == org::apache::zookeeper::ReturnCode::Ok) && (_principalPath.find(pathCreated) != 0)) {
         //path created is not a prefix of the requested principal path
-        _principalCallback->process(ServiceDiscoveryCallback::ERROR);
+        fail();
     }
     else {
         /*
@@ -232,4 +662,63 @@ void  ServiceDiscoveryAsyncClient::CreatePathDelegate::process(ReturnCode::type
     }
 }
 
+
+void ServiceDiscoveryAsyncClient::CreatePathDelegate::process(ReturnCode::type rc,
+        const ::std::string&, const data::Stat& stat) {
+    if (_retries.retry(rc, ::boost::bind(&CreatePathDelegate::checkOwner, shared_from_this()))) {
+        //lost with the connection, asked again
+    } else if (rc == ReturnCode::Ok && _client.ownsEphemeral(stat)) {
+        _principalCallback->process(ServiceDiscoveryCallback::OK);
+    } else if (rc == ReturnCode::NoNode) {
+        //gone since, create it after all
+        createPath(_principalPath);
+    } else if (rc == ReturnCode::Ok && !_replaced) {
+        //persistent, or of another session: it would not go away with ours
+        replace();
+    } else {
+        fail();
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::CreatePathDelegate::process(ReturnCode::type rc, const ::std::string& path) {
+    if (_retries.retry(rc, ::boost::bind(&CreatePathDelegate::replace, shared_from_this()))) {
+        //lost with the connection, removed again
+    } else if (rc == ReturnCode::Ok || rc == ReturnCode::NoNode) {
+        if (rc == ReturnCode::Ok) {
+            _client.written(path);
+        }
+        createPath(_principalPath);
+    } else {
+        fail();
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::CreatePathDelegate::checkOwner() {
+    ReturnCode::type rc = _client._handle.exists(_principalPath, ::boost::shared_ptr<Watch>(),
+            shared_from_this());
+    if (ReturnCode::Ok != rc) {
+        process(rc, _principalPath, data::Stat());
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::CreatePathDelegate::replace() {
+    _replaced = true;
+    ReturnCode::type rc = _client._handle.remove(_principalPath, -1, shared_from_this());
+    if (ReturnCode::Ok != rc) {
+        process(rc, _principalPath);
+    }
+}
+
+
+void ServiceDiscoveryAsyncClient::CreatePathDelegate::fail() {
+    if (_createMode == CreateMode::Ephemeral) {
+        //nothing to register again on a new session
+        _client.untrackEphemeral(_principalPath);
+    }
+    _principalCallback->process(ServiceDiscoveryCallback::ERROR);
+}
+
 }} // namespace ::ezbake::ezdiscovery
@@ -20,6 +20,10 @@
  */
 
 #include <ezbake/ezdiscovery/ServiceDiscoveryClient.h>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/locks.hpp>
+#include <algorithm>
 
 namespace ezbake { namespace ezdiscovery {
 
@@ -37,34 +41,387 @@ const SDACL ServiceDiscoveryClient::CREATOR_ALL_ACL_ACL = SDACL("auth", "", Perm
 const ::std::vector<data::ACL> ServiceDiscoveryClient::SD_DEFAULT_ACL = ::std::vector<data::ACL>(1, OPEN_ACL_UNSAFE_ACL);
 
 
+ServiceDiscoveryClient::ServiceDiscoveryClient()
+    : _retryPolicy(new ExponentialBackoffRetry(MAX_NUM_OF_TRIES)),
+      _reregister(false) {}
+
+
 void ServiceDiscoveryClient::close() {
     _handle.close();
+
+    ::boost::lock_guard< ::boost::mutex> lock(_ephemeralMutex);
+    _ephemerals.clear();
+    _reregister = false;
 }
 
 
 void ServiceDiscoveryClient::init(const ::std::string& zookeeperConnectString) {
-    //validate the connection string
-    if (zookeeperConnectString.find(PATH_DELIM) != ::std::string::npos) {
-        THROW_EXCEPTION(ServiceDiscoveryException,
-                "ZK connect string should not contain \"" +
-                PATH_DELIM + "\": " + zookeeperConnectString);
-    }
+    ::std::string connectString = namespacedConnectString(zookeeperConnectString);
 
     //initialize our namespace
     initializeNamespace(zookeeperConnectString);
 
-    //append our namespace for connection to zookeeper - this will serve as the chroot
-    ::std::string namespacedConnectString = zookeeperConnectString +
-            PATH_DELIM + NAMESPACE;
+    //initialize our zookeeper connection. Readers and watchers need a session as much as our
+    //ephemerals do, so it renews expired sessions whatever we hold
+    if (ReturnCode::Ok != _handle.init(connectString, DEFAULT_SESSION_TIMEOUT,
+                                       ::boost::shared_ptr<Watch>(new SessionWatch(*this)),
+                                       InitFlag::RenewExpiredSession)) {
+        THROW_EXCEPTION(ServiceDiscoveryException, "Unable to connect to zookeeper");
+    }
+}
 
-    //initialize a zookeeper connection without Watches
-    if (ReturnCode::Ok != _handle.init(namespacedConnectString, DEFAULT_SESSION_TIMEOUT,
-                                       ::boost::shared_ptr<Watch>())) {
+
+void ServiceDiscoveryClient::init(const ::std::string& zookeeperConnectString, int64_t sessionId,
+        const ::std::string& sessionPassword) {
+    if (sessionId == 0) {
+        //no session to resume, so nothing may exist yet
+        init(zookeeperConnectString);
+        return;
+    }
+    ::std::string connectString = namespacedConnectString(zookeeperConnectString);
+
+    //the namespace of a session we resume already exists, and so do its ephemeral end points
+    if (ReturnCode::Ok != _handle.init(connectString, DEFAULT_SESSION_TIMEOUT,
+                                       ::boost::shared_ptr<Watch>(new SessionWatch(*this)),
+                                       sessionId, sessionPassword,
+                                       InitFlag::RenewExpiredSession)) {
         THROW_EXCEPTION(ServiceDiscoveryException, "Unable to connect to zookeeper");
     }
 }
 
 
+int64_t ServiceDiscoveryClient::getSessionId() {
+    int64_t sessionId = 0;
+    ReturnCode::type rc = _handle.getSessionId(sessionId);
+    if (rc != ReturnCode::Ok) {
+        ::std::ostringstream ss;
+        ss << "Unable to get the session id. ZK error: " << rc;
+        THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+    }
+    return sessionId;
+}
+
+
+::std::string ServiceDiscoveryClient::getSessionPassword() {
+    ::std::string password;
+    ReturnCode::type rc = _handle.getSessionPassword(password);
+    if (rc != ReturnCode::Ok) {
+        ::std::ostringstream ss;
+        ss << "Unable to get the session password. ZK error: " << rc;
+        THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+    }
+    return password;
+}
+
+
+void ServiceDiscoveryClient::setRetryPolicy(::boost::shared_ptr<RetryPolicy> policy) {
+    if (!policy) {
+        THROW_EXCEPTION(ServiceDiscoveryException, "Retry policy must not be null");
+    }
+    _retryPolicy = policy;
+}
+
+
+void ServiceDiscoveryClient::trackEphemeral(const ::std::string& path) {
+    ::boost::lock_guard< ::boost::mutex> lock(_ephemeralMutex);
+    _ephemerals.insert(path);
+}
+
+
+void ServiceDiscoveryClient::untrackEphemeral(const ::std::string& path) {
+    ::boost::lock_guard< ::boost::mutex> lock(_ephemeralMutex);
+    _ephemerals.erase(path);
+}
+
+
+bool ServiceDiscoveryClient::ownsEphemeral(const data::Stat& stat) {
+    int64_t sessionId = 0;
+    return stat.getephemeralOwner() != 0 && ReturnCode::Ok == _handle.getSessionId(sessionId) &&
+            stat.getephemeralOwner() == sessionId;
+}
+
+
+ReturnCode::type ServiceDiscoveryClient::crawlRegistry(unsigned int maxConcurrency,
+        ::boost::shared_ptr<RetryTimer> timer, const RegistryDone& done) {
+    ::boost::shared_ptr<RegistryCrawl> crawl = ::boost::make_shared<RegistryCrawl>(_handle, _retryPolicy,
+            timer, ::std::max(maxConcurrency, 1u), done);
+    return crawl->start();
+}
+
+
+void ServiceDiscoveryClient::sessionStateChanged(SessionState::type state) {
+    if (state == SessionState::Expired) {
+        //our ephemeral nodes are gone; the handle is establishing a new session
+        ::boost::lock_guard< ::boost::mutex> lock(_ephemeralMutex);
+        _reregister = true;
+    } else if (state == SessionState::Connected) {
+        reregisterEphemerals();
+    }
+}
+
+
+void ServiceDiscoveryClient::reregisterEphemerals() {
+    ::boost::lock_guard< ::boost::mutex> lock(_ephemeralMutex);
+    if (!_reregister) {
+        return;
+    }
+    _reregister = false;
+
+    /*
+     * We are on the completion thread, so nothing here may wait for a response. Requests on a
+     * session are processed in order, so the parents are in place by the time each end point
+     * is created, and the ones that already exist cost a NodeExists each.
+     */
+    for (::std::set< ::std::string>::const_iterator it = _ephemerals.begin(); it != _ephemerals.end(); ++it) {
+        reregisterEphemeral(*it, 1);
+    }
+}
+
+
+void ServiceDiscoveryClient::reregisterEphemeral(const ::std::string& path, unsigned int attempts) {
+    ::std::vector< ::std::string> paths = splitPath(path);
+    ::std::string pathToCreate;
+    for (unsigned int i = 0; i + 1 < paths.size(); i++) {
+        pathToCreate += PATH_DELIM + paths.at(i);
+        _handle.create(pathToCreate, "", SD_DEFAULT_ACL, CreateMode::Persistent,
+                ::boost::shared_ptr<CreateCallback>());
+    }
+
+    ::boost::shared_ptr<CreateCallback> callback(new EphemeralCallback(*this, attempts));
+    ReturnCode::type rc = _handle.create(path, "", SD_DEFAULT_ACL, CreateMode::Ephemeral, callback);
+    if (rc != ReturnCode::Ok) {
+        retryEphemeral(path, attempts, rc);
+    }
+}
+
+
+void ServiceDiscoveryClient::resendEphemeral(const ::std::string& path, unsigned int attempts) {
+    ::boost::lock_guard< ::boost::mutex> lock(_ephemeralMutex);
+    //not if it was unregistered since, or if the session expired and all are sent again anyway
+    if (_ephemerals.count(path) && !_reregister) {
+        reregisterEphemeral(path, attempts);
+    }
+}
+
+
+void ServiceDiscoveryClient::retryEphemeral(const ::std::string& path, unsigned int attempts,
+        ReturnCode::type rc) {
+    if (!_ephemerals.count(path)) {
+        return;
+    }
+
+    /*
+     * The session may well stay connected, in which case nothing else would register the end
+     * point again. Once the policy gives up we are disconnected, or the ensemble refused it
+     */
+    unsigned int delayMs = 0;
+    if (!_retryPolicy->retryAfter(attempts, rc, delayMs) ||
+            !_ephemeralTimer.schedule(delayMs, ::boost::bind(&ServiceDiscoveryClient::resendEphemeral,
+                    this, path, attempts + 1))) {
+        //try again once we are connected again
+        _reregister = true;
+    }
+}
+
+
+void ServiceDiscoveryClient::SessionWatch::process(WatchEvent::type event, SessionState::type state,
+        const ::std::string&) {
+    if (event == WatchEvent::SessionStateChanged) {
+        _client.sessionStateChanged(state);
+    }
+}
+
+
+void ServiceDiscoveryClient::EphemeralCallback::process(ReturnCode::type rc,
+        const ::std::string& pathRequested, const ::std::string&) {
+    if (rc != ReturnCode::Ok && rc != ReturnCode::NodeExists) {
+        ::boost::lock_guard< ::boost::mutex> lock(_client._ephemeralMutex);
+        _client.retryEphemeral(pathRequested, _attempts, rc);
+    }
+}
+
+
+ServiceDiscoveryClient::RegistryCrawl::RegistryCrawl(ZooKeeper& handle,
+        ::boost::shared_ptr<RetryPolicy> policy, ::boost::shared_ptr<RetryTimer> timer,
+        unsigned int maxConcurrency, const RegistryDone& done)
+    : _handle(handle),
+      _policy(policy),
+      _timer(timer),
+      _maxConcurrency(maxConcurrency),
+      _done(done),
+      _retrying(0),
+      _rc(ReturnCode::Ok),
+      _finished(false) {}
+
+
+ReturnCode::type ServiceDiscoveryClient::RegistryCrawl::start() {
+    ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+
+    //the root of our namespace lists the applications
+    _queue.push_back(Read());
+    dispatch();
+    if (_rc != ReturnCode::Ok) {
+        //nothing is in flight, the caller reports the error
+        _finished = true;
+    }
+    return _rc;
+}
+
+
+void ServiceDiscoveryClient::RegistryCrawl::process(ReturnCode::type rc, const ::std::string& path,
+        const ::std::vector< ::std::string>& children, const data::Stat& stat) {
+    process(rc, path, ::std::vector< ::std::string>(children), stat);
+}
+
+
+void ServiceDiscoveryClient::RegistryCrawl::process(ReturnCode::type rc, const ::std::string& path,
+        ::std::vector< ::std::string>&& children, const data::Stat&) {
+    {
+        ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+        ::boost::unordered_map< ::std::string, Read>::iterator it = _inFlight.find(path);
+        if (it == _inFlight.end()) {
+            return;
+        }
+        Read read = it->second;
+        _inFlight.erase(it);
+        if (_finished) {
+            //the crawl already failed
+            return;
+        }
+
+        if (!retry(read, rc)) {
+            if (rc == ReturnCode::Ok) {
+                add(read, children);
+            } else if (rc == ReturnCode::NoNode) {
+                //removed since its parent was listed. A service without end points is still listed
+                if (!read.app.empty() && read.service.empty()) {
+                    _registry.erase(read.app);
+                }
+            } else {
+                _rc = rc;
+            }
+        }
+        dispatch();
+        if (!finished()) {
+            return;
+        }
+    }
+    complete();
+}
+
+
+void ServiceDiscoveryClient::RegistryCrawl::resend(const Read& read) {
+    {
+        ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+        --_retrying;
+        if (_finished) {
+            return;
+        }
+        _queue.push_front(read);
+        dispatch();
+        if (!finished()) {
+            return;
+        }
+    }
+    complete();
+}
+
+
+void ServiceDiscoveryClient::RegistryCrawl::dispatch() {
+    while (_rc == ReturnCode::Ok && _inFlight.size() < _maxConcurrency && !_queue.empty()) {
+        Read read = _queue.front();
+        _queue.pop_front();
+
+        ReturnCode::type rc = _handle.getChildren(read.path, ::boost::shared_ptr<Watch>(), shared_from_this());
+        if (rc == ReturnCode::Ok) {
+            _inFlight.insert(::std::make_pair(read.path, read));
+        } else if (!retry(read, rc)) {
+            _rc = rc;
+        }
+    }
+}
+
+
+void ServiceDiscoveryClient::RegistryCrawl::add(const Read& read, ::std::vector< ::std::string>& children) {
+    if (!read.service.empty()) {
+        _registry[read.app][read.service].swap(children);
+        return;
+    }
+
+    Read next;
+    next.app = read.app;
+    for (::std::vector< ::std::string>::const_iterator it = children.begin(); it != children.end(); ++it) {
+        if (read.app.empty()) {
+            //an application, list its services next
+            _registry[*it];
+            next.app = *it;
+            next.path = makeZKPath(*it);
+        } else if (*it != SECURITY_ZK_PATH) {
+            //a service, list its end points next. The security node of an application is no service
+            _registry[read.app][*it];
+            next.service = *it;
+            next.path = makeZKPath(read.app, *it, ENDPOINTS_ZK_PATH);
+        } else {
+            continue;
+        }
+        _queue.push_back(next);
+    }
+}
+
+
+bool ServiceDiscoveryClient::RegistryCrawl::retry(const Read& read, ReturnCode::type rc) {
+    unsigned int delayMs = 0;
+    if (!_policy->retryAfter(read.attempts, rc, delayMs)) {
+        return false;
+    }
+
+    Read again = read;
+    ++again.attempts;
+    if (!_timer->schedule(delayMs, ::boost::bind(&RegistryCrawl::resend, shared_from_this(), again))) {
+        //the client is going away
+        return false;
+    }
+    ++_retrying;
+    return true;
+}
+
+
+bool ServiceDiscoveryClient::RegistryCrawl::finished() {
+    if (_finished) {
+        return false;
+    }
+    if (_rc == ReturnCode::Ok && !(_queue.empty() && _inFlight.empty() && _retrying == 0)) {
+        return false;
+    }
+    _finished = true;
+    return true;
+}
+
+
+void ServiceDiscoveryClient::RegistryCrawl::complete() {
+    //nothing touches the registry once the crawl is finished
+    if (_rc != ReturnCode::Ok) {
+        _registry.clear();
+    }
+    RegistryDone done;
+    done.swap(_done);
+    done(_rc, _registry);
+}
+
+
+::std::string ServiceDiscoveryClient::namespacedConnectString(const ::std::string& connectString) {
+    //validate the connection string
+    if (connectString.find(PATH_DELIM) != ::std::string::npos) {
+        THROW_EXCEPTION(ServiceDiscoveryException,
+                "ZK connect string should not contain \"" +
+                PATH_DELIM + "\": " + connectString);
+    }
+
+    //append our namespace for connection to zookeeper - this will serve as the chroot
+    return connectString + PATH_DELIM + NAMESPACE;
+}
+
+
 void ServiceDiscoveryClient::initializeNamespace(const ::std::string& connectString) {
     //initialize a zookeeper connection without a namespace CHROOT
     if (ReturnCode::Ok != _handle.init(connectString, DEFAULT_SESSION_TIMEOUT,
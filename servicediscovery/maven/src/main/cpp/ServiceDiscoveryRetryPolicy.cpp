@@ -0,0 +1,134 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryRetryPolicy.cpp
+ */
+
+#include <ezbake/ezdiscovery/ServiceDiscoveryRetryPolicy.h>
+#include <boost/bind.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread/locks.hpp>
+#include <ctime>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+using namespace org::apache::zookeeper;
+
+
+ExponentialBackoffRetry::ExponentialBackoffRetry(unsigned int maxTries, unsigned int baseDelayMs,
+        unsigned int maxDelayMs, unsigned int maxTokens)
+    : _maxTries(maxTries),
+      _baseDelayMs(baseDelayMs),
+      _maxDelayMs(maxDelayMs),
+      _maxTokens(static_cast<int>(maxTokens) * TOKEN),
+      _tokens(static_cast<int>(maxTokens) * TOKEN),
+      _random(static_cast<unsigned int>(::time(NULL)) ^ static_cast<unsigned int>(
+              reinterpret_cast<size_t>(this))) {}
+
+
+bool ExponentialBackoffRetry::shouldRetry(unsigned int attempts, ReturnCode::type, unsigned int& delayMs) {
+    if (attempts >= _maxTries) {
+        return false;
+    }
+
+    //spend a token; with the budget used up we give up until answers earn some back
+    int tokens = _tokens.load();
+    do {
+        if (tokens < TOKEN) {
+            return false;
+        }
+    } while (!_tokens.compare_exchange_weak(tokens, tokens - TOKEN));
+
+    //double the window with every retry, without overflowing it past the cap
+    unsigned int window = _baseDelayMs;
+    for (unsigned int i = 1; i < attempts && window < _maxDelayMs; ++i) {
+        window *= 2;
+    }
+    if (window > _maxDelayMs) {
+        window = _maxDelayMs;
+    }
+
+    //full jitter, so that clients that lost the same server do not come back in lockstep
+    ::boost::lock_guard< ::boost::mutex> lock(_randomMutex);
+    delayMs = ::boost::random::uniform_int_distribution<unsigned int>(0, window)(_random);
+    return true;
+}
+
+
+void ExponentialBackoffRetry::onAnswer() {
+    int tokens = _tokens.load();
+    while (tokens < _maxTokens && !_tokens.compare_exchange_weak(tokens, tokens + 1)) {}
+}
+
+
+bool RetryTimer::schedule(unsigned int delayMs, const ::boost::function<void ()>& fn) {
+    ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+    if (_stopped) {
+        return false;
+    }
+    if (!_thread.joinable()) {
+        _thread = ::boost::thread(::boost::bind(&RetryTimer::run, this));
+    }
+
+    ::boost::system_time deadline = ::boost::get_system_time() + ::boost::posix_time::milliseconds(delayMs);
+    //insert before reading begin(): the operands of == may be evaluated in either order
+    ::std::multimap< ::boost::system_time, ::boost::function<void ()> >::iterator timer =
+            _timers.insert(::std::make_pair(deadline, fn));
+    if (timer == _timers.begin()) {
+        _cond.notify_one();
+    }
+    return true;
+}
+
+
+void RetryTimer::stop() {
+    {
+        ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+        _stopped = true;
+        _timers.clear();
+    }
+    _cond.notify_one();
+
+    if (_thread.joinable() && _thread.get_id() != ::boost::this_thread::get_id()) {
+        _thread.join();
+    }
+}
+
+
+void RetryTimer::run() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    while (!_stopped) {
+        if (_timers.empty()) {
+            _cond.wait(lock);
+            continue;
+        }
+        if (_timers.begin()->first > ::boost::get_system_time()) {
+            _cond.timed_wait(lock, _timers.begin()->first);
+            continue;
+        }
+
+        //run it unlocked: it may well schedule itself again
+        ::boost::function<void ()> fn;
+        fn.swap(_timers.begin()->second);
+        _timers.erase(_timers.begin());
+        lock.unlock();
+        fn();
+        fn.clear();
+        lock.lock();
+    }
+}
+
+}} // namespace ::ezbake::ezdiscovery
@@ -20,24 +20,86 @@
  */
 
 #include <ezbake/ezdiscovery/ServiceDiscoverySyncClient.h>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
 #include <sstream>
 
 namespace ezbake { namespace ezdiscovery {
 
 using namespace org::apache::zookeeper;
 
+namespace {
+
+/*
+ * Hands the outcome of a registry crawl over to the thread waiting for it
+ */
+class RegistryResult : private ::boost::noncopyable {
+public:
+    RegistryResult() : _done(false), _rc(ReturnCode::Ok) {}
+
+    void set(ReturnCode::type rc, RegistrySnapshot& registry) {
+        ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+        _rc = rc;
+        _registry.swap(registry);
+        _done = true;
+        _cond.notify_all();
+    }
+
+    ReturnCode::type wait(RegistrySnapshot& registry) {
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        while (!_done) {
+            _cond.wait(lock);
+        }
+        registry.swap(_registry);
+        return _rc;
+    }
+
+private:
+    bool _done;
+    ReturnCode::type _rc;
+    RegistrySnapshot _registry;
+    ::boost::mutex _mutex;
+    ::boost::condition_variable _cond;
+};
+
+} // namespace
+
 
 void ServiceDiscoverySyncClient::registerEndpoint(const ::std::string& serviceName,
-        const ::std::string& point) {
-    registerEndpoint(JUST_SERVICE_APP_NAME, serviceName, point);
+        const ::std::string& point, RegistrationMode mode) {
+    registerEndpoint(JUST_SERVICE_APP_NAME, serviceName, point, mode);
 }
 
 
 void ServiceDiscoverySyncClient::registerEndpoint(const ::std::string& appName,
-        const ::std::string& serviceName, const ::std::string& point) {
+        const ::std::string& serviceName, const ::std::string& point, RegistrationMode mode) {
     validateHostAndPort(point); //validate the host and port for the point
-    createPath(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point));
+    createPath(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point), mode);
+}
+
+
+void ServiceDiscoverySyncClient::registerEphemeralEndpoint(const ::std::string& serviceName,
+        const ::std::string& point, RegistrationMode mode) {
+    registerEphemeralEndpoint(JUST_SERVICE_APP_NAME, serviceName, point, mode);
+}
+
+
+void ServiceDiscoverySyncClient::registerEphemeralEndpoint(const ::std::string& appName,
+        const ::std::string& serviceName, const ::std::string& point, RegistrationMode mode) {
+    validateHostAndPort(point); //validate the host and port for the point
+    ::std::string path = makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point);
+
+    //track it first, so that a session that expires while we create it is covered too
+    trackEphemeral(path);
+    try {
+        createPath(path, mode, CreateMode::Ephemeral);
+    } catch (...) {
+        untrackEphemeral(path);
+        throw;
+    }
 }
 
 
@@ -50,9 +112,10 @@ void ServiceDiscoverySyncClient::unregisterEndpoint(const ::std::string& service
 void ServiceDiscoverySyncClient::unregisterEndpoint(const ::std::string& appName,
         const ::std::string& serviceName, const ::std::string& point) {
     std::string path = makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH, point);
+    untrackEphemeral(path);
 
     //delete the endpoint
-    ReturnCode::type response = _handle.remove(path, -1);
+    ReturnCode::type response = removeNode(path);
 
     if (response != ReturnCode::Ok && response != ReturnCode::NoNode) {
         THROW_EXCEPTION(ServiceDiscoveryException, "Error in unregistering endpoint: " + path);
@@ -71,13 +134,8 @@ void ServiceDiscoverySyncClient::unregisterEndpoint(const ::std::string& appName
 
 
 ::std::vector< ::std::string> ServiceDiscoverySyncClient::getServices(const ::std::string& appName) {
-    ::std::vector< ::std::string> services;
-    ::std::string path = makeZKPath(appName);
-
-    if (checkPathExists(path)) {
-        return getChildren(path);
-    }
-    return services;
+    //a missing application reads as no children, no need to check it exists first
+    return getChildren(makeZKPath(appName));
 }
 
 
@@ -88,13 +146,118 @@ void ServiceDiscoverySyncClient::unregisterEndpoint(const ::std::string& appName
 
 std::vector<std::string> ServiceDiscoverySyncClient::getEndpoints(const ::std::string& appName,
         const ::std::string& serviceName) {
-    ::std::vector< ::std::string> endpoints;
+    return getChildren(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH));
+}
+
+
+::std::vector< ::std::string> ServiceDiscoverySyncClient::getEndpoints(const ::std::string& appName,
+        const ::std::string& serviceName, bool& stale) {
+    ::std::vector< ::std::string> children;
+    ReturnCode::type response = _childrenReads.read(_handle, *_retryPolicy,
+            makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH), children, &stale);
+
+    if (response != ReturnCode::Ok && response != ReturnCode::NoNode) {
+        ::std::ostringstream ss;
+        ss << "Error in getting children. ZK error: " << response;
+        THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+    }
+
+    return children;
+}
+
+
+void ServiceDiscoverySyncClient::setLastKnownReads(unsigned int maxPaths, unsigned int maxAgeMs) {
+    //only children reads accept stale results
+    _childrenReads.keepLastKnown(maxPaths, maxAgeMs);
+}
+
+
+void ServiceDiscoverySyncClient::getEndpoints(const ::std::string& serviceName,
+        FlatStringList& endpoints) {
+    getEndpoints(JUST_SERVICE_APP_NAME, serviceName, endpoints);
+}
+
+
+void ServiceDiscoverySyncClient::getEndpoints(const ::std::string& appName,
+        const ::std::string& serviceName, FlatStringList& endpoints) {
+    endpoints.clear();
+    getChildren(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH), endpoints);
+}
+
+
+bool ServiceDiscoverySyncClient::getEndpointsIfChanged(const ::std::string& appName,
+        const ::std::string& serviceName, ::std::vector< ::std::string>& endpoints, int32_t& version) {
     ::std::string path = makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH);
 
-    if (checkPathExists(path)) {
-        return getChildren(path);
+    //the children version moves on every child added or removed, so compare it first
+    data::Stat stat;
+    if (!checkPathExists(path, stat)) {
+        bool changed = (version != -1);
+        endpoints.clear();
+        version = -1;
+        return changed;
+    }
+    if (stat.getcversion() == version) {
+        return false;
+    }
+
+    ::std::vector< ::std::string> children;
+    ReturnCode::type response;
+    unsigned int attempts = 0;
+    do {
+        response = _handle.getChildren(path, boost::shared_ptr<Watch>(), children, stat);
+    } while (_retryPolicy->awaitRetry(++attempts, response));
+    if (response == ReturnCode::NoNode) {
+        bool changed = (version != -1);
+        endpoints.clear();
+        version = -1;
+        return changed;
+    }
+    if (response != ReturnCode::Ok) {
+        ::std::ostringstream ss;
+        ss << "Error in getting children. ZK error: " << response;
+        THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+    }
+
+    endpoints.swap(children);
+    version = stat.getcversion();
+    return true;
+}
+
+
+unsigned int ServiceDiscoverySyncClient::getEndpointCount(const ::std::string& serviceName) {
+    return getEndpointCount(JUST_SERVICE_APP_NAME, serviceName);
+}
+
+
+unsigned int ServiceDiscoverySyncClient::getEndpointCount(const ::std::string& appName,
+        const ::std::string& serviceName) {
+    data::Stat stat;
+    if (!checkPathExists(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH), stat)) {
+        return 0;
     }
-    return endpoints;
+    return static_cast<unsigned int>(stat.getnumChildren());
+}
+
+
+RegistrySnapshot ServiceDiscoverySyncClient::getRegistrySnapshot(unsigned int maxConcurrency) {
+    ::boost::shared_ptr<RegistryResult> result = ::boost::make_shared<RegistryResult>();
+    ::boost::shared_ptr<RetryTimer> timer = ::boost::make_shared<RetryTimer>();
+
+    RegistrySnapshot registry;
+    ReturnCode::type response = crawlRegistry(maxConcurrency, timer,
+            ::boost::bind(&RegistryResult::set, result, _1, _2));
+    if (response == ReturnCode::Ok) {
+        response = result->wait(registry);
+    }
+    timer->stop();
+
+    if (response != ReturnCode::Ok) {
+        ::std::ostringstream ss;
+        ss << "Error in getting the registry snapshot. ZK error: " << response;
+        THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+    }
+    return registry;
 }
 
 
@@ -137,7 +300,12 @@ bool ServiceDiscoverySyncClient::isServiceCommon(const ::std::string& serviceNam
 
 bool ServiceDiscoverySyncClient::checkPathExists(const ::std::string& path) {
     data::Stat stat;
-    ReturnCode::type response = _handle.exists(path, boost::shared_ptr<Watch>(), stat);
+    return checkPathExists(path, stat);
+}
+
+
+bool ServiceDiscoverySyncClient::checkPathExists(const ::std::string& path, data::Stat& stat) {
+    ReturnCode::type response = _existsReads.read(_handle, *_retryPolicy, path, stat);
 
     if (response != ReturnCode::Ok && response != ReturnCode::NoNode) {
         ::std::ostringstream ss;
@@ -149,14 +317,35 @@ bool ServiceDiscoverySyncClient::checkPathExists(const ::std::string& path) {
 }
 
 
-void ServiceDiscoverySyncClient::createPath(const ::std::string& path) {
-    /*
-     * Don't handle response remove, since if it doesn't exists its all good,
-     * as we are going to create it
-     */
-    _handle.remove(path, -1);
+void ServiceDiscoverySyncClient::createPath(const ::std::string& path, RegistrationMode mode,
+        CreateMode::type createMode) {
+    bool retried = false;
 
-    ::std::string pathCreated;
+    if (mode == IF_ABSENT) {
+        /*
+         * Try the node itself first: if it is already there (the common case when
+         * re-registering) that is the only request, and nothing changes for watchers
+         */
+        ReturnCode::type response = createNode(path, createMode, retried);
+        if (response == ReturnCode::Ok || (response == ReturnCode::NodeExists && isOurs(path, createMode))) {
+            return;
+        }
+        if (response == ReturnCode::NodeExists) {
+            //a persistent end point, or one of another session, that we are to register ephemeral
+            removeNode(path);
+        } else if (response != ReturnCode::NoNode) {
+            ::std::ostringstream ss;
+            ss << "Error in creating node: " << path << " ZK error: " << response;
+            THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+        }
+        //else a parent is missing, create the whole path
+    } else {
+        /*
+         * Don't handle response remove, since if it doesn't exists its all good,
+         * as we are going to create it
+         */
+        removeNode(path);
+    }
 
     /*
      * Create parents. No need to check if they already exists because even if one doens't
@@ -166,9 +355,7 @@ void ServiceDiscoverySyncClient::createPath(const ::std::string& path) {
     ::std::string pathToCreate = "";
     for (unsigned int i = 0; i < (paths.size() - 1); i++) {
         pathToCreate += PATH_DELIM + paths.at(i);
-        ReturnCode::type response = _handle.create(pathToCreate, "",
-                                                   SD_DEFAULT_ACL, CreateMode::Persistent,
-                                                   pathCreated);
+        ReturnCode::type response = createNode(pathToCreate, CreateMode::Persistent, retried);
         if (response != ReturnCode::Ok && response != ReturnCode::NodeExists) {
             ::std::ostringstream ss;
             ss << "Error in creating parents for node: " << pathToCreate << " ZK error: " << response;
@@ -176,20 +363,68 @@ void ServiceDiscoverySyncClient::createPath(const ::std::string& path) {
         }
     }
 
-    //create child node
-    ReturnCode::type response = _handle.create(path, "", SD_DEFAULT_ACL, CreateMode::Persistent, pathCreated);
-    if (response != ReturnCode::Ok) {
+    //create child node. If it is there after a lost attempt, that attempt created it
+    ReturnCode::type response = createNode(path, createMode, retried);
+    if (response != ReturnCode::Ok &&
+            !((mode == IF_ABSENT || retried) && response == ReturnCode::NodeExists && isOurs(path, createMode))) {
         ::std::ostringstream ss;
         ss << "Error in creating node: " << path << " ZK error: " << response;
         THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
     }
 }
 
-::std::vector< ::std::string> ServiceDiscoverySyncClient::getChildren(const ::std::string& path) {
+
+bool ServiceDiscoverySyncClient::isOurs(const ::std::string& path, CreateMode::type createMode) {
+    if (createMode != CreateMode::Ephemeral) {
+        return true;
+    }
+
+    //an ephemeral node has to be of our session, or it would not go away with it
     data::Stat stat;
+    return checkPathExists(path, stat) && ownsEphemeral(stat);
+}
+
+
+ReturnCode::type ServiceDiscoverySyncClient::createNode(const ::std::string& path,
+        CreateMode::type createMode, bool& retried) {
+    ::std::string pathCreated;
+    ReturnCode::type response;
+    unsigned int attempts = 0;
+    do {
+        response = _handle.create(path, "", SD_DEFAULT_ACL, createMode, pathCreated);
+    } while (_retryPolicy->awaitRetry(++attempts, response));
+
+    retried = (attempts > 1);
+    if (response == ReturnCode::Ok) {
+        written(path);
+    }
+    return response;
+}
+
+
+ReturnCode::type ServiceDiscoverySyncClient::removeNode(const ::std::string& path) {
+    ReturnCode::type response;
+    unsigned int attempts = 0;
+    do {
+        response = _handle.remove(path, -1);
+    } while (_retryPolicy->awaitRetry(++attempts, response));
+    if (response == ReturnCode::Ok) {
+        written(path);
+    }
+    return response;
+}
+
+void ServiceDiscoverySyncClient::written(const ::std::string& path) {
+    _existsReads.written(path);
+    _childrenReads.written(path);
+    _flatReads.written(path);
+}
+
+
+::std::vector< ::std::string> ServiceDiscoverySyncClient::getChildren(const ::std::string& path) {
     ::std::vector< ::std::string> children;
 
-    ReturnCode::type response = _handle.getChildren(path, boost::shared_ptr<Watch>(), children, stat);
+    ReturnCode::type response = _childrenReads.read(_handle, *_retryPolicy, path, children);
 
     if (response != ReturnCode::Ok && response != ReturnCode::NoNode) {
         ::std::ostringstream ss;
@@ -200,4 +435,15 @@ void ServiceDiscoverySyncClient::createPath(const ::std::string& path) {
     return children;
 }
 
+
+void ServiceDiscoverySyncClient::getChildren(const ::std::string& path, FlatStringList& children) {
+    ReturnCode::type response = _flatReads.read(_handle, *_retryPolicy, path, children);
+
+    if (response != ReturnCode::Ok && response != ReturnCode::NoNode) {
+        ::std::ostringstream ss;
+        ss << "Error in getting children. ZK error: " << response;
+        THROW_EXCEPTION(ServiceDiscoveryException, ss.str());
+    }
+}
+
 }} // namespace ::ezbake::ezdiscovery
@@ -0,0 +1,905 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryTreeCache.cpp
+ */
+
+#include <ezbake/ezdiscovery/ServiceDiscoveryTreeCache.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+using namespace org::apache::zookeeper;
+
+namespace {
+
+template<typename Child>
+struct ChildNameLess {
+    bool operator()(const Child& lhs, const ::std::string& rhs) const {
+        return lhs.first < rhs;
+    }
+};
+
+/*
+ * A snapshot file is a header followed by one record per node, in depth-first order, each record
+ * followed by the name of its node padded to 8 bytes. Everything is in the byte order of the host
+ * that wrote it, and aligned so that the records can be read in place from a mapped file.
+ */
+const char SNAPSHOT_MAGIC[8] = {'E', 'Z', 'S', 'D', 'S', 'N', 'A', 'P'};
+const uint32_t SNAPSHOT_FORMAT = 1;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+const size_t SNAPSHOT_MAX_DEPTH = 16;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t byteOrder;
+    int64_t zxid; //highest zxid the tree reflects
+    uint64_t nodeCount;
+    uint64_t length; //bytes of records after the header
+    uint32_t checksum; //crc32 of the records
+    uint32_t reserved;
+};
+
+struct SnapshotRecord {
+    int64_t pzxid;
+    int32_t cversion;
+    uint32_t childCount;
+    uint32_t nameLength;
+    uint32_t reserved;
+};
+
+size_t padded(size_t length) {
+    return (length + 7) & ~static_cast<size_t>(7);
+}
+
+uint32_t checksum(const char* data, size_t length) {
+    ::boost::crc_32_type crc;
+    crc.process_bytes(data, length);
+    return crc.checksum();
+}
+
+/*
+ * Errors a read may succeed after once the session is connected again
+ */
+bool isDisconnected(ReturnCode::type rc) {
+    return isSessionLoss(rc) || rc == ReturnCode::InvalidState || rc == ReturnCode::SessionMoved;
+}
+
+} // namespace
+
+
+ServiceDiscoveryTreeCache::ServiceDiscoveryTreeCache(unsigned int maxConcurrency,
+        unsigned int refreshIntervalMs, unsigned int refreshJitterMs)
+    : _crawler(::boost::make_shared<Crawler>(_handle, ::std::max(maxConcurrency, 1u),
+            refreshIntervalMs, refreshJitterMs)),
+      _persistIntervalMs(DEFAULT_PERSIST_INTERVAL),
+      _persistedZxid(-1) {}
+
+
+ServiceDiscoveryTreeCache::~ServiceDiscoveryTreeCache() {
+    close();
+}
+
+
+void ServiceDiscoveryTreeCache::start() {
+    _crawler->start();
+}
+
+
+void ServiceDiscoveryTreeCache::validate() {
+    _crawler->validate();
+}
+
+
+void ServiceDiscoveryTreeCache::close() {
+    //save what we have for the next start, unless it did not change
+    _persistTimer.stop();
+    persist();
+    {
+        ::boost::lock_guard< ::boost::mutex> lock(_persistMutex);
+        _persistPath.clear();
+    }
+
+    //stop the crawler touching the handle before the handle goes away
+    _crawler->detach();
+    ServiceDiscoveryClient::close();
+}
+
+
+bool ServiceDiscoveryTreeCache::waitUntilInitialized(unsigned int timeoutMs) {
+    return _crawler->waitUntilInitialized(timeoutMs);
+}
+
+
+::std::map< ::std::string, ReturnCode::type> ServiceDiscoveryTreeCache::getUnreadablePaths() const {
+    return _crawler->getUnreadable();
+}
+
+
+uint64_t ServiceDiscoveryTreeCache::getRequestCount() const {
+    return _crawler->getRequestCount();
+}
+
+
+::boost::shared_ptr<const ServiceDiscoveryTreeCache::Snapshot> ServiceDiscoveryTreeCache::getSnapshot() const {
+    return _crawler->getSnapshot();
+}
+
+
+bool ServiceDiscoveryTreeCache::loadSnapshot(const ::std::string& path) {
+    return _crawler->load(path);
+}
+
+
+bool ServiceDiscoveryTreeCache::saveSnapshot(const ::std::string& path) {
+    return _crawler->save(path);
+}
+
+
+void ServiceDiscoveryTreeCache::persistSnapshot(const ::std::string& path, unsigned int intervalMs) {
+    ::boost::lock_guard< ::boost::mutex> lock(_persistMutex);
+    bool persisting = !_persistPath.empty();
+    if (path != _persistPath) {
+        _persistedZxid = -1;
+    }
+    _persistPath = path;
+    _persistIntervalMs = intervalMs;
+    if (!persisting && !_persistTimer.schedule(_persistIntervalMs,
+            ::boost::bind(&ServiceDiscoveryTreeCache::persist, this))) {
+        _persistPath.clear();
+        THROW_EXCEPTION(ServiceDiscoveryException, "Tree cache has been closed");
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::persist() {
+    ::boost::lock_guard< ::boost::mutex> lock(_persistMutex);
+    if (_persistPath.empty()) {
+        return;
+    }
+
+    int64_t zxid = _crawler->getSnapshot()->getZxid();
+    if (zxid != _persistedZxid) {
+        try {
+            if (_crawler->save(_persistPath)) {
+                _persistedZxid = zxid;
+            }
+        } catch (const ServiceDiscoveryException&) {
+            //the previous snapshot stays in place; try again at the next interval
+        }
+    }
+    _persistTimer.schedule(_persistIntervalMs, ::boost::bind(&ServiceDiscoveryTreeCache::persist, this));
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Snapshot::getApplications() const {
+    return getChildren(PATH_DELIM);
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Snapshot::getServices() const {
+    return getServices(JUST_SERVICE_APP_NAME);
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Snapshot::getServices(
+        const ::std::string& appName) const {
+    return getChildren(makeZKPath(appName));
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Snapshot::getEndpoints(
+        const ::std::string& serviceName) const {
+    return getEndpoints(JUST_SERVICE_APP_NAME, serviceName);
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Snapshot::getEndpoints(
+        const ::std::string& appName, const ::std::string& serviceName) const {
+    return getChildren(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH));
+}
+
+
+size_t ServiceDiscoveryTreeCache::Snapshot::getEndpointCount(const ::std::string& serviceName) const {
+    return getEndpointCount(JUST_SERVICE_APP_NAME, serviceName);
+}
+
+
+size_t ServiceDiscoveryTreeCache::Snapshot::getEndpointCount(const ::std::string& appName,
+        const ::std::string& serviceName) const {
+    const Node* node = find(makeZKPath(appName, serviceName, ENDPOINTS_ZK_PATH));
+    return node ? node->children.size() : 0;
+}
+
+
+::std::string ServiceDiscoveryTreeCache::Snapshot::getSecurityIdForApplication(
+        const ::std::string& applicationName) const {
+    const Node* node = find(makeZKPath(applicationName, SECURITY_ZK_PATH, SECURITY_ID_NODE));
+    return (node && node->children.size()) ? node->children.front().first : "";
+}
+
+
+::std::string ServiceDiscoveryTreeCache::Snapshot::getSecurityIdForCommonService(
+        const ::std::string& serviceName) const {
+    const Node* node = find(makeZKPath(JUST_SERVICE_APP_NAME, serviceName,
+            SECURITY_ZK_PATH, SECURITY_ID_NODE));
+    return (node && node->children.size()) ? node->children.front().first : "";
+}
+
+
+bool ServiceDiscoveryTreeCache::Snapshot::isServiceCommon(const ::std::string& serviceName) const {
+    return find(makeZKPath(JUST_SERVICE_APP_NAME, serviceName)) != NULL;
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Snapshot::getChildren(
+        const ::std::string& path) const {
+    const Node* node = find(path);
+    return node ? node->names() : ::std::vector< ::std::string>();
+}
+
+
+size_t ServiceDiscoveryTreeCache::Snapshot::size() const {
+    return _root->size;
+}
+
+
+int64_t ServiceDiscoveryTreeCache::Snapshot::getZxid() const {
+    return _root->zxid;
+}
+
+
+const ServiceDiscoveryTreeCache::Node* ServiceDiscoveryTreeCache::Snapshot::find(
+        const ::std::string& path) const {
+    const Node* node = _root.get();
+    ::std::vector< ::std::string> nodes = splitPath(path);
+    for (size_t i = 0; node && i < nodes.size(); ++i) {
+        node = node->find(nodes[i]);
+    }
+    return node;
+}
+
+
+const ServiceDiscoveryTreeCache::Node* ServiceDiscoveryTreeCache::Node::find(
+        const ::std::string& name) const {
+    Children::const_iterator it = ::std::lower_bound(children.begin(), children.end(), name,
+            ChildNameLess<Child>());
+    return (it != children.end() && it->first == name) ? it->second.get() : NULL;
+}
+
+
+::std::vector< ::std::string> ServiceDiscoveryTreeCache::Node::names() const {
+    ::std::vector< ::std::string> result;
+    result.reserve(children.size());
+    for (Children::const_iterator it = children.begin(); it != children.end(); ++it) {
+        result.push_back(it->first);
+    }
+    return result;
+}
+
+
+ServiceDiscoveryTreeCache::Crawler::Crawler(ZooKeeper& handle, unsigned int maxConcurrency,
+        unsigned int refreshIntervalMs, unsigned int refreshJitterMs)
+    : _handle(&handle),
+      _maxConcurrency(maxConcurrency),
+      _refreshIntervalMs(refreshIntervalMs),
+      _refreshJitterMs(refreshJitterMs),
+      _initialized(false),
+      _warm(false),
+      _expired(false),
+      _requests(0),
+      _random(static_cast<unsigned int>(::time(NULL)) ^ static_cast<unsigned int>(
+              reinterpret_cast<size_t>(this))),
+      _root(::boost::make_shared<Node>()) {}
+
+
+void ServiceDiscoveryTreeCache::Crawler::start() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    if (_handle == NULL) {
+        THROW_EXCEPTION(ServiceDiscoveryException, "Tree cache has been closed");
+    }
+
+    if ((_refreshIntervalMs || _refreshJitterMs) && !_timerThread.joinable()) {
+        _timerThread = ::boost::thread(::boost::bind(&Crawler::runTimers, this));
+    }
+
+    //retry anything that could not be read so far along with the root
+    ::boost::unordered_set< ::std::string> failed;
+    failed.swap(_failed);
+    for (::boost::unordered_set< ::std::string>::const_iterator it = failed.begin();
+            it != failed.end(); ++it) {
+        refresh(*it, false);
+    }
+    for (::std::map< ::std::string, ReturnCode::type>::const_iterator it = _unreadable.begin();
+            it != _unreadable.end(); ++it) {
+        refresh(it->first, false);
+    }
+    if (_warm) {
+        //the tree came from a snapshot file: read every node of it again, and watch it
+        ::std::vector< ::std::string> nodes;
+        refreshTree(*_root, PATH_DELIM, nodes, false, false);
+    } else {
+        refresh(PATH_DELIM, false);
+    }
+    dispatch();
+
+    if (_inFlight.empty()) {
+        THROW_EXCEPTION(ServiceDiscoveryException,
+                "Error in starting tree cache. ZK error: error in dispatching request");
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::validate() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    if (_handle == NULL) {
+        THROW_EXCEPTION(ServiceDiscoveryException, "Tree cache has been closed");
+    }
+
+    ::std::vector< ::std::string> nodes;
+    refreshTree(*_root, PATH_DELIM, nodes, false, true);
+    dispatch();
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::refreshTree(const Node& node, const ::std::string& path,
+        ::std::vector< ::std::string>& nodes, bool delayed, bool check) {
+    refresh(path, delayed, check);
+    for (Node::Children::const_iterator it = node.children.begin(); it != node.children.end(); ++it) {
+        nodes.push_back(it->first);
+        if (!isLeaf(nodes)) {
+            refreshTree(*it->second, childPath(path, it->first), nodes, delayed, check);
+        }
+        nodes.pop_back();
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::detach() {
+    {
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        _handle = NULL;
+    }
+    _timerCond.notify_all();
+    if (_timerThread.joinable()) {
+        _timerThread.join();
+    }
+}
+
+
+bool ServiceDiscoveryTreeCache::Crawler::waitUntilInitialized(unsigned int timeoutMs) {
+    ::boost::system_time deadline = ::boost::get_system_time() +
+            ::boost::posix_time::milliseconds(timeoutMs);
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    while (!_initialized) {
+        if (!_cond.timed_wait(lock, deadline)) {
+            return _initialized;
+        }
+    }
+    return true;
+}
+
+
+::std::map< ::std::string, ReturnCode::type> ServiceDiscoveryTreeCache::Crawler::getUnreadable() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    return _unreadable;
+}
+
+
+uint64_t ServiceDiscoveryTreeCache::Crawler::getRequestCount() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    return _requests;
+}
+
+
+::boost::shared_ptr<const ServiceDiscoveryTreeCache::Snapshot> ServiceDiscoveryTreeCache::Crawler::getSnapshot() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    return ::boost::shared_ptr<const Snapshot>(new Snapshot(_root, _warm));
+}
+
+
+bool ServiceDiscoveryTreeCache::Crawler::load(const ::std::string& path) {
+    namespace ipc = ::boost::interprocess;
+    ::boost::shared_ptr<const Node> root;
+
+    try {
+        ipc::file_mapping file(path.c_str(), ipc::read_only);
+        ipc::mapped_region region(file, ipc::read_only);
+        const char* begin = static_cast<const char*>(region.get_address());
+        size_t size = region.get_size();
+        if (size < sizeof(SnapshotHeader)) {
+            return false;
+        }
+
+        const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(begin);
+        if (::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+                header->format != SNAPSHOT_FORMAT || header->byteOrder != SNAPSHOT_BYTE_ORDER ||
+                header->length != size - sizeof(SnapshotHeader)) {
+            return false;
+        }
+
+        const char* pos = begin + sizeof(SnapshotHeader);
+        const char* end = begin + size;
+        if (checksum(pos, header->length) != header->checksum) {
+            return false;
+        }
+
+        ::std::string name;
+        root = deserialize(pos, end, name, 0);
+        if (!root || pos != end || root->size + 1 != header->nodeCount) {
+            return false;
+        }
+    } catch (const ipc::interprocess_exception&) {
+        //no snapshot, or one we cannot read
+        return false;
+    }
+
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    if (_root->cversion != -1) {
+        //we already read the namespace itself, which is better than any snapshot
+        return false;
+    }
+    _root = root;
+    _warm = true;
+    return true;
+}
+
+
+bool ServiceDiscoveryTreeCache::Crawler::save(const ::std::string& path) {
+    ::boost::shared_ptr<const Node> root;
+    {
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        if (!_initialized) {
+            return false;
+        }
+        root = _root;
+    }
+
+    //the tree is immutable, so it is written out without holding up the crawl
+    ::std::string records;
+    records.reserve((root->size + 1) * (sizeof(SnapshotRecord) + 32));
+    serialize(*root, "", records);
+
+    SnapshotHeader header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.format = SNAPSHOT_FORMAT;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.zxid = root->zxid;
+    header.nodeCount = root->size + 1;
+    header.length = records.size();
+    header.checksum = checksum(records.data(), records.size());
+
+    //write next to the file and rename over it, so that nobody ever maps half a snapshot
+    ::std::string temporary = path + ".tmp";
+    {
+        ::std::ofstream out(temporary.c_str(), ::std::ios::out | ::std::ios::binary | ::std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(records.data(), static_cast< ::std::streamsize>(records.size()));
+        out.close();
+        if (!out) {
+            ::std::remove(temporary.c_str());
+            THROW_EXCEPTION(ServiceDiscoveryException, "Error in writing tree cache snapshot: " + temporary);
+        }
+    }
+    if (::std::rename(temporary.c_str(), path.c_str()) != 0) {
+        ::std::remove(temporary.c_str());
+        THROW_EXCEPTION(ServiceDiscoveryException, "Error in writing tree cache snapshot: " + path);
+    }
+    return true;
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::process(ReturnCode::type rc, const ::std::string& path,
+        const ::std::vector< ::std::string>& children, const data::Stat& stat) {
+    process(rc, path, ::std::vector< ::std::string>(children), stat);
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::process(ReturnCode::type rc, const ::std::string& path,
+        ::std::vector< ::std::string>&& children, const data::Stat& stat) {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    _inFlight.erase(path);
+
+    if (rc == ReturnCode::Ok) {
+        update(path, children, stat);
+    }
+    finish(rc, path);
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::process(ReturnCode::type rc, const ::std::string& path,
+        const data::Stat& stat) {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    _inFlight.erase(path);
+
+    if (rc == ReturnCode::Ok) {
+        //only list the children if they moved on since we last did
+        const Node* node = Snapshot(_root).find(path);
+        if (node == NULL || node->cversion != stat.getcversion()) {
+            refresh(path, false);
+        }
+    }
+    finish(rc, path);
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::finish(ReturnCode::type rc, const ::std::string& path) {
+    if (rc == ReturnCode::NoNode) {
+        remove(path);
+    } else if (isDisconnected(rc)) {
+        //read again once the session reconnects
+        _failed.insert(path);
+    } else if (rc != ReturnCode::Ok) {
+        //reconnecting will not help, so do not hold up initialization for it
+        _unreadable[path] = rc;
+    }
+    if (rc == ReturnCode::Ok || rc == ReturnCode::NoNode) {
+        _unreadable.erase(path);
+    }
+
+    if (_dirty.erase(path) && rc != ReturnCode::NoNode) {
+        //the node changed again while this read was in flight
+        refresh(path, true);
+    }
+
+    dispatch();
+    checkInitialized();
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::process(WatchEvent::type event, SessionState::type state,
+        const ::std::string& path) {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+
+    switch (event) {
+    case WatchEvent::ZnodeChildrenChanged:
+        refresh(path, true);
+        break;
+    case WatchEvent::ZnodeRemoved:
+        remove(path);
+        break;
+    case WatchEvent::SessionStateChanged:
+        if (state == SessionState::Expired) {
+            _expired = true;
+        } else if (state == SessionState::Connected) {
+            //every client reconnects at once after an outage, so spread the retries out too
+            ::boost::unordered_set< ::std::string> failed;
+            failed.swap(_failed);
+            for (::boost::unordered_set< ::std::string>::const_iterator it = failed.begin();
+                    it != failed.end(); ++it) {
+                refresh(*it, true);
+            }
+            if (_expired) {
+                //changes made while we had no session may have been missed: read it all again
+                _expired = false;
+                ::std::vector< ::std::string> nodes;
+                refreshTree(*_root, PATH_DELIM, nodes, true, false);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    dispatch();
+    checkInitialized();
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::refresh(const ::std::string& path, bool delayed, bool check) {
+    ::boost::unordered_map< ::std::string, bool>::iterator queued = _queued.find(path);
+    if (queued != _queued.end()) {
+        //a read that has not been sent yet will see this change
+        queued->second = queued->second && check;
+        return;
+    }
+    if (_scheduled.count(path)) {
+        return;
+    }
+    if (_inFlight.count(path)) {
+        //the read in flight may predate this change; read again once it completes
+        _dirty.insert(path);
+        return;
+    }
+    if (delayed && _timerThread.joinable()) {
+        schedule(path);
+    } else {
+        enqueue(path, check);
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::enqueue(const ::std::string& path, bool check) {
+    if (_queued.insert(::std::make_pair(path, check)).second) {
+        _queue.push_back(path);
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::schedule(const ::std::string& path) {
+    unsigned int delay = _refreshIntervalMs;
+    if (_refreshJitterMs) {
+        delay += ::boost::random::uniform_int_distribution<unsigned int>(0, _refreshJitterMs)(_random);
+    }
+
+    ::boost::system_time deadline = ::boost::get_system_time() + ::boost::posix_time::milliseconds(delay);
+    _scheduled.insert(path);
+    //insert before reading begin(): the operands of == may be evaluated in either order
+    ::std::multimap< ::boost::system_time, ::std::string>::iterator timer =
+            _timers.insert(::std::make_pair(deadline, path));
+    if (timer == _timers.begin()) {
+        _timerCond.notify_one();
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::runTimers() {
+    ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+    while (_handle != NULL) {
+        if (_timers.empty()) {
+            _timerCond.wait(lock);
+            continue;
+        }
+
+        ::boost::system_time now = ::boost::get_system_time();
+        if (_timers.begin()->first > now) {
+            _timerCond.timed_wait(lock, _timers.begin()->first);
+            continue;
+        }
+
+        //queue every refresh that is due, then send as many as the concurrency limit allows
+        while (!_timers.empty() && _timers.begin()->first <= now) {
+            ::std::string path;
+            path.swap(_timers.begin()->second);
+            _timers.erase(_timers.begin());
+            _scheduled.erase(path);
+            refresh(path, false);
+        }
+        dispatch();
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::dispatch() {
+    /*
+     * Keep up to _maxConcurrency reads in flight. Each response feeds the next level of the tree
+     * back into the queue, so the crawl is pipelined across levels rather than done level by level.
+     */
+    while (_handle != NULL && _inFlight.size() < _maxConcurrency && !_queue.empty()) {
+        ::std::string path;
+        path.swap(_queue.front());
+        _queue.pop_front();
+        ::boost::unordered_map< ::std::string, bool>::iterator queued = _queued.find(path);
+        bool check = queued->second;
+        _queued.erase(queued);
+
+        ReturnCode::type rc = check ?
+                _handle->exists(path, ::boost::shared_ptr<Watch>(), shared_from_this()) :
+                _handle->getChildren(path, shared_from_this(), shared_from_this());
+        if (ReturnCode::Ok != rc) {
+            _failed.insert(path);
+        } else {
+            _inFlight.insert(path);
+            ++_requests;
+        }
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::update(const ::std::string& path,
+        ::std::vector< ::std::string>& children, const data::Stat& stat) {
+    ::std::sort(children.begin(), children.end());
+    children.erase(::std::unique(children.begin(), children.end()), children.end());
+
+    ::std::vector< ::std::string> nodes = splitPath(path);
+    ::std::vector< ::std::string> added;
+    ::boost::shared_ptr<const Node> root = replace(_root, nodes, 0, &children, &stat, added);
+    if (!root) {
+        //the node was removed from the cache while this read was in flight
+        return;
+    }
+    _root = root;
+
+    //crawl the new children
+    nodes.push_back("");
+    for (::std::vector< ::std::string>::const_iterator it = added.begin(); it != added.end(); ++it) {
+        nodes.back() = *it;
+        if (!isLeaf(nodes)) {
+            refresh(childPath(path, *it), false);
+        }
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::remove(const ::std::string& path) {
+    ::std::vector< ::std::string> nodes = splitPath(path);
+    if (nodes.empty()) {
+        //the namespace itself is gone
+        _root = ::boost::make_shared<Node>();
+        return;
+    }
+
+    ::std::vector< ::std::string> added;
+    ::boost::shared_ptr<const Node> root = replace(_root, nodes, 0, NULL, NULL, added);
+    if (root) {
+        _root = root;
+    }
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::checkInitialized() {
+    if (!_initialized && _inFlight.empty() && _queue.empty() && _failed.empty()) {
+        //every node has been read from zookeeper, including any loaded from a snapshot
+        _initialized = true;
+        _warm = false;
+        _cond.notify_all();
+    }
+}
+
+
+bool ServiceDiscoveryTreeCache::Crawler::isLeaf(const ::std::vector< ::std::string>& nodes) {
+    /*
+     * Endpoints and security ids never have children. Their parents are watched, so there is
+     * no need to read or watch them individually:
+     *   /<app>/<service>/endpoints/<point>
+     *   /<app>/security/security_id/<id>
+     *   /common_services/<service>/security/security_id/<id>
+     */
+    size_t size = nodes.size();
+    if (size >= 5) {
+        return true;
+    }
+    return (size == 4) &&
+           (nodes[2] == ENDPOINTS_ZK_PATH || nodes[2] == SECURITY_ID_NODE);
+}
+
+
+::std::string ServiceDiscoveryTreeCache::Crawler::childPath(const ::std::string& path,
+        const ::std::string& name) {
+    return (path == PATH_DELIM) ? PATH_DELIM + name : path + PATH_DELIM + name;
+}
+
+
+void ServiceDiscoveryTreeCache::Crawler::serialize(const Node& node, const ::std::string& name,
+        ::std::string& out) {
+    SnapshotRecord record;
+    ::memset(&record, 0, sizeof(record));
+    record.pzxid = node.pzxid;
+    record.cversion = node.cversion;
+    record.childCount = static_cast<uint32_t>(node.children.size());
+    record.nameLength = static_cast<uint32_t>(name.size());
+    out.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    out.append(name);
+    out.append(padded(name.size()) - name.size(), '\0');
+
+    for (Node::Children::const_iterator it = node.children.begin(); it != node.children.end(); ++it) {
+        serialize(*it->second, it->first, out);
+    }
+}
+
+
+::boost::shared_ptr<const ServiceDiscoveryTreeCache::Node> ServiceDiscoveryTreeCache::Crawler::deserialize(
+        const char*& pos, const char* end, ::std::string& name, size_t depth) {
+    /*
+     * Reads the subtree at pos and sets name to the name of its root. Returns a null pointer if
+     * the records do not make up a well formed tree.
+     */
+    if (depth > SNAPSHOT_MAX_DEPTH || static_cast<size_t>(end - pos) < sizeof(SnapshotRecord)) {
+        return ::boost::shared_ptr<const Node>();
+    }
+    const SnapshotRecord* record = reinterpret_cast<const SnapshotRecord*>(pos);
+    pos += sizeof(SnapshotRecord);
+    if (static_cast<size_t>(end - pos) < padded(record->nameLength)) {
+        return ::boost::shared_ptr<const Node>();
+    }
+    name.assign(pos, record->nameLength);
+    pos += padded(record->nameLength);
+
+    ::boost::shared_ptr<Node> node = ::boost::make_shared<Node>();
+    node->cversion = record->cversion;
+    node->pzxid = record->pzxid;
+    node->zxid = record->pzxid;
+    node->children.reserve(::std::min<size_t>(record->childCount,
+            static_cast<size_t>(end - pos) / sizeof(SnapshotRecord)));
+
+    ::std::string childName;
+    for (uint32_t i = 0; i < record->childCount; ++i) {
+        ::boost::shared_ptr<const Node> child = deserialize(pos, end, childName, depth + 1);
+        if (!child || (!node->children.empty() && !(node->children.back().first < childName))) {
+            //children must be there, sorted and unique
+            return ::boost::shared_ptr<const Node>();
+        }
+        node->children.push_back(Node::Child(childName, child));
+        node->size += child->size + 1;
+        node->zxid = ::std::max(node->zxid, child->zxid);
+    }
+    return node;
+}
+
+
+::boost::shared_ptr<const ServiceDiscoveryTreeCache::Node> ServiceDiscoveryTreeCache::Crawler::replace(
+        const ::boost::shared_ptr<const Node>& node, const ::std::vector< ::std::string>& nodes,
+        size_t depth, const ::std::vector< ::std::string>* children, const data::Stat* stat,
+        ::std::vector< ::std::string>& added) {
+    /*
+     * Returns a copy of node with the node at nodes[depth..] given the (sorted) children read at
+     * stat, or removed if children is NULL. Unchanged subtrees are shared with the original.
+     * Returns a null pointer if the target is not in the tree.
+     */
+    ::boost::shared_ptr<Node> copy = ::boost::make_shared<Node>();
+
+    if (depth == nodes.size()) {
+        //the target node: merge the new children list with the subtrees we already have
+        copy->cversion = stat->getcversion();
+        copy->pzxid = stat->getpzxid();
+        copy->children.reserve(children->size());
+        Node::Children::const_iterator existing = node->children.begin();
+        for (::std::vector< ::std::string>::const_iterator it = children->begin();
+                it != children->end(); ++it) {
+            while (existing != node->children.end() && existing->first < *it) {
+                ++existing;
+            }
+            if (existing != node->children.end() && existing->first == *it) {
+                copy->children.push_back(*existing);
+            } else {
+                copy->children.push_back(Node::Child(*it, ::boost::make_shared<Node>()));
+                added.push_back(*it);
+            }
+        }
+    } else {
+        Node::Children::const_iterator it = ::std::lower_bound(node->children.begin(),
+                node->children.end(), nodes[depth], ChildNameLess<Node::Child>());
+        if (it == node->children.end() || it->first != nodes[depth]) {
+            return ::boost::shared_ptr<const Node>();
+        }
+
+        copy->cversion = node->cversion;
+        copy->pzxid = node->pzxid;
+        copy->children.reserve(node->children.size());
+        copy->children.insert(copy->children.end(), node->children.begin(), it);
+        if (children != NULL || depth + 1 < nodes.size()) {
+            ::boost::shared_ptr<const Node> child = replace(it->second, nodes, depth + 1,
+                    children, stat, added);
+            if (!child) {
+                return child;
+            }
+            copy->children.push_back(Node::Child(it->first, child));
+        }
+        copy->children.insert(copy->children.end(), it + 1, node->children.end());
+    }
+
+    copy->zxid = copy->pzxid;
+    for (Node::Children::const_iterator it = copy->children.begin();
+            it != copy->children.end(); ++it) {
+        copy->size += it->second->size + 1;
+        copy->zxid = ::std::max(copy->zxid, it->second->zxid);
+    }
+    return copy;
+}
+
+}} // namespace ::ezbake::ezdiscovery
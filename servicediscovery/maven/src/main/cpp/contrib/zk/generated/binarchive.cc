@@ -59,55 +59,54 @@ static void deserialize(T& t, InStream& stream)
 
 static void serializeLong(int64_t t, OutStream& stream)
 {
-  const int64_t num = htonll(t);
-  assert(sizeof(num) == stream.write(&num, sizeof(num)));
+  ::serialize(htonll(t), stream);
 }
 
 static void deserializeLong(int64_t& t, InStream& stream)
 {
   int64_t num;
-  assert(sizeof(num) == stream.read(&num, sizeof(num)));
+  ::deserialize(num, stream);
   t = ntohll(num);
 }
 
 static void serializeInt(int32_t t, OutStream& stream)
 {
-  const int32_t num = htonl(t);
-  assert(sizeof(num) == stream.write(&num, sizeof(num)));
+  ::serialize(static_cast<int32_t>(htonl(t)), stream);
 }
 
 static void deserializeInt(int32_t& t, InStream& stream)
 {
   int32_t num;
-  assert(sizeof(num) == stream.read(&num, sizeof(num)));
+  ::deserialize(num, stream);
   t = ntohl(num);
 }
 
 static void serializeFloat(float t, OutStream& stream)
 {
-  assert("!Serializing froat is not supported\n");
+  throw new IOException("Serializing float is not supported.");
 }
 
 static void deserializeFloat(float& t, InStream& stream)
 {
-  assert("!Deserializing froat is not supported\n");
+  throw new IOException("Deserializing float is not supported.");
 }
 
 static void serializeDouble(double t, OutStream& stream)
 {
-  assert("!Serializing double is not supported\n");
+  throw new IOException("Serializing double is not supported.");
 }
 
 static void deserializeDouble(double& t, InStream& stream)
 {
-  assert("!Deserializing double is not supported\n");
+  throw new IOException("Deserializing double is not supported.");
 }
 
 static void serializeString(const std::string& t, OutStream& stream)
 {
   ::serializeInt(static_cast<int32_t>(t.length()), stream);
-  if (t.length() > 0) {
-    stream.write(t.data(), t.length());
+  if (t.length() > 0 &&
+      static_cast<ssize_t>(t.length()) != stream.write(t.data(), t.length())) {
+    throw new IOException("Error serializing data.");
   }
 }
 
@@ -119,7 +118,9 @@ static void deserializeString(std::string& t, InStream& stream)
   if (len > 0) {
     // resize the string to the right length
     t.resize(len);
-    assert(len == stream.read((void *)t.data(), len));
+    if (len != stream.read((void *)t.data(), len)) {
+      throw new IOException("Error deserializing data.");
+    }
   }
 }
 
@@ -0,0 +1,183 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLAT_STRING_LIST_HH_
+#define FLAT_STRING_LIST_HH_
+
+#include <boost/utility/string_ref.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace org { namespace apache { namespace zookeeper {
+
+/**
+ * A read-only list of strings packed into one contiguous buffer.
+ *
+ * All the strings live back to back in a single blob, and element i spans
+ * [offsets[i], offsets[i + 1]). Decoding a list of N strings therefore costs
+ * two allocations rather than N + 1, and the list is cheap to move or swap
+ * through the API. Elements are returned as boost::string_ref views which
+ * stay valid until the list is modified or destroyed.
+ */
+class FlatStringList {
+  public:
+    typedef boost::string_ref value_type;
+
+    class const_iterator {
+      public:
+        const_iterator(const FlatStringList* list, size_t index) :
+          list_(list), index_(index) {}
+        value_type operator*() const {
+          return (*list_)[index_];
+        }
+        const_iterator& operator++() {
+          ++index_;
+          return *this;
+        }
+        bool operator==(const const_iterator& other) const {
+          return index_ == other.index_ && list_ == other.list_;
+        }
+        bool operator!=(const const_iterator& other) const {
+          return !(*this == other);
+        }
+
+      private:
+        const FlatStringList* list_;
+        size_t index_;
+    };
+
+    FlatStringList() : offsets_(1, 0) {}
+
+    FlatStringList(FlatStringList&& other) : offsets_(1, 0) {
+      swap(other);
+    }
+
+    FlatStringList& operator=(FlatStringList&& other) {
+      swap(other);
+      return *this;
+    }
+
+    FlatStringList(const FlatStringList& other) :
+      blob_(other.blob_), offsets_(other.offsets_) {}
+
+    FlatStringList& operator=(const FlatStringList& other) {
+      blob_ = other.blob_;
+      offsets_ = other.offsets_;
+      return *this;
+    }
+
+    size_t size() const {
+      return offsets_.size() - 1;
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+    value_type operator[](size_t i) const {
+      return value_type(blob_.data() + offsets_[i],
+                        offsets_[i + 1] - offsets_[i]);
+    }
+
+    const_iterator begin() const {
+      return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+      return const_iterator(this, size());
+    }
+
+    /**
+     * Reserves room for count strings totalling bytes characters.
+     */
+    void reserve(size_t count, size_t bytes) {
+      offsets_.reserve(count + 1);
+      blob_.reserve(bytes);
+    }
+
+    void push_back(const char* data, size_t len) {
+      blob_.append(data, len);
+      offsets_.push_back(static_cast<uint32_t>(blob_.size()));
+    }
+
+    void push_back(value_type str) {
+      push_back(str.data(), str.size());
+    }
+
+    void clear() {
+      blob_.clear();
+      offsets_.assign(1, 0);
+    }
+
+    void swap(FlatStringList& other) {
+      blob_.swap(other.blob_);
+      offsets_.swap(other.offsets_);
+    }
+
+    /**
+     * Copies the list out into individual strings.
+     */
+    std::vector<std::string> toVector() const {
+      std::vector<std::string> result;
+      result.reserve(size());
+      for (size_t i = 0; i < size(); i++) {
+        result.push_back((*this)[i].to_string());
+      }
+      return result;
+    }
+
+    /**
+     * Decodes a jute vector<ustring> straight out of the archive's buffer.
+     * The archive must support zero-copy string reads, as
+     * hadoop::InlineIBinArchive does.
+     */
+    template <typename A_> void deserialize(A_& a_) {
+      int32_t count;
+      a_.deserialize(count);
+      clear();
+      if (count <= 0) {
+        return;
+      }
+      // size the blob from the lengths, read through a copy of the archive;
+      // a count or length past the end of the input throws before we reserve
+      A_ scan(a_);
+      size_t bytes = 0;
+      for (int32_t i = 0; i < count; i++) {
+        const char* data;
+        size_t len;
+        scan.deserialize(data, len);
+        bytes += len;
+      }
+      reserve(count, bytes);
+      for (int32_t i = 0; i < count; i++) {
+        const char* data;
+        size_t len;
+        a_.deserialize(data, len);
+        push_back(data, len);
+      }
+    }
+
+  private:
+    std::string blob_;
+    std::vector<uint32_t> offsets_;
+};
+
+}}}  // namespace org::apache::zookeeper
+
+#endif  // FLAT_STRING_LIST_HH_
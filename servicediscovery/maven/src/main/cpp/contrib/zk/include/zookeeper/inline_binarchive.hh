@@ -0,0 +1,257 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INLINE_BINARCHIVE_HH_
+#define INLINE_BINARCHIVE_HH_
+
+#include <zookeeper/recordio.hh>
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Header-only binary archives for jute records.
+ *
+ * These produce exactly the same wire format as hadoop::IBinArchive and
+ * hadoop::OBinArchive, but are resolved at compile time: every record in
+ * zookeeper.jute.hh has template serialize(A&)/deserialize(A&) members, so
+ * each field access inlines into a bounds check plus a byte-swapped load or
+ * store instead of a virtual archive call and a virtual stream read.
+ */
+namespace hadoop {
+
+namespace endian {
+
+inline uint32_t swap32(uint32_t v) {
+#if defined(__GNUC__)
+  return __builtin_bswap32(v);
+#else
+  return ((v & 0x000000ffU) << 24) | ((v & 0x0000ff00U) << 8) |
+         ((v & 0x00ff0000U) >> 8)  | ((v & 0xff000000U) >> 24);
+#endif
+}
+
+inline uint64_t swap64(uint64_t v) {
+#if defined(__GNUC__)
+  return __builtin_bswap64(v);
+#else
+  return ((uint64_t)swap32((uint32_t)v) << 32) | swap32((uint32_t)(v >> 32));
+#endif
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline uint32_t toBig32(uint32_t v) { return v; }
+inline uint64_t toBig64(uint64_t v) { return v; }
+#else
+inline uint32_t toBig32(uint32_t v) { return swap32(v); }
+inline uint64_t toBig64(uint64_t v) { return swap64(v); }
+#endif
+
+inline int32_t load32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (int32_t)toBig32(v);
+}
+
+inline int64_t load64(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (int64_t)toBig64(v);
+}
+
+inline void store32(char* p, int32_t t) {
+  uint32_t v = toBig32((uint32_t)t);
+  memcpy(p, &v, sizeof(v));
+}
+
+inline void store64(char* p, int64_t t) {
+  uint64_t v = toBig64((uint64_t)t);
+  memcpy(p, &v, sizeof(v));
+}
+
+}  // namespace endian
+
+/**
+ * Reads jute records out of a contiguous buffer.
+ *
+ * Every read is bounds-checked against the buffer; running off the end
+ * throws an IOException, as IBinArchive does. This class does not take the
+ * ownership of the buffer passed in the constructor.
+ */
+class InlineIBinArchive {
+  public:
+    InlineIBinArchive(const void* buf, size_t buflen) :
+      buf_((const char*)buf), buflen_(buflen), offset_(0) {}
+
+    void deserialize(int8_t& t) {
+      t = (int8_t)*take(sizeof(t));
+    }
+
+    void deserialize(bool& t) {
+      t = *take(sizeof(t)) != 0;
+    }
+
+    void deserialize(int32_t& t) {
+      t = endian::load32(take(sizeof(t)));
+    }
+
+    void deserialize(int64_t& t) {
+      t = endian::load64(take(sizeof(t)));
+    }
+
+    void deserialize(std::string& t) {
+      int32_t len = endian::load32(take(sizeof(len)));
+      if (len > 0) {
+        t.assign(take(len), len);
+      } else {
+        t.clear();
+      }
+    }
+
+    /**
+     * Zero-copy string read: points data at the bytes inside the buffer.
+     */
+    void deserialize(const char*& data, size_t& len) {
+      int32_t slen = endian::load32(take(sizeof(slen)));
+      len = slen > 0 ? slen : 0;
+      data = take(len);
+    }
+
+    template <typename T>
+    void deserialize(std::vector<T>& v) {
+      int32_t len = endian::load32(take(sizeof(len)));
+      v.clear();
+      if (len <= 0) {
+        return;
+      }
+      // each element takes at least one byte; don't trust a corrupt length
+      if ((size_t)len > remaining()) {
+        throw new IOException("Error deserializing data.");
+      }
+      v.resize(len);
+      for (int32_t i = 0; i < len; i++) {
+        deserialize(v[i]);
+      }
+    }
+
+    template <typename R>
+    void deserialize(R& record) {
+      record.deserialize(*this);
+    }
+
+    size_t remaining() const {
+      return buflen_ - offset_;
+    }
+
+  private:
+    const char* take(size_t len) {
+      if (len > buflen_ - offset_) {
+        throw new IOException("Error deserializing data.");
+      }
+      const char* p = buf_ + offset_;
+      offset_ += len;
+      return p;
+    }
+
+    const char* buf_;
+    size_t buflen_;
+    size_t offset_;
+};
+
+/**
+ * Writes jute records by appending to a byte buffer.
+ *
+ * The Buffer policy only needs append(const char*, size_t), which both
+ * std::string and std::vector-like buffers can provide.
+ */
+template <typename Buffer = std::string>
+class InlineOBinArchive {
+  public:
+    explicit InlineOBinArchive(Buffer& buffer) : buffer_(buffer) {}
+
+    void serialize(int8_t t) {
+      buffer_.append((const char*)&t, sizeof(t));
+    }
+
+    void serialize(bool t) {
+      char b = t ? 1 : 0;
+      buffer_.append(&b, sizeof(b));
+    }
+
+    void serialize(int32_t t) {
+      char b[sizeof(t)];
+      endian::store32(b, t);
+      buffer_.append(b, sizeof(b));
+    }
+
+    void serialize(int64_t t) {
+      char b[sizeof(t)];
+      endian::store64(b, t);
+      buffer_.append(b, sizeof(b));
+    }
+
+    void serialize(const std::string& t) {
+      serialize(t.data(), t.length());
+    }
+
+    void serialize(const char* data, size_t len) {
+      serialize((int32_t)len);
+      if (len > 0) {
+        buffer_.append(data, len);
+      }
+    }
+
+    /**
+     * Writes a string made of two pieces, e.g. a chroot and a path, without
+     * joining them first.
+     */
+    void serialize(const std::string& prefix, const std::string& suffix) {
+      serialize((int32_t)(prefix.length() + suffix.length()));
+      buffer_.append(prefix.data(), prefix.length());
+      buffer_.append(suffix.data(), suffix.length());
+    }
+
+    /**
+     * Appends bytes that are already in wire format, e.g. a pre-encoded
+     * record.
+     */
+    void append(const std::string& encoded) {
+      buffer_.append(encoded.data(), encoded.length());
+    }
+
+    template <typename T>
+    void serialize(const std::vector<T>& v) {
+      serialize((int32_t)v.size());
+      for (size_t i = 0; i < v.size(); i++) {
+        serialize(v[i]);
+      }
+    }
+
+    template <typename R>
+    void serialize(const R& record) {
+      record.serialize(*this);
+    }
+
+  private:
+    Buffer& buffer_;
+};
+
+}  // namespace hadoop
+
+#endif  // INLINE_BINARCHIVE_HH_
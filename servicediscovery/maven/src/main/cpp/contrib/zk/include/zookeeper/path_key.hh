@@ -0,0 +1,148 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PATH_KEY_HH_
+#define PATH_KEY_HH_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <boost/atomic.hpp>
+
+namespace org { namespace apache { namespace zookeeper {
+
+/**
+ * An interned znode path.
+ *
+ * PathKey::intern() maps every distinct path string to a single immutable
+ * entry in a process-wide path table. The entry holds the path, its hash
+ * (computed once, when the path is first interned) and a small dense id, so
+ * that a PathKey is a pointer-sized handle which hashes and compares in
+ * constant time. Hash maps keyed by PathKey never rehash the path string.
+ *
+ * Entries are reference counted by the keys that point to them. The last
+ * key to let go of an entry erases it from the table, and its id is handed
+ * out again to the next path interned, so ids stay dense for as long as the
+ * set of live paths is bounded. Copying a key costs an atomic increment;
+ * releasing one that is not the last costs an atomic decrement. The table
+ * is thread-safe.
+ */
+class PathKey {
+  public:
+    /** The null key; it matches no interned path. */
+    PathKey() : entry_(NULL) {}
+
+    PathKey(const PathKey& other) : entry_(other.entry_) {
+      acquire();
+    }
+
+    PathKey& operator=(const PathKey& other) {
+      if (entry_ != other.entry_) {
+        release();
+        entry_ = other.entry_;
+        acquire();
+      }
+      return *this;
+    }
+
+    ~PathKey() {
+      release();
+    }
+
+    /**
+     * Returns the key for path, adding it to the path table if needed.
+     */
+    static PathKey intern(const std::string& path);
+
+    /**
+     * Looks path up without interning it.
+     *
+     * @return true and sets key if path has been interned before.
+     */
+    static bool find(const std::string& path, PathKey& key);
+
+    /**
+     * The number of ids handed out so far. The ids of live keys are in
+     * [1, count()]; ids of erased entries are reused before new ones.
+     */
+    static uint32_t count();
+
+    bool isNull() const {
+      return entry_ == NULL;
+    }
+
+    /** The path, or the empty string for the null key. */
+    const std::string& str() const;
+
+    /** The precomputed hash of str(). */
+    size_t hash() const {
+      return entry_ ? entry_->hash : 0;
+    }
+
+    /**
+     * A dense id, starting from 1; the null key has id 0. Once every key
+     * for a path is gone its id may be reused for another path.
+     */
+    uint32_t id() const {
+      return entry_ ? entry_->id : 0;
+    }
+
+    bool operator==(const PathKey& other) const {
+      return entry_ == other.entry_;
+    }
+
+    bool operator!=(const PathKey& other) const {
+      return entry_ != other.entry_;
+    }
+
+    /** Orders keys by id. */
+    bool operator<(const PathKey& other) const {
+      return id() < other.id();
+    }
+
+    struct Entry {
+      const std::string* path;
+      size_t hash;
+      uint32_t id;
+      /** The number of keys pointing at this entry. */
+      mutable boost::atomic<uint32_t> refs;
+    };
+
+  private:
+    /** Takes over a reference the path table already counted for it. */
+    explicit PathKey(const Entry* entry) : entry_(entry) {}
+
+    void acquire() {
+      if (entry_ != NULL) {
+        entry_->refs.fetch_add(1, boost::memory_order_relaxed);
+      }
+    }
+
+    void release();
+
+    const Entry* entry_;
+};
+
+/** For boost::hash. */
+inline size_t hash_value(const PathKey& key) {
+  return key.hash();
+}
+
+}}}  // namespace org::apache::zookeeper
+
+#endif  // PATH_KEY_HH_
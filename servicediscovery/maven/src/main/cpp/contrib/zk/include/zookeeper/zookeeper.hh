@@ -24,7 +24,9 @@
 #include <boost/utility.hpp>
 #include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
+#include "flat_string_list.hh"
 #include "zookeeper.jute.hh"
 #include "zookeeper_const.hh"
 #include "zookeeper_multi.hh"
@@ -96,6 +98,16 @@ class GetCallback {
      */
     virtual void process(ReturnCode::type rc, const std::string& path,
                          const std::string& data, const data::Stat& stat) = 0;
+
+    /**
+     * Invoked in place of the const overload above with the decoded data.
+     * Override it to take ownership of the data without copying; the
+     * default forwards to the const overload.
+     */
+    virtual void process(ReturnCode::type rc, const std::string& path,
+                         std::string&& data, const data::Stat& stat) {
+      process(rc, path, static_cast<const std::string&>(data), stat);
+    }
     virtual ~GetCallback() {}
 };
 
@@ -113,6 +125,17 @@ class GetAclCallback {
     virtual void process(ReturnCode::type rc, const std::string& path,
                          const std::vector<data::ACL>& acl,
                          const data::Stat& stat) = 0;
+
+    /**
+     * Invoked in place of the const overload above with the decoded list.
+     * Override it to take ownership of the list without copying; the
+     * default forwards to the const overload.
+     */
+    virtual void process(ReturnCode::type rc, const std::string& path,
+                         std::vector<data::ACL>&& acl,
+                         const data::Stat& stat) {
+      process(rc, path, static_cast<const std::vector<data::ACL>&>(acl), stat);
+    }
     virtual ~GetAclCallback() {}
 };
 
@@ -130,9 +153,40 @@ class GetChildrenCallback {
     virtual void process(ReturnCode::type rc, const std::string& path,
                          const std::vector<std::string>& children,
                          const data::Stat& stat) = 0;
+
+    /**
+     * Invoked in place of the const overload above with the decoded list.
+     * Override it to take ownership of the list without copying; the
+     * default forwards to the const overload.
+     */
+    virtual void process(ReturnCode::type rc, const std::string& path,
+                         std::vector<std::string>&& children,
+                         const data::Stat& stat) {
+      process(rc, path,
+              static_cast<const std::vector<std::string>&>(children), stat);
+    }
     virtual ~GetChildrenCallback() {}
 };
 
+/**
+ * Callback interface for ZooKeeper::getChildrenFlat() operation.
+ */
+class GetChildrenFlatCallback {
+  public:
+    /**
+     * @param rc Ok if this getChildrenFlat() operation was successful.
+     * @param path The path of the znode this getChildrenFlat() operation was for
+     * @param children The children of this znode, decoded straight from the
+     *                 response. The callee may swap it out to take ownership.
+     *                 Valid iff rc == Ok.
+     * @param stat Stat associated with this znode. Valid iff rc == Ok.
+     */
+    virtual void process(ReturnCode::type rc, const std::string& path,
+                         FlatStringList& children,
+                         const data::Stat& stat) = 0;
+    virtual ~GetChildrenFlatCallback() {}
+};
+
 /**
  * Callback interface for ZooKeeper::create() operation.
  */
@@ -236,9 +290,27 @@ class ZooKeeper : boost::noncopyable {
 
     /**
      * Initializes ZooKeeper session asynchronously.
+     *
+     * @param flags a combination of InitFlag values.
      */
     ReturnCode::type init(const std::string& hosts, int32_t sessionTimeoutMs,
-                    boost::shared_ptr<Watch> watch);
+                    boost::shared_ptr<Watch> watch, int32_t flags = 0);
+
+    /**
+     * Initializes ZooKeeper session asynchronously, resuming an existing
+     * session, e.g. the one of a process this one replaces, as returned by
+     * its getSessionId() and getSessionPassword().
+     *
+     * The session keeps its ephemeral nodes, but not its watches. If the
+     * session has expired, the session state becomes SessionState::Expired,
+     * unless InitFlag::RenewExpiredSession is given.
+     *
+     * @param sessionId the session to resume, or 0 for a new session.
+     * @param flags a combination of InitFlag values.
+     */
+    ReturnCode::type init(const std::string& hosts, int32_t sessionTimeoutMs,
+                    boost::shared_ptr<Watch> watch, int64_t sessionId,
+                    const std::string& sessionPassword, int32_t flags = 0);
 
     /**
      * Adds authentication info for this session asynchronously.
@@ -448,6 +520,31 @@ class ZooKeeper : boost::noncopyable {
                            std::vector<std::string>& children,
                            data::Stat& stat);
 
+    /**
+     * Gets the children and the stat of a znode asynchronously, as a
+     * FlatStringList. Use this instead of getChildren() for znodes with many
+     * children: the list is decoded with O(1) allocations.
+     *
+     * @param path The name of the znode.
+     * @param watch If non-null, a watch will be set at the server to notify
+     *              the client if the node changes.
+     * @param callback The callback to invoke when the request completes.
+     *
+     * @return ReturnCode::Ok if the request has been enqueued successfully.
+     */
+    ReturnCode::type getChildrenFlat(const std::string& path,
+                           boost::shared_ptr<Watch> watch,
+                           boost::shared_ptr<GetChildrenFlatCallback> callback);
+
+    /**
+     * Gets the children and the stat of a znode synchronously, as a
+     * FlatStringList.
+     */
+    ReturnCode::type getChildren(const std::string& path,
+                           boost::shared_ptr<Watch> watch,
+                           FlatStringList& children,
+                           data::Stat& stat);
+
     /**
      * Gets the acl associated with a znode.
      *
@@ -553,26 +650,24 @@ class ZooKeeper : boost::noncopyable {
     /**
      * Gets the ZooKeeper session ID.
      *
-     * This ZooKeeper object must be in "Connected" state for this operation
-     * to succeed.
+     * This ZooKeeper object must have a session, i.e. have been in
+     * "Connected" state, or be resuming one, for this operation to succeed;
+     * it fails with InvalidState otherwise.
      *
      * @param[out] id Session ID.
      */
-    ReturnCode::type getSessionId(int64_t& id) {
-      return ReturnCode::Unimplemented;
-    }
+    ReturnCode::type getSessionId(int64_t& id);
 
     /**
      * Gets the ZooKeeper session password.
      *
-     * This ZooKeeper object must be in "Connected" state for this operation
-     * to succeed.
+     * This ZooKeeper object must have a session, i.e. have been in
+     * "Connected" state, or be resuming one, for this operation to succeed;
+     * it fails with InvalidState otherwise.
      *
      * @param[out] password Session password.
      */
-    ReturnCode::type getSessionPassword(std::string& password) {
-      return ReturnCode::Unimplemented;
-    }
+    ReturnCode::type getSessionPassword(std::string& password);
 
   private:
     ZooKeeperImpl* impl_;
@@ -36,6 +36,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const Id& peer_) const;
   virtual bool operator==(const Id& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mscheme);
+    a_.serialize(mid);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mscheme);
+    a_.deserialize(mid);
+    bs_.set();
+  }
+  Id() = default;
+  Id(const Id&) = default;
+  Id(Id&&) = default;
+  Id& operator=(const Id&) = default;
+  Id& operator=(Id&&) = default;
   virtual ~Id() {};
   virtual const  ::std::string& getscheme() const {
     return mscheme;
@@ -71,6 +87,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ACL& peer_) const;
   virtual bool operator==(const ACL& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mperms);
+    a_.serialize(mid);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mperms);
+    a_.deserialize(mid);
+    bs_.set();
+  }
+  ACL() = default;
+  ACL(const ACL&) = default;
+  ACL(ACL&&) = default;
+  ACL& operator=(const ACL&) = default;
+  ACL& operator=(ACL&&) = default;
   virtual ~ACL() {};
   virtual int32_t getperms() const {
     return mperms;
@@ -115,6 +147,40 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const Stat& peer_) const;
   virtual bool operator==(const Stat& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mczxid);
+    a_.serialize(mmzxid);
+    a_.serialize(mctime);
+    a_.serialize(mmtime);
+    a_.serialize(mversion);
+    a_.serialize(mcversion);
+    a_.serialize(maversion);
+    a_.serialize(mephemeralOwner);
+    a_.serialize(mdataLength);
+    a_.serialize(mnumChildren);
+    a_.serialize(mpzxid);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mczxid);
+    a_.deserialize(mmzxid);
+    a_.deserialize(mctime);
+    a_.deserialize(mmtime);
+    a_.deserialize(mversion);
+    a_.deserialize(mcversion);
+    a_.deserialize(maversion);
+    a_.deserialize(mephemeralOwner);
+    a_.deserialize(mdataLength);
+    a_.deserialize(mnumChildren);
+    a_.deserialize(mpzxid);
+    bs_.set();
+  }
+  Stat() = default;
+  Stat(const Stat&) = default;
+  Stat(Stat&&) = default;
+  Stat& operator=(const Stat&) = default;
+  Stat& operator=(Stat&&) = default;
   virtual ~Stat() {};
   virtual int64_t getczxid() const {
     return mczxid;
@@ -211,6 +277,36 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const StatPersisted& peer_) const;
   virtual bool operator==(const StatPersisted& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mczxid);
+    a_.serialize(mmzxid);
+    a_.serialize(mctime);
+    a_.serialize(mmtime);
+    a_.serialize(mversion);
+    a_.serialize(mcversion);
+    a_.serialize(maversion);
+    a_.serialize(mephemeralOwner);
+    a_.serialize(mpzxid);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mczxid);
+    a_.deserialize(mmzxid);
+    a_.deserialize(mctime);
+    a_.deserialize(mmtime);
+    a_.deserialize(mversion);
+    a_.deserialize(mcversion);
+    a_.deserialize(maversion);
+    a_.deserialize(mephemeralOwner);
+    a_.deserialize(mpzxid);
+    bs_.set();
+  }
+  StatPersisted() = default;
+  StatPersisted(const StatPersisted&) = default;
+  StatPersisted(StatPersisted&&) = default;
+  StatPersisted& operator=(const StatPersisted&) = default;
+  StatPersisted& operator=(StatPersisted&&) = default;
   virtual ~StatPersisted() {};
   virtual int64_t getczxid() const {
     return mczxid;
@@ -291,6 +387,28 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ConnectRequest& peer_) const;
   virtual bool operator==(const ConnectRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mprotocolVersion);
+    a_.serialize(mlastZxidSeen);
+    a_.serialize(mtimeOut);
+    a_.serialize(msessionId);
+    a_.serialize(mpasswd);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mprotocolVersion);
+    a_.deserialize(mlastZxidSeen);
+    a_.deserialize(mtimeOut);
+    a_.deserialize(msessionId);
+    a_.deserialize(mpasswd);
+    bs_.set();
+  }
+  ConnectRequest() = default;
+  ConnectRequest(const ConnectRequest&) = default;
+  ConnectRequest(ConnectRequest&&) = default;
+  ConnectRequest& operator=(const ConnectRequest&) = default;
+  ConnectRequest& operator=(ConnectRequest&&) = default;
   virtual ~ConnectRequest() {};
   virtual int32_t getprotocolVersion() const {
     return mprotocolVersion;
@@ -346,6 +464,26 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ConnectResponse& peer_) const;
   virtual bool operator==(const ConnectResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mprotocolVersion);
+    a_.serialize(mtimeOut);
+    a_.serialize(msessionId);
+    a_.serialize(mpasswd);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mprotocolVersion);
+    a_.deserialize(mtimeOut);
+    a_.deserialize(msessionId);
+    a_.deserialize(mpasswd);
+    bs_.set();
+  }
+  ConnectResponse() = default;
+  ConnectResponse(const ConnectResponse&) = default;
+  ConnectResponse(ConnectResponse&&) = default;
+  ConnectResponse& operator=(const ConnectResponse&) = default;
+  ConnectResponse& operator=(ConnectResponse&&) = default;
   virtual ~ConnectResponse() {};
   virtual int32_t getprotocolVersion() const {
     return mprotocolVersion;
@@ -395,6 +533,26 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetWatches& peer_) const;
   virtual bool operator==(const SetWatches& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mrelativeZxid);
+    a_.serialize(mdataWatches);
+    a_.serialize(mexistWatches);
+    a_.serialize(mchildWatches);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mrelativeZxid);
+    a_.deserialize(mdataWatches);
+    a_.deserialize(mexistWatches);
+    a_.deserialize(mchildWatches);
+    bs_.set();
+  }
+  SetWatches() = default;
+  SetWatches(const SetWatches&) = default;
+  SetWatches(SetWatches&&) = default;
+  SetWatches& operator=(const SetWatches&) = default;
+  SetWatches& operator=(SetWatches&&) = default;
   virtual ~SetWatches() {};
   virtual int64_t getrelativeZxid() const {
     return mrelativeZxid;
@@ -442,6 +600,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const RequestHeader& peer_) const;
   virtual bool operator==(const RequestHeader& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mxid);
+    a_.serialize(mtype);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mxid);
+    a_.deserialize(mtype);
+    bs_.set();
+  }
+  RequestHeader() = default;
+  RequestHeader(const RequestHeader&) = default;
+  RequestHeader(RequestHeader&&) = default;
+  RequestHeader& operator=(const RequestHeader&) = default;
+  RequestHeader& operator=(RequestHeader&&) = default;
   virtual ~RequestHeader() {};
   virtual int32_t getxid() const {
     return mxid;
@@ -478,6 +652,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const MultiHeader& peer_) const;
   virtual bool operator==(const MultiHeader& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtype);
+    a_.serialize(mdone);
+    a_.serialize(merr);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtype);
+    a_.deserialize(mdone);
+    a_.deserialize(merr);
+    bs_.set();
+  }
+  MultiHeader() = default;
+  MultiHeader(const MultiHeader&) = default;
+  MultiHeader(MultiHeader&&) = default;
+  MultiHeader& operator=(const MultiHeader&) = default;
+  MultiHeader& operator=(MultiHeader&&) = default;
   virtual ~MultiHeader() {};
   virtual int32_t gettype() const {
     return mtype;
@@ -520,6 +712,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const AuthPacket& peer_) const;
   virtual bool operator==(const AuthPacket& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtype);
+    a_.serialize(mscheme);
+    a_.serialize(mauth);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtype);
+    a_.deserialize(mscheme);
+    a_.deserialize(mauth);
+    bs_.set();
+  }
+  AuthPacket() = default;
+  AuthPacket(const AuthPacket&) = default;
+  AuthPacket(AuthPacket&&) = default;
+  AuthPacket& operator=(const AuthPacket&) = default;
+  AuthPacket& operator=(AuthPacket&&) = default;
   virtual ~AuthPacket() {};
   virtual int32_t gettype() const {
     return mtype;
@@ -562,6 +772,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ReplyHeader& peer_) const;
   virtual bool operator==(const ReplyHeader& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mxid);
+    a_.serialize(mzxid);
+    a_.serialize(merr);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mxid);
+    a_.deserialize(mzxid);
+    a_.deserialize(merr);
+    bs_.set();
+  }
+  ReplyHeader() = default;
+  ReplyHeader(const ReplyHeader&) = default;
+  ReplyHeader(ReplyHeader&&) = default;
+  ReplyHeader& operator=(const ReplyHeader&) = default;
+  ReplyHeader& operator=(ReplyHeader&&) = default;
   virtual ~ReplyHeader() {};
   virtual int32_t getxid() const {
     return mxid;
@@ -603,6 +831,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetDataRequest& peer_) const;
   virtual bool operator==(const GetDataRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mwatch);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mwatch);
+    bs_.set();
+  }
+  GetDataRequest() = default;
+  GetDataRequest(const GetDataRequest&) = default;
+  GetDataRequest(GetDataRequest&&) = default;
+  GetDataRequest& operator=(const GetDataRequest&) = default;
+  GetDataRequest& operator=(GetDataRequest&&) = default;
   virtual ~GetDataRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -639,6 +883,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetDataRequest& peer_) const;
   virtual bool operator==(const SetDataRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mdata);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mdata);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  SetDataRequest() = default;
+  SetDataRequest(const SetDataRequest&) = default;
+  SetDataRequest(SetDataRequest&&) = default;
+  SetDataRequest& operator=(const SetDataRequest&) = default;
+  SetDataRequest& operator=(SetDataRequest&&) = default;
   virtual ~SetDataRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -679,6 +941,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetDataResponse& peer_) const;
   virtual bool operator==(const SetDataResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mstat);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mstat);
+    bs_.set();
+  }
+  SetDataResponse() = default;
+  SetDataResponse(const SetDataResponse&) = default;
+  SetDataResponse(SetDataResponse&&) = default;
+  SetDataResponse& operator=(const SetDataResponse&) = default;
+  SetDataResponse& operator=(SetDataResponse&&) = default;
   virtual ~SetDataResponse() {};
   virtual const org::apache::zookeeper::data::Stat& getstat() const {
     return mstat;
@@ -707,6 +983,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetSASLRequest& peer_) const;
   virtual bool operator==(const GetSASLRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtoken);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtoken);
+    bs_.set();
+  }
+  GetSASLRequest() = default;
+  GetSASLRequest(const GetSASLRequest&) = default;
+  GetSASLRequest(GetSASLRequest&&) = default;
+  GetSASLRequest& operator=(const GetSASLRequest&) = default;
+  GetSASLRequest& operator=(GetSASLRequest&&) = default;
   virtual ~GetSASLRequest() {};
   virtual const  ::std::string& gettoken() const {
     return mtoken;
@@ -735,6 +1025,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetSASLRequest& peer_) const;
   virtual bool operator==(const SetSASLRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtoken);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtoken);
+    bs_.set();
+  }
+  SetSASLRequest() = default;
+  SetSASLRequest(const SetSASLRequest&) = default;
+  SetSASLRequest(SetSASLRequest&&) = default;
+  SetSASLRequest& operator=(const SetSASLRequest&) = default;
+  SetSASLRequest& operator=(SetSASLRequest&&) = default;
   virtual ~SetSASLRequest() {};
   virtual const  ::std::string& gettoken() const {
     return mtoken;
@@ -763,6 +1067,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetSASLResponse& peer_) const;
   virtual bool operator==(const SetSASLResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtoken);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtoken);
+    bs_.set();
+  }
+  SetSASLResponse() = default;
+  SetSASLResponse(const SetSASLResponse&) = default;
+  SetSASLResponse(SetSASLResponse&&) = default;
+  SetSASLResponse& operator=(const SetSASLResponse&) = default;
+  SetSASLResponse& operator=(SetSASLResponse&&) = default;
   virtual ~SetSASLResponse() {};
   virtual const  ::std::string& gettoken() const {
     return mtoken;
@@ -794,6 +1112,26 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CreateRequest& peer_) const;
   virtual bool operator==(const CreateRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mdata);
+    a_.serialize(macl);
+    a_.serialize(mflags);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mdata);
+    a_.deserialize(macl);
+    a_.deserialize(mflags);
+    bs_.set();
+  }
+  CreateRequest() = default;
+  CreateRequest(const CreateRequest&) = default;
+  CreateRequest(CreateRequest&&) = default;
+  CreateRequest& operator=(const CreateRequest&) = default;
+  CreateRequest& operator=(CreateRequest&&) = default;
   virtual ~CreateRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -841,6 +1179,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const DeleteRequest& peer_) const;
   virtual bool operator==(const DeleteRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  DeleteRequest() = default;
+  DeleteRequest(const DeleteRequest&) = default;
+  DeleteRequest(DeleteRequest&&) = default;
+  DeleteRequest& operator=(const DeleteRequest&) = default;
+  DeleteRequest& operator=(DeleteRequest&&) = default;
   virtual ~DeleteRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -876,6 +1230,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetChildrenRequest& peer_) const;
   virtual bool operator==(const GetChildrenRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mwatch);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mwatch);
+    bs_.set();
+  }
+  GetChildrenRequest() = default;
+  GetChildrenRequest(const GetChildrenRequest&) = default;
+  GetChildrenRequest(GetChildrenRequest&&) = default;
+  GetChildrenRequest& operator=(const GetChildrenRequest&) = default;
+  GetChildrenRequest& operator=(GetChildrenRequest&&) = default;
   virtual ~GetChildrenRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -911,6 +1281,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetChildren2Request& peer_) const;
   virtual bool operator==(const GetChildren2Request& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mwatch);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mwatch);
+    bs_.set();
+  }
+  GetChildren2Request() = default;
+  GetChildren2Request(const GetChildren2Request&) = default;
+  GetChildren2Request(GetChildren2Request&&) = default;
+  GetChildren2Request& operator=(const GetChildren2Request&) = default;
+  GetChildren2Request& operator=(GetChildren2Request&&) = default;
   virtual ~GetChildren2Request() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -946,6 +1332,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CheckVersionRequest& peer_) const;
   virtual bool operator==(const CheckVersionRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  CheckVersionRequest() = default;
+  CheckVersionRequest(const CheckVersionRequest&) = default;
+  CheckVersionRequest(CheckVersionRequest&&) = default;
+  CheckVersionRequest& operator=(const CheckVersionRequest&) = default;
+  CheckVersionRequest& operator=(CheckVersionRequest&&) = default;
   virtual ~CheckVersionRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -980,6 +1382,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetMaxChildrenRequest& peer_) const;
   virtual bool operator==(const GetMaxChildrenRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  GetMaxChildrenRequest() = default;
+  GetMaxChildrenRequest(const GetMaxChildrenRequest&) = default;
+  GetMaxChildrenRequest(GetMaxChildrenRequest&&) = default;
+  GetMaxChildrenRequest& operator=(const GetMaxChildrenRequest&) = default;
+  GetMaxChildrenRequest& operator=(GetMaxChildrenRequest&&) = default;
   virtual ~GetMaxChildrenRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1008,6 +1424,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetMaxChildrenResponse& peer_) const;
   virtual bool operator==(const GetMaxChildrenResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mmax);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mmax);
+    bs_.set();
+  }
+  GetMaxChildrenResponse() = default;
+  GetMaxChildrenResponse(const GetMaxChildrenResponse&) = default;
+  GetMaxChildrenResponse(GetMaxChildrenResponse&&) = default;
+  GetMaxChildrenResponse& operator=(const GetMaxChildrenResponse&) = default;
+  GetMaxChildrenResponse& operator=(GetMaxChildrenResponse&&) = default;
   virtual ~GetMaxChildrenResponse() {};
   virtual int32_t getmax() const {
     return mmax;
@@ -1037,6 +1467,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetMaxChildrenRequest& peer_) const;
   virtual bool operator==(const SetMaxChildrenRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mmax);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mmax);
+    bs_.set();
+  }
+  SetMaxChildrenRequest() = default;
+  SetMaxChildrenRequest(const SetMaxChildrenRequest&) = default;
+  SetMaxChildrenRequest(SetMaxChildrenRequest&&) = default;
+  SetMaxChildrenRequest& operator=(const SetMaxChildrenRequest&) = default;
+  SetMaxChildrenRequest& operator=(SetMaxChildrenRequest&&) = default;
   virtual ~SetMaxChildrenRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1071,6 +1517,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SyncRequest& peer_) const;
   virtual bool operator==(const SyncRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  SyncRequest() = default;
+  SyncRequest(const SyncRequest&) = default;
+  SyncRequest(SyncRequest&&) = default;
+  SyncRequest& operator=(const SyncRequest&) = default;
+  SyncRequest& operator=(SyncRequest&&) = default;
   virtual ~SyncRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1099,6 +1559,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SyncResponse& peer_) const;
   virtual bool operator==(const SyncResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  SyncResponse() = default;
+  SyncResponse(const SyncResponse&) = default;
+  SyncResponse(SyncResponse&&) = default;
+  SyncResponse& operator=(const SyncResponse&) = default;
+  SyncResponse& operator=(SyncResponse&&) = default;
   virtual ~SyncResponse() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1127,6 +1601,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetACLRequest& peer_) const;
   virtual bool operator==(const GetACLRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  GetACLRequest() = default;
+  GetACLRequest(const GetACLRequest&) = default;
+  GetACLRequest(GetACLRequest&&) = default;
+  GetACLRequest& operator=(const GetACLRequest&) = default;
+  GetACLRequest& operator=(GetACLRequest&&) = default;
   virtual ~GetACLRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1157,6 +1645,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetACLRequest& peer_) const;
   virtual bool operator==(const SetACLRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(macl);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(macl);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  SetACLRequest() = default;
+  SetACLRequest(const SetACLRequest&) = default;
+  SetACLRequest(SetACLRequest&&) = default;
+  SetACLRequest& operator=(const SetACLRequest&) = default;
+  SetACLRequest& operator=(SetACLRequest&&) = default;
   virtual ~SetACLRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1197,6 +1703,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetACLResponse& peer_) const;
   virtual bool operator==(const SetACLResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mstat);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mstat);
+    bs_.set();
+  }
+  SetACLResponse() = default;
+  SetACLResponse(const SetACLResponse&) = default;
+  SetACLResponse(SetACLResponse&&) = default;
+  SetACLResponse& operator=(const SetACLResponse&) = default;
+  SetACLResponse& operator=(SetACLResponse&&) = default;
   virtual ~SetACLResponse() {};
   virtual const org::apache::zookeeper::data::Stat& getstat() const {
     return mstat;
@@ -1227,6 +1747,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const WatcherEvent& peer_) const;
   virtual bool operator==(const WatcherEvent& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtype);
+    a_.serialize(mstate);
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtype);
+    a_.deserialize(mstate);
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  WatcherEvent() = default;
+  WatcherEvent(const WatcherEvent&) = default;
+  WatcherEvent(WatcherEvent&&) = default;
+  WatcherEvent& operator=(const WatcherEvent&) = default;
+  WatcherEvent& operator=(WatcherEvent&&) = default;
   virtual ~WatcherEvent() {};
   virtual int32_t gettype() const {
     return mtype;
@@ -1267,6 +1805,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ErrorResponse& peer_) const;
   virtual bool operator==(const ErrorResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(merr);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(merr);
+    bs_.set();
+  }
+  ErrorResponse() = default;
+  ErrorResponse(const ErrorResponse&) = default;
+  ErrorResponse(ErrorResponse&&) = default;
+  ErrorResponse& operator=(const ErrorResponse&) = default;
+  ErrorResponse& operator=(ErrorResponse&&) = default;
   virtual ~ErrorResponse() {};
   virtual int32_t geterr() const {
     return merr;
@@ -1295,6 +1847,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CreateResponse& peer_) const;
   virtual bool operator==(const CreateResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  CreateResponse() = default;
+  CreateResponse(const CreateResponse&) = default;
+  CreateResponse(CreateResponse&&) = default;
+  CreateResponse& operator=(const CreateResponse&) = default;
+  CreateResponse& operator=(CreateResponse&&) = default;
   virtual ~CreateResponse() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1324,6 +1890,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ExistsRequest& peer_) const;
   virtual bool operator==(const ExistsRequest& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mwatch);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mwatch);
+    bs_.set();
+  }
+  ExistsRequest() = default;
+  ExistsRequest(const ExistsRequest&) = default;
+  ExistsRequest(ExistsRequest&&) = default;
+  ExistsRequest& operator=(const ExistsRequest&) = default;
+  ExistsRequest& operator=(ExistsRequest&&) = default;
   virtual ~ExistsRequest() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1358,6 +1940,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ExistsResponse& peer_) const;
   virtual bool operator==(const ExistsResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mstat);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mstat);
+    bs_.set();
+  }
+  ExistsResponse() = default;
+  ExistsResponse(const ExistsResponse&) = default;
+  ExistsResponse(ExistsResponse&&) = default;
+  ExistsResponse& operator=(const ExistsResponse&) = default;
+  ExistsResponse& operator=(ExistsResponse&&) = default;
   virtual ~ExistsResponse() {};
   virtual const org::apache::zookeeper::data::Stat& getstat() const {
     return mstat;
@@ -1387,6 +1983,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetDataResponse& peer_) const;
   virtual bool operator==(const GetDataResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mdata);
+    a_.serialize(mstat);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mdata);
+    a_.deserialize(mstat);
+    bs_.set();
+  }
+  GetDataResponse() = default;
+  GetDataResponse(const GetDataResponse&) = default;
+  GetDataResponse(GetDataResponse&&) = default;
+  GetDataResponse& operator=(const GetDataResponse&) = default;
+  GetDataResponse& operator=(GetDataResponse&&) = default;
   virtual ~GetDataResponse() {};
   virtual const  ::std::string& getdata() const {
     return mdata;
@@ -1421,6 +2033,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetChildrenResponse& peer_) const;
   virtual bool operator==(const GetChildrenResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mchildren);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mchildren);
+    bs_.set();
+  }
+  GetChildrenResponse() = default;
+  GetChildrenResponse(const GetChildrenResponse&) = default;
+  GetChildrenResponse(GetChildrenResponse&&) = default;
+  GetChildrenResponse& operator=(const GetChildrenResponse&) = default;
+  GetChildrenResponse& operator=(GetChildrenResponse&&) = default;
   virtual ~GetChildrenResponse() {};
   virtual const  ::std::vector< ::std::string>& getchildren() const {
     return mchildren;
@@ -1450,6 +2076,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetChildren2Response& peer_) const;
   virtual bool operator==(const GetChildren2Response& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mchildren);
+    a_.serialize(mstat);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mchildren);
+    a_.deserialize(mstat);
+    bs_.set();
+  }
+  GetChildren2Response() = default;
+  GetChildren2Response(const GetChildren2Response&) = default;
+  GetChildren2Response(GetChildren2Response&&) = default;
+  GetChildren2Response& operator=(const GetChildren2Response&) = default;
+  GetChildren2Response& operator=(GetChildren2Response&&) = default;
   virtual ~GetChildren2Response() {};
   virtual const  ::std::vector< ::std::string>& getchildren() const {
     return mchildren;
@@ -1485,6 +2127,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const GetACLResponse& peer_) const;
   virtual bool operator==(const GetACLResponse& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(macl);
+    a_.serialize(mstat);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(macl);
+    a_.deserialize(mstat);
+    bs_.set();
+  }
+  GetACLResponse() = default;
+  GetACLResponse(const GetACLResponse&) = default;
+  GetACLResponse(GetACLResponse&&) = default;
+  GetACLResponse& operator=(const GetACLResponse&) = default;
+  GetACLResponse& operator=(GetACLResponse&&) = default;
   virtual ~GetACLResponse() {};
   virtual const  ::std::vector<org::apache::zookeeper::data::ACL>& getacl() const {
     return macl;
@@ -1521,6 +2179,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const LearnerInfo& peer_) const;
   virtual bool operator==(const LearnerInfo& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mserverid);
+    a_.serialize(mprotocolVersion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mserverid);
+    a_.deserialize(mprotocolVersion);
+    bs_.set();
+  }
+  LearnerInfo() = default;
+  LearnerInfo(const LearnerInfo&) = default;
+  LearnerInfo(LearnerInfo&&) = default;
+  LearnerInfo& operator=(const LearnerInfo&) = default;
+  LearnerInfo& operator=(LearnerInfo&&) = default;
   virtual ~LearnerInfo() {};
   virtual int64_t getserverid() const {
     return mserverid;
@@ -1560,6 +2234,26 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const QuorumPacket& peer_) const;
   virtual bool operator==(const QuorumPacket& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtype);
+    a_.serialize(mzxid);
+    a_.serialize(mdata);
+    a_.serialize(mauthinfo);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtype);
+    a_.deserialize(mzxid);
+    a_.deserialize(mdata);
+    a_.deserialize(mauthinfo);
+    bs_.set();
+  }
+  QuorumPacket() = default;
+  QuorumPacket(const QuorumPacket&) = default;
+  QuorumPacket(QuorumPacket&&) = default;
+  QuorumPacket& operator=(const QuorumPacket&) = default;
+  QuorumPacket& operator=(QuorumPacket&&) = default;
   virtual ~QuorumPacket() {};
   virtual int32_t gettype() const {
     return mtype;
@@ -1610,6 +2304,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const FileHeader& peer_) const;
   virtual bool operator==(const FileHeader& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mmagic);
+    a_.serialize(mversion);
+    a_.serialize(mdbid);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mmagic);
+    a_.deserialize(mversion);
+    a_.deserialize(mdbid);
+    bs_.set();
+  }
+  FileHeader() = default;
+  FileHeader(const FileHeader&) = default;
+  FileHeader(FileHeader&&) = default;
+  FileHeader& operator=(const FileHeader&) = default;
+  FileHeader& operator=(FileHeader&&) = default;
   virtual ~FileHeader() {};
   virtual int32_t getmagic() const {
     return mmagic;
@@ -1655,6 +2367,28 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const TxnHeader& peer_) const;
   virtual bool operator==(const TxnHeader& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mclientId);
+    a_.serialize(mcxid);
+    a_.serialize(mzxid);
+    a_.serialize(mtime);
+    a_.serialize(mtype);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mclientId);
+    a_.deserialize(mcxid);
+    a_.deserialize(mzxid);
+    a_.deserialize(mtime);
+    a_.deserialize(mtype);
+    bs_.set();
+  }
+  TxnHeader() = default;
+  TxnHeader(const TxnHeader&) = default;
+  TxnHeader(TxnHeader&&) = default;
+  TxnHeader& operator=(const TxnHeader&) = default;
+  TxnHeader& operator=(TxnHeader&&) = default;
   virtual ~TxnHeader() {};
   virtual int64_t getclientId() const {
     return mclientId;
@@ -1710,6 +2444,26 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CreateTxnV0& peer_) const;
   virtual bool operator==(const CreateTxnV0& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mdata);
+    a_.serialize(macl);
+    a_.serialize(mephemeral);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mdata);
+    a_.deserialize(macl);
+    a_.deserialize(mephemeral);
+    bs_.set();
+  }
+  CreateTxnV0() = default;
+  CreateTxnV0(const CreateTxnV0&) = default;
+  CreateTxnV0(CreateTxnV0&&) = default;
+  CreateTxnV0& operator=(const CreateTxnV0&) = default;
+  CreateTxnV0& operator=(CreateTxnV0&&) = default;
   virtual ~CreateTxnV0() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1760,6 +2514,28 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CreateTxn& peer_) const;
   virtual bool operator==(const CreateTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mdata);
+    a_.serialize(macl);
+    a_.serialize(mephemeral);
+    a_.serialize(mparentCVersion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mdata);
+    a_.deserialize(macl);
+    a_.deserialize(mephemeral);
+    a_.deserialize(mparentCVersion);
+    bs_.set();
+  }
+  CreateTxn() = default;
+  CreateTxn(const CreateTxn&) = default;
+  CreateTxn(CreateTxn&&) = default;
+  CreateTxn& operator=(const CreateTxn&) = default;
+  CreateTxn& operator=(CreateTxn&&) = default;
   virtual ~CreateTxn() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1812,6 +2588,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const DeleteTxn& peer_) const;
   virtual bool operator==(const DeleteTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    bs_.set();
+  }
+  DeleteTxn() = default;
+  DeleteTxn(const DeleteTxn&) = default;
+  DeleteTxn(DeleteTxn&&) = default;
+  DeleteTxn& operator=(const DeleteTxn&) = default;
+  DeleteTxn& operator=(DeleteTxn&&) = default;
   virtual ~DeleteTxn() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1842,6 +2632,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetDataTxn& peer_) const;
   virtual bool operator==(const SetDataTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mdata);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mdata);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  SetDataTxn() = default;
+  SetDataTxn(const SetDataTxn&) = default;
+  SetDataTxn(SetDataTxn&&) = default;
+  SetDataTxn& operator=(const SetDataTxn&) = default;
+  SetDataTxn& operator=(SetDataTxn&&) = default;
   virtual ~SetDataTxn() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1883,6 +2691,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CheckVersionTxn& peer_) const;
   virtual bool operator==(const CheckVersionTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  CheckVersionTxn() = default;
+  CheckVersionTxn(const CheckVersionTxn&) = default;
+  CheckVersionTxn(CheckVersionTxn&&) = default;
+  CheckVersionTxn& operator=(const CheckVersionTxn&) = default;
+  CheckVersionTxn& operator=(CheckVersionTxn&&) = default;
   virtual ~CheckVersionTxn() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1919,6 +2743,24 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetACLTxn& peer_) const;
   virtual bool operator==(const SetACLTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(macl);
+    a_.serialize(mversion);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(macl);
+    a_.deserialize(mversion);
+    bs_.set();
+  }
+  SetACLTxn() = default;
+  SetACLTxn(const SetACLTxn&) = default;
+  SetACLTxn(SetACLTxn&&) = default;
+  SetACLTxn& operator=(const SetACLTxn&) = default;
+  SetACLTxn& operator=(SetACLTxn&&) = default;
   virtual ~SetACLTxn() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1960,6 +2802,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const SetMaxChildrenTxn& peer_) const;
   virtual bool operator==(const SetMaxChildrenTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mpath);
+    a_.serialize(mmax);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mpath);
+    a_.deserialize(mmax);
+    bs_.set();
+  }
+  SetMaxChildrenTxn() = default;
+  SetMaxChildrenTxn(const SetMaxChildrenTxn&) = default;
+  SetMaxChildrenTxn(SetMaxChildrenTxn&&) = default;
+  SetMaxChildrenTxn& operator=(const SetMaxChildrenTxn&) = default;
+  SetMaxChildrenTxn& operator=(SetMaxChildrenTxn&&) = default;
   virtual ~SetMaxChildrenTxn() {};
   virtual const  ::std::string& getpath() const {
     return mpath;
@@ -1994,6 +2852,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const CreateSessionTxn& peer_) const;
   virtual bool operator==(const CreateSessionTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtimeOut);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtimeOut);
+    bs_.set();
+  }
+  CreateSessionTxn() = default;
+  CreateSessionTxn(const CreateSessionTxn&) = default;
+  CreateSessionTxn(CreateSessionTxn&&) = default;
+  CreateSessionTxn& operator=(const CreateSessionTxn&) = default;
+  CreateSessionTxn& operator=(CreateSessionTxn&&) = default;
   virtual ~CreateSessionTxn() {};
   virtual int32_t gettimeOut() const {
     return mtimeOut;
@@ -2022,6 +2894,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const ErrorTxn& peer_) const;
   virtual bool operator==(const ErrorTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(merr);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(merr);
+    bs_.set();
+  }
+  ErrorTxn() = default;
+  ErrorTxn(const ErrorTxn&) = default;
+  ErrorTxn(ErrorTxn&&) = default;
+  ErrorTxn& operator=(const ErrorTxn&) = default;
+  ErrorTxn& operator=(ErrorTxn&&) = default;
   virtual ~ErrorTxn() {};
   virtual int32_t geterr() const {
     return merr;
@@ -2051,6 +2937,22 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const Txn& peer_) const;
   virtual bool operator==(const Txn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtype);
+    a_.serialize(mdata);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtype);
+    a_.deserialize(mdata);
+    bs_.set();
+  }
+  Txn() = default;
+  Txn(const Txn&) = default;
+  Txn(Txn&&) = default;
+  Txn& operator=(const Txn&) = default;
+  Txn& operator=(Txn&&) = default;
   virtual ~Txn() {};
   virtual int32_t gettype() const {
     return mtype;
@@ -2085,6 +2987,20 @@ public:
   virtual bool validate() const;
   virtual bool operator<(const MultiTxn& peer_) const;
   virtual bool operator==(const MultiTxn& peer_) const;
+  template <typename A_> void serialize(A_& a_) const {
+    if (!validate()) throw new ::hadoop::IOException("All fields not set.");
+    a_.serialize(mtxns);
+    bs_.reset();
+  }
+  template <typename A_> void deserialize(A_& a_) {
+    a_.deserialize(mtxns);
+    bs_.set();
+  }
+  MultiTxn() = default;
+  MultiTxn(const MultiTxn&) = default;
+  MultiTxn(MultiTxn&&) = default;
+  MultiTxn& operator=(const MultiTxn&) = default;
+  MultiTxn& operator=(MultiTxn&&) = default;
   virtual ~MultiTxn() {};
   virtual const  ::std::vector<org::apache::zookeeper::txn::Txn>& gettxns() const {
     return mtxns;
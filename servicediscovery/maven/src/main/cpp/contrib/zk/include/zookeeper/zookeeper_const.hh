@@ -274,6 +274,21 @@ namespace CreateMode {
   const std::string toString(int32_t flags);
 };
 
+/**
+ * Namespace for session initialization flags.
+ */
+namespace InitFlag {
+  enum type {
+    /**
+     * When the session expires, establish a new one on the same handle
+     * instead of leaving the handle unusable. Watchers still get
+     * SessionState::Expired first, followed by SessionState::Connected once
+     * the new session is up; outstanding watches are re-armed on it.
+     */
+    RenewExpiredSession = 1 << 0,
+  };
+};
+
 /**
  * Namespace for znode permission enum.
  */
@@ -34,7 +34,7 @@ class Op {
     virtual ~Op() = 0;
 
     OpCode::type getType() const;
-    std::string getPath() const;
+    const std::string& getPath() const;
 
     class Create;
     class Remove;
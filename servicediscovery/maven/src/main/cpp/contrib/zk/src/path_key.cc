@@ -0,0 +1,167 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <zookeeper/path_key.hh>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <vector>
+
+namespace org {
+namespace apache {
+
+/** ZooKeeper namespace. */
+namespace zookeeper {
+
+namespace {
+
+/**
+ * The process-wide path table. Entries live on the heap and point at their
+ * key in the map, which boost::unordered_map never moves.
+ *
+ * Lookups take a reference under the shared lock, and the last reference is
+ * only dropped under the exclusive lock, so a lookup never finds an entry on
+ * its way out.
+ */
+class PathTable {
+  typedef boost::unordered_map<std::string, PathKey::Entry*> entry_map;
+  public:
+    PathTable() : count_(0) {}
+
+    const PathKey::Entry* find(const std::string& path, size_t hash) {
+      boost::shared_lock<boost::shared_mutex> lock(mutex_);
+      entry_map::const_iterator itr = entries_.find(path, hasher(hash),
+                                                    entries_.key_eq());
+      if (itr == entries_.end()) {
+        return NULL;
+      }
+      itr->second->refs.fetch_add(1, boost::memory_order_relaxed);
+      return itr->second;
+    }
+
+    const PathKey::Entry* intern(const std::string& path, size_t hash) {
+      boost::unique_lock<boost::shared_mutex> lock(mutex_);
+      entry_map::iterator itr = entries_.find(path, hasher(hash),
+                                              entries_.key_eq());
+      if (itr == entries_.end()) {
+        PathKey::Entry* entry = new PathKey::Entry();
+        itr = entries_.insert(std::make_pair(path, entry)).first;
+        entry->path = &itr->first;
+        entry->hash = hash;
+        if (freeIds_.empty()) {
+          entry->id = ++count_;
+        } else {
+          entry->id = freeIds_.back();
+          freeIds_.pop_back();
+        }
+        entry->refs.store(0, boost::memory_order_relaxed);
+      }
+      itr->second->refs.fetch_add(1, boost::memory_order_relaxed);
+      return itr->second;
+    }
+
+    void release(const PathKey::Entry* entry) {
+      uint32_t refs = entry->refs.load(boost::memory_order_relaxed);
+      while (refs > 1) {
+        if (entry->refs.compare_exchange_weak(refs, refs - 1,
+                                              boost::memory_order_release,
+                                              boost::memory_order_relaxed)) {
+          return;
+        }
+      }
+      // possibly the last reference; a lookup may still add one until we
+      // hold the exclusive lock
+      boost::unique_lock<boost::shared_mutex> lock(mutex_);
+      if (entry->refs.fetch_sub(1, boost::memory_order_acq_rel) == 1) {
+        entries_.erase(entries_.find(*entry->path, hasher(entry->hash),
+                                     entries_.key_eq()));
+        freeIds_.push_back(entry->id);
+        delete entry;
+      }
+    }
+
+    uint32_t count() {
+      boost::shared_lock<boost::shared_mutex> lock(mutex_);
+      return count_;
+    }
+
+  private:
+    /** Hands the already computed hash back to the map. */
+    struct hasher {
+      explicit hasher(size_t hash) : hash_(hash) {}
+      size_t operator()(const std::string&) const {
+        return hash_;
+      }
+      size_t hash_;
+    };
+
+    boost::shared_mutex mutex_;
+    entry_map entries_;
+    uint32_t count_;
+    std::vector<uint32_t> freeIds_;
+};
+
+PathTable& table() {
+  // never destroyed, so keys released during exit still find it
+  static PathTable* table = new PathTable();
+  return *table;
+}
+
+const std::string emptyPath;
+
+}  // namespace
+
+PathKey PathKey::
+intern(const std::string& path) {
+  size_t hash = boost::hash<std::string>()(path);
+  const Entry* entry = table().find(path, hash);
+  if (entry == NULL) {
+    entry = table().intern(path, hash);
+  }
+  return PathKey(entry);
+}
+
+bool PathKey::
+find(const std::string& path, PathKey& key) {
+  const Entry* entry = table().find(path, boost::hash<std::string>()(path));
+  if (entry == NULL) {
+    return false;
+  }
+  key = PathKey(entry);
+  return true;
+}
+
+uint32_t PathKey::
+count() {
+  return table().count();
+}
+
+void PathKey::
+release() {
+  if (entry_ != NULL) {
+    table().release(entry_);
+    entry_ = NULL;
+  }
+}
+
+const std::string& PathKey::
+str() const {
+  return entry_ ? *entry_->path : emptyPath;
+}
+
+}}}  // namespace org::apache::zookeeper
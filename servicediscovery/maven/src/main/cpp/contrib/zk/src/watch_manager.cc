@@ -17,6 +17,10 @@
  */
 #include "watch_manager.hh"
 #include <boost/foreach.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/unordered_set.hpp>
+#include <algorithm>
+#include <string.h>
 #include <zookeeper/logging.hh>
 ENABLE_LOGGING;
 
@@ -26,13 +30,162 @@ namespace apache {
 /** ZooKeeper namespace. */
 namespace zookeeper {
 
+WatcherIdList::
+WatcherIdList(const WatcherIdList& other) : size_(0), capacity_(kInline) {
+  *this = other;
+}
+
+WatcherIdList& WatcherIdList::
+operator=(const WatcherIdList& other) {
+  if (this != &other) {
+    clear();
+    for (uint32_t i = 0; i < other.size_; i++) {
+      push_back(other[i]);
+    }
+  }
+  return *this;
+}
+
+WatcherIdList::
+~WatcherIdList() {
+  clear();
+}
+
+void WatcherIdList::
+push_back(uint32_t id) {
+  if (size_ == capacity_) {
+    uint32_t capacity = capacity_ * 2;
+    uint32_t* heap = new uint32_t[capacity];
+    std::copy(data(), data() + size_, heap);
+    if (capacity_ > kInline) {
+      delete[] heap_;
+    }
+    heap_ = heap;
+    capacity_ = capacity;
+  }
+  data()[size_++] = id;
+}
+
+void WatcherIdList::
+clear() {
+  if (capacity_ > kInline) {
+    delete[] heap_;
+  }
+  size_ = 0;
+  capacity_ = kInline;
+}
+
+void WatcherIdList::
+swap(WatcherIdList& other) {
+  std::swap(size_, other.size_);
+  std::swap(capacity_, other.capacity_);
+  // the union is either both inline ids or the heap pointer; swap it whole
+  uint32_t tmp[kInline];
+  memcpy(tmp, inline_, sizeof(tmp));
+  memcpy(inline_, other.inline_, sizeof(tmp));
+  memcpy(other.inline_, tmp, sizeof(tmp));
+}
+
+const uint32_t WatchManager::NO_SLOT;
+const uint32_t WatchManager::NUM_SHARDS;
+
+WatchManager::
+WatchManager() {
+}
+
+uint32_t WatchManager::Shard::
+findSlot(const PathKey& path) const {
+  uint32_t index = path.id() / NUM_SHARDS;
+  if (index >= slotIndex.size()) {
+    return NO_SLOT;
+  }
+  return slotIndex[index];
+}
+
+uint32_t WatchManager::Shard::
+addSlot(const PathKey& path) {
+  uint32_t index = path.id() / NUM_SHARDS;
+  if (index >= slotIndex.size()) {
+    slotIndex.resize(index + 1, NO_SLOT);
+  }
+  uint32_t slot = slots.size();
+  slots.push_back(Slot());
+  slots[slot].path = path;
+  slotIndex[index] = slot;
+  return slot;
+}
+
+void WatchManager::Shard::
+removeSlotIfEmpty(uint32_t slot) {
+  for (int type = 0; type < NUM_WATCH_TYPES; type++) {
+    if (!slots[slot].watchers[type].empty()) {
+      return;
+    }
+  }
+  // move the last slot into the hole to keep the array dense
+  slotIndex[slots[slot].path.id() / NUM_SHARDS] = NO_SLOT;
+  uint32_t last = slots.size() - 1;
+  if (slot != last) {
+    slots[slot].path = slots[last].path;
+    for (int type = 0; type < NUM_WATCH_TYPES; type++) {
+      slots[slot].watchers[type].swap(slots[last].watchers[type]);
+      slots[slot].armed[type] = slots[last].armed[type];
+    }
+    slotIndex[slots[slot].path.id() / NUM_SHARDS] = slot;
+  }
+  slots.pop_back();
+}
+
+/* Must be called with the shard mutex held. */
+uint32_t WatchManager::Shard::
+refWatcher(const boost::shared_ptr<Watch>& watch) {
+  boost::unordered_map<const Watch*, uint32_t>::iterator itr =
+    watcherIds.find(watch.get());
+  if (itr != watcherIds.end()) {
+    watcherRefs[itr->second]++;
+    return itr->second;
+  }
+  uint32_t id;
+  if (freeWatcherIds.empty()) {
+    id = watchers.size();
+    watchers.push_back(watch);
+    watcherRefs.push_back(1);
+  } else {
+    id = freeWatcherIds.back();
+    freeWatcherIds.pop_back();
+    watchers[id] = watch;
+    watcherRefs[id] = 1;
+  }
+  watcherIds[watch.get()] = id;
+  return id;
+}
+
+/* Must be called with the shard mutex held. */
+void WatchManager::Shard::
+unrefWatcher(uint32_t id) {
+  if (--watcherRefs[id] == 0) {
+    watcherIds.erase(watchers[id].get());
+    watchers[id].reset();
+    freeWatcherIds.push_back(id);
+  }
+}
+
 void WatchManager::
-moveWatches(watch_map& from, const std::string&path,
+moveWatches(WatchType type, const PathKey& path,
             std::list<boost::shared_ptr<Watch> >& to) {
-  watch_map::iterator itr = from.find(path);
-  if (itr != from.end()) {
-    to.insert(to.end(), itr->second.begin(), itr->second.end());
-    from.erase(itr);
+  Shard& shard = shardFor(path);
+  boost::lock_guard<boost::mutex> lock(shard.mutex);
+  uint32_t slot = shard.findSlot(path);
+  if (slot == NO_SLOT) {
+    return;
+  }
+  WatcherIdList ids;
+  ids.swap(shard.slots[slot].watchers[type]);
+  shard.slots[slot].armed[type] = 0;
+  shard.removeSlotIfEmpty(slot);
+  for (uint32_t i = 0; i < ids.size(); i++) {
+    to.push_back(shard.watchers[ids[i]]);
+    shard.unrefWatcher(ids[i]);
   }
 }
 
@@ -43,31 +196,46 @@ getWatches(WatchEvent::type event,
     std::list<boost::shared_ptr<Watch> >& watches) {
   watches.clear();
 
+  // a path that was never interned cannot have any watches on it
+  PathKey key;
+  if (event != WatchEvent::SessionStateChanged && !PathKey::find(path, key)) {
+    LOG_DEBUG(boost::format("No watches: event=%s, state=%s, path=%s") %
+              WatchEvent::toString(event) % SessionState::toString(state) %
+              path);
+    return;
+  }
+
   switch (event) {
-    case WatchEvent::SessionStateChanged:
-      if (defaultWatch_.get() != NULL) {
-        watches.push_back(defaultWatch_);
+    case WatchEvent::SessionStateChanged: {
+      // every distinct watcher gets the event once, even if it is set on
+      // paths in several shards
+      boost::unordered_set<const Watch*> seen;
+      boost::shared_ptr<Watch> defaultWatch = boost::atomic_load(&defaultWatch_);
+      if (defaultWatch.get() != NULL) {
+        watches.push_back(defaultWatch);
+        seen.insert(defaultWatch.get());
       }
-      BOOST_FOREACH(const watch_map::value_type& pair, existsWatches_) {
-        watches.insert(watches.end(), pair.second.begin(), pair.second.end());
-      }
-      BOOST_FOREACH(const watch_map::value_type& pair, getDataWatches_) {
-        watches.insert(watches.end(), pair.second.begin(), pair.second.end());
-      }
-      BOOST_FOREACH(const watch_map::value_type& pair, getChildrenWatches_) {
-        watches.insert(watches.end(), pair.second.begin(), pair.second.end());
+      for (uint32_t i = 0; i < NUM_SHARDS; i++) {
+        boost::lock_guard<boost::mutex> lock(shards_[i].mutex);
+        for (size_t id = 0; id < shards_[i].watchers.size(); id++) {
+          if (shards_[i].watcherRefs[id] > 0 &&
+              seen.insert(shards_[i].watchers[id].get()).second) {
+            watches.push_back(shards_[i].watchers[id]);
+          }
+        }
       }
       break;
+    }
     case WatchEvent::ZnodeCreated:
-      moveWatches(existsWatches_, path, watches);
+      moveWatches(EXISTS, key, watches);
     case WatchEvent::ZnodeDataChanged:
-      moveWatches(getDataWatches_, path, watches);
+      moveWatches(GET_DATA, key, watches);
     case WatchEvent::ZnodeChildrenChanged:
-      moveWatches(getChildrenWatches_, path, watches);
+      moveWatches(GET_CHILDREN, key, watches);
       break;
     case WatchEvent::ZnodeRemoved:
-      moveWatches(getDataWatches_, path, watches);
-      moveWatches(getChildrenWatches_, path, watches);
+      moveWatches(GET_DATA, key, watches);
+      moveWatches(GET_CHILDREN, key, watches);
       break;
   }
   LOG_DEBUG(boost::format("Got %d watch(es): event=%s, state=%s, path=%s") %
@@ -77,69 +245,98 @@ getWatches(WatchEvent::type event,
 
 void WatchManager::
 setDefaultWatch(boost::shared_ptr<Watch> watch) {
-  defaultWatch_ = watch;
+  boost::atomic_store(&defaultWatch_, watch);
 }
 
-void WatchManager::
-addWatch(watch_map& watches, const std::string& path,
-         boost::shared_ptr<Watch> watch) {
-  watch_map::iterator itr;
-  itr = watches.find(path);
-  if (itr == watches.end()) {
-    std::list<boost::shared_ptr<Watch> > watchList;
-    watchList.push_back(watch);
-    watches[path] = watchList;
-  } else {
-    itr->second.push_back(watch);
+uint64_t WatchManager::
+getServerWatch(WatchType type, const PathKey& path) {
+  Shard& shard = shardFor(path);
+  boost::lock_guard<boost::mutex> lock(shard.mutex);
+  uint32_t slot = shard.findSlot(path);
+  return slot == NO_SLOT ? 0 : shard.slots[slot].armed[type];
+}
+
+WatchManager::AddResult WatchManager::
+addWatch(WatchType type, const PathKey& path,
+         boost::shared_ptr<Watch> watch, uint64_t serverWatch) {
+  Shard& shard = shardFor(path);
+  boost::lock_guard<boost::mutex> lock(shard.mutex);
+  uint32_t slot = shard.findSlot(path);
+  if (serverWatch != 0 &&
+      (slot == NO_SLOT || shard.slots[slot].armed[type] != serverWatch)) {
+    // the shared watch has fired since the request went out
+    return SERVER_WATCH_LOST;
+  }
+  if (slot == NO_SLOT) {
+    slot = shard.addSlot(path);
+  }
+  uint32_t id = shard.refWatcher(watch);
+  WatcherIdList& ids = shard.slots[slot].watchers[type];
+  for (uint32_t i = 0; i < ids.size(); i++) {
+    if (ids[i] == id) {
+      shard.unrefWatcher(id);
+      return DUPLICATE;
+    }
   }
+  if (ids.empty()) {
+    shard.slots[slot].armed[type] = ++shard.nextToken;
+  }
+  ids.push_back(id);
+  return ADDED;
 }
 
 void WatchManager::
-addToExistsWatches(const std::string& path,
+addToExistsWatches(const PathKey& path,
     boost::shared_ptr<Watch> watch) {
-  addWatch(existsWatches_, path, watch);
+  addWatch(EXISTS, path, watch);
 }
 
 void WatchManager::
-addToGetDataWatches(const std::string& path,
+addToGetDataWatches(const PathKey& path,
     boost::shared_ptr<Watch> watch) {
-  addWatch(getDataWatches_, path, watch);
+  addWatch(GET_DATA, path, watch);
 }
 
 void WatchManager::
-addToGetChildrenWatches(const std::string& path,
+addToGetChildrenWatches(const PathKey& path,
     boost::shared_ptr<Watch> watch) {
-  addWatch(getChildrenWatches_, path, watch);
+  addWatch(GET_CHILDREN, path, watch);
 }
 
 void WatchManager::
-getPaths(const watch_map& watches, std::vector<std::string>& paths) {
+getPaths(WatchType type, std::vector<std::string>& paths) {
   paths.clear();
-  BOOST_FOREACH(const watch_map::value_type& pair, watches) {
-    paths.push_back(pair.first);
+  for (uint32_t i = 0; i < NUM_SHARDS; i++) {
+    boost::lock_guard<boost::mutex> lock(shards_[i].mutex);
+    BOOST_FOREACH(const Slot& slot, shards_[i].slots) {
+      if (!slot.watchers[type].empty()) {
+        paths.push_back(slot.path.str());
+      }
+    }
   }
 }
 
 void WatchManager::
 getExistsPaths(std::vector<std::string>& paths) {
-  getPaths(existsWatches_, paths);
+  getPaths(EXISTS, paths);
 }
 
 void WatchManager::
 getGetDataPaths(std::vector<std::string>& paths) {
-  getPaths(getDataWatches_, paths);
+  getPaths(GET_DATA, paths);
 }
 
 void WatchManager::
 getGetChildrenPaths(std::vector<std::string>& paths) {
-  getPaths(getChildrenWatches_, paths);
+  getPaths(GET_CHILDREN, paths);
 }
 
 WatchRegistration::
 WatchRegistration(boost::shared_ptr<WatchManager> manager,
                   const std::string& path,
                   boost::shared_ptr<Watch> watch) :
-  manager_(manager), path_(path), watch_(watch) {
+  manager_(manager), path_(PathKey::intern(path)), watch_(watch),
+  serverWatch_(0), missed_(false), missedEvent_(WatchEvent::ZnodeDataChanged) {
 }
 
 
@@ -147,6 +344,28 @@ WatchRegistration::
 ~WatchRegistration() {
 }
 
+bool WatchRegistration::
+shareServerWatch(WatchManager::WatchType type) {
+  serverWatch_ = manager_->getServerWatch(type, path_);
+  return serverWatch_ != 0;
+}
+
+bool WatchRegistration::
+add(WatchManager::WatchType type, WatchEvent::type missedEvent) {
+  if (manager_->addWatch(type, path_, watch_, serverWatch_) ==
+      WatchManager::SERVER_WATCH_LOST) {
+    missed_ = true;
+    missedEvent_ = missedEvent;
+  }
+  return true;
+}
+
+bool WatchRegistration::
+getMissedEvent(WatchEvent::type& event) const {
+  event = missedEvent_;
+  return missed_;
+}
+
 ExistsWatchRegistration::
 ExistsWatchRegistration(boost::shared_ptr<WatchManager> manager,
         const std::string& path, boost::shared_ptr<Watch> watch) :
@@ -156,11 +375,9 @@ ExistsWatchRegistration(boost::shared_ptr<WatchManager> manager,
 bool ExistsWatchRegistration::
 activate(ReturnCode::type rc) {
   if (rc == ReturnCode::Ok) {
-    manager_->addToGetDataWatches(path_, watch_);
-    return true;
+    return add(WatchManager::GET_DATA, WatchEvent::ZnodeDataChanged);
   } else if (rc == ReturnCode::NoNode) {
-    manager_->addToExistsWatches(path_, watch_);
-    return true;
+    return add(WatchManager::EXISTS, WatchEvent::ZnodeCreated);
   } else {
     return false;
   }
@@ -175,13 +392,17 @@ GetDataWatchRegistration(boost::shared_ptr<WatchManager> manager,
 bool GetDataWatchRegistration::
 activate(ReturnCode::type rc) {
   if (rc == ReturnCode::Ok) {
-    manager_->addToGetDataWatches(path_, watch_);
-    return true;
+    return add(WatchManager::GET_DATA, WatchEvent::ZnodeDataChanged);
   } else {
     return false;
   }
 }
 
+bool GetDataWatchRegistration::
+shareServerWatch() {
+  return WatchRegistration::shareServerWatch(WatchManager::GET_DATA);
+}
+
 GetChildrenWatchRegistration::
 GetChildrenWatchRegistration(boost::shared_ptr<WatchManager> manager,
         const std::string& path, boost::shared_ptr<Watch> watch) :
@@ -191,11 +412,15 @@ GetChildrenWatchRegistration(boost::shared_ptr<WatchManager> manager,
 bool GetChildrenWatchRegistration::
 activate(ReturnCode::type rc) {
   if (rc == ReturnCode::Ok) {
-    manager_->addToGetChildrenWatches(path_, watch_);
-    return true;
+    return add(WatchManager::GET_CHILDREN, WatchEvent::ZnodeChildrenChanged);
   } else {
     return false;
   }
 }
 
+bool GetChildrenWatchRegistration::
+shareServerWatch() {
+  return WatchRegistration::shareServerWatch(WatchManager::GET_CHILDREN);
+}
+
 }}}  // namespace org::apache::zookeeper
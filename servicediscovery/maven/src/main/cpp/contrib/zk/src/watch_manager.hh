@@ -19,45 +19,189 @@
 #define SRC_CONTRIB_ZKCPP_SRC_WATCH_MANAGER_HH_
 
 #include <zookeeper/zookeeper.hh>
+#include <zookeeper/path_key.hh>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include <list>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace org {
 namespace apache {
 namespace zookeeper {
 
+/**
+ * A list of watcher ids. The first two ids are stored inline, which covers
+ * the common case of one or two watchers per path without a heap
+ * allocation; longer lists spill to the heap.
+ */
+class WatcherIdList {
+  public:
+    WatcherIdList() : size_(0), capacity_(kInline) {}
+    WatcherIdList(const WatcherIdList& other);
+    WatcherIdList(WatcherIdList&& other) noexcept : size_(0),
+      capacity_(kInline) {
+      swap(other);
+    }
+    WatcherIdList& operator=(const WatcherIdList& other);
+    ~WatcherIdList();
+
+    uint32_t size() const {
+      return size_;
+    }
+    bool empty() const {
+      return size_ == 0;
+    }
+    uint32_t operator[](uint32_t i) const {
+      return data()[i];
+    }
+    void push_back(uint32_t id);
+    void clear();
+    void swap(WatcherIdList& other);
+
+  private:
+    static const uint32_t kInline = 2;
+
+    uint32_t* data() {
+      return capacity_ > kInline ? heap_ : inline_;
+    }
+    const uint32_t* data() const {
+      return capacity_ > kInline ? heap_ : inline_;
+    }
+
+    uint32_t size_;
+    uint32_t capacity_;
+    union {
+      uint32_t inline_[kInline];
+      uint32_t* heap_;
+    };
+};
+
+/**
+ * Keeps track of the watches set on znodes.
+ *
+ * Each distinct Watch object is stored once, in a reference counted watcher
+ * table; per path, the manager only keeps small lists of watcher ids. Paths
+ * are looked up by interned PathKey id through a sparse index into one
+ * dense array of slots, so neither registration nor dispatch hashes a path
+ * string. The watcher table doubles as the index for session events, which
+ * go to every distinct watcher once.
+ *
+ * A watcher is kept at most once per (type, path). The server keeps one
+ * watch per path for the whole session, so a request only needs to ask the
+ * server for a watch when no watch of that type is armed on the path yet;
+ * getServerWatch() returns a token identifying the armed watch, and
+ * addWatch() with that token attaches to it, or reports SERVER_WATCH_LOST if
+ * it fired while the request was in flight.
+ *
+ * The manager is thread-safe. Paths are spread over NUM_SHARDS shards by
+ * id, each with its own lock and its own watcher table, so registrations
+ * and event fan-out on different paths do not contend and no common path
+ * takes a lock shared by the whole manager. A session event visits the
+ * shards one at a time and drops the watchers it has already seen.
+ */
 class WatchManager {
-  typedef boost::unordered_map<std::string,
-                               std::list<boost::shared_ptr<Watch> > >
-          watch_map;
   public:
+    enum WatchType {
+      EXISTS = 0,
+      GET_DATA,
+      GET_CHILDREN,
+      NUM_WATCH_TYPES
+    };
+
+    enum AddResult {
+      ADDED,
+      DUPLICATE,
+      SERVER_WATCH_LOST
+    };
+
+    WatchManager();
     void getWatches(WatchEvent::type event,
                    SessionState::type state,
                    const std::string& path,
                    std::list<boost::shared_ptr<Watch> >& waches);
     void setDefaultWatch(boost::shared_ptr<Watch> watch);
-    void addToExistsWatches(const std::string& path,
+    void addToExistsWatches(const PathKey& path,
                             boost::shared_ptr<Watch> watch);
-    void addToGetDataWatches(const std::string& path,
+    void addToGetDataWatches(const PathKey& path,
                              boost::shared_ptr<Watch> watch);
-    void addToGetChildrenWatches(const std::string& path,
+    void addToGetChildrenWatches(const PathKey& path,
                                  boost::shared_ptr<Watch> watch);
     void getExistsPaths(std::vector<std::string>& paths);
     void getGetDataPaths(std::vector<std::string>& paths);
     void getGetChildrenPaths(std::vector<std::string>& paths);
+
+    /**
+     * Returns a token for the watch of this type armed on the server for
+     * path, or 0 if there is none.
+     */
+    uint64_t getServerWatch(WatchType type, const PathKey& path);
+
+    /**
+     * Adds watch unless it is already registered for (type, path).
+     *
+     * @param serverWatch 0 if the request that set this watch asked the
+     *        server for one, otherwise the token from getServerWatch().
+     */
+    AddResult addWatch(WatchType type, const PathKey& path,
+                       boost::shared_ptr<Watch> watch,
+                       uint64_t serverWatch = 0);
+
   private:
-    void moveWatches(watch_map& from, const std::string&path,
+    struct Slot {
+      Slot() {
+        for (int type = 0; type < NUM_WATCH_TYPES; type++) {
+          armed[type] = 0;
+        }
+      }
+      PathKey path;
+      WatcherIdList watchers[NUM_WATCH_TYPES];
+      /** Token for each armed server watch, 0 if none is armed. */
+      uint64_t armed[NUM_WATCH_TYPES];
+    };
+
+    static const uint32_t NO_SLOT = 0xffffffff;
+    static const uint32_t NUM_SHARDS = 16;
+
+    /**
+     * The slots for the paths with id % NUM_SHARDS == shard index, and the
+     * watchers set on them. Watcher ids are local to the shard.
+     */
+    struct Shard {
+      uint32_t findSlot(const PathKey& path) const;
+      uint32_t addSlot(const PathKey& path);
+      void removeSlotIfEmpty(uint32_t slot);
+      uint32_t refWatcher(const boost::shared_ptr<Watch>& watch);
+      void unrefWatcher(uint32_t id);
+
+      Shard() : nextToken(0) {}
+
+      boost::mutex mutex;
+      uint64_t nextToken;
+      /** Maps PathKey::id() / NUM_SHARDS to an index into slots. */
+      std::vector<uint32_t> slotIndex;
+      std::vector<Slot> slots;
+      /** The watcher table, indexed by watcher id. */
+      std::vector<boost::shared_ptr<Watch> > watchers;
+      std::vector<uint32_t> watcherRefs;
+      std::vector<uint32_t> freeWatcherIds;
+      boost::unordered_map<const Watch*, uint32_t> watcherIds;
+    };
+
+    Shard& shardFor(const PathKey& path) {
+      return shards_[path.id() % NUM_SHARDS];
+    }
+
+    void moveWatches(WatchType type, const PathKey& path,
         std::list<boost::shared_ptr<Watch> >& to);
-    void addWatch(watch_map& watches, const std::string& path,
-                  boost::shared_ptr<Watch> watch);
-    void getPaths(const watch_map& watches, std::vector<std::string>& paths);
+    void getPaths(WatchType type, std::vector<std::string>& paths);
 
+    Shard shards_[NUM_SHARDS];
+
+    /** Only accessed through boost::atomic_load and boost::atomic_store. */
     boost::shared_ptr<Watch> defaultWatch_;
-    watch_map existsWatches_;
-    watch_map getDataWatches_;
-    watch_map getChildrenWatches_;
 };
 
 class WatchRegistration {
@@ -65,12 +209,42 @@ class WatchRegistration {
     virtual ~WatchRegistration() = 0;
     virtual bool activate(ReturnCode::type rc) = 0;
 
+    /**
+     * Attaches this registration to a watch already armed on the server for
+     * the same path, if there is one.
+     *
+     * @return true if the request does not need to ask for a server watch.
+     */
+    virtual bool shareServerWatch() {
+      return false;
+    }
+
+    /**
+     * If the shared server watch fired before activate() could attach to
+     * it, the watcher missed that event; this returns true and the event to
+     * deliver to it in its place.
+     */
+    bool getMissedEvent(WatchEvent::type& event) const;
+
+    const PathKey& getPath() const {
+      return path_;
+    }
+    boost::shared_ptr<Watch> getWatch() const {
+      return watch_;
+    }
+
   protected:
     WatchRegistration(boost::shared_ptr<WatchManager> manager,
                       const std::string& path, boost::shared_ptr<Watch> watch);
+    bool shareServerWatch(WatchManager::WatchType type);
+    bool add(WatchManager::WatchType type, WatchEvent::type missedEvent);
+
     boost::shared_ptr<WatchManager> manager_;
-    std::string path_;
+    PathKey path_;
     boost::shared_ptr<Watch> watch_;
+    uint64_t serverWatch_;
+    bool missed_;
+    WatchEvent::type missedEvent_;
 };
 
 class ExistsWatchRegistration : public WatchRegistration {
@@ -85,6 +259,7 @@ class GetDataWatchRegistration : public WatchRegistration {
     GetDataWatchRegistration(boost::shared_ptr<WatchManager> manager,
         const std::string& path, boost::shared_ptr<Watch> watch);
     virtual bool activate(ReturnCode::type rc);
+    virtual bool shareServerWatch();
 };
 
 class GetChildrenWatchRegistration : public WatchRegistration {
@@ -92,6 +267,7 @@ class GetChildrenWatchRegistration : public WatchRegistration {
     GetChildrenWatchRegistration(boost::shared_ptr<WatchManager> manager,
         const std::string& path, boost::shared_ptr<Watch> watch);
     virtual bool activate(ReturnCode::type rc);
+    virtual bool shareServerWatch();
 };
 
 }}}  // namespace org::apache::zookeeper
@@ -87,6 +87,10 @@ adaptor_init(zhandle_t *zh) {
   set_nonblock(zh->threads.self_pipe[1]);
   set_nonblock(zh->threads.self_pipe[0]);
 
+  // the resolver thread is detached: it exits on its own once the handle is closed
+  zh->resolver->wakeup_fd = zh->threads.self_pipe[1];
+  boost::thread(do_resolve, zh->resolver).detach();
+
   // start threads
   zh->threads.threadsToWait=2;  // wait for 2 threads before opening the barrier
   LOG_DEBUG("starting threads...");
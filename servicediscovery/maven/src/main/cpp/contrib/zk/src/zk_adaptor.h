@@ -23,7 +23,9 @@
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/ptr_container/ptr_list.hpp>
+#include <boost/random/mersenne_twister.hpp>
 #include <queue>
+#include <vector>
 #include <zookeeper/zookeeper_const.hh>
 #include "zookeeper.h"
 #include "watch_manager.hh"
@@ -69,6 +71,7 @@ class completion_t {
         data_completion_t data_result;
         strings_completion_t strings_result;
         strings_stat_completion_t strings_stat_result;
+        flat_strings_stat_completion_t flat_strings_stat_result;
         acl_completion_t acl_result;
         string_completion_t string_result;
         multi_completion_t multi_result;
@@ -113,6 +116,33 @@ class adaptor_threads {
      int self_pipe[2];
 };
 
+/* addrs_rtt values of the addresses we have no round trip for */
+#define RTT_UNKNOWN -1
+#define RTT_UNREACHABLE -2
+
+/**
+ * The state shared with the resolver thread, which looks the servers up in the
+ * background. It is shared rather than owned by the handle, as the thread may
+ * still be waiting for a lookup when the handle goes away.
+ */
+class resolver_t {
+  public:
+    resolver_t() : requested(false), ready(false), probed_ready(false), closed(false),
+        wakeup_fd(-1) {}
+    std::string hosts; /* the servers of the connect string, as given */
+    std::vector<struct sockaddr_storage> addrs; /* the addresses last resolved, if ready */
+    std::vector<bool> local; /* whether each of them is in the client's zone */
+    std::vector<struct sockaddr_storage> probed; /* the addresses last timed, if probed_ready */
+    std::vector<int> probed_rtt; /* the round trip to each of them, or RTT_UNREACHABLE */
+    bool requested; /* resolve again now rather than at the next refresh */
+    bool ready; /* addrs holds addresses the IO thread has not taken yet */
+    bool probed_ready; /* probed holds round trips the IO thread has not taken yet */
+    bool closed; /* the handle is closed, the thread exits */
+    int wakeup_fd; /* wakes the IO thread up once addresses are ready */
+    boost::mutex lock;
+    boost::condition_variable cond;
+};
+
 /**
  * This structure represents the connection to zookeeper.
  */
@@ -123,6 +153,10 @@ class zhandle_t {
     char *hostname; /* the hostname of zookeeper */
     struct sockaddr_storage *addrs; /* the addresses that correspond to the hostname */
     int addrs_count; /* The number of addresses in the addrs array */
+    std::vector<int> addrs_rtt; /* smoothed round trip to each address in ms, or one of the RTT_* values */
+    std::vector<bool> addrs_local; /* whether each address is in the client's zone */
+    boost::mutex addrs_lock; /* held by the IO thread to swap the addrs array, and to read it by others */
+    boost::shared_ptr<resolver_t> resolver;
     struct timeval last_recv; /* The time that the last message was received */
     struct timeval last_send; /* The time that the last message was sent */
     struct timeval last_ping; /* The time that the last PING was sent */
@@ -135,11 +169,18 @@ class zhandle_t {
     completion_head_t sent_requests; /* The outstanding requests */
     completion_head_t completions_to_process; /* completions that are ready to run */
     int connect_index; /* The index of the address to connect to */
+    int connect_rounds; /* rounds over every address that failed since the last session was established */
+    struct timeval next_connect; /* no connection is attempted before this time */
+    struct timeval last_rebalance; /* The time we last looked for a faster server */
+    struct timeval resolve_start; /* requests fail once nothing resolved for a session timeout since */
+    boost::mt19937 rng; /* shuffles the addresses and jitters the backoff, in the IO thread */
     int64_t sessionId;
     std::string sessionPassword;
+    boost::mutex session_lock; /* held by the IO thread to change the session, and to read it by others */
     long long last_zxid;
     proto::ConnectResponse connectResponse;
     SessionState::type state;
+    int flags; /* InitFlag values given to zookeeper_init */
     boost::ptr_list<auth_info> authList_; /* authentication data list */
     volatile int close_requested;
     adaptor_threads threads;
@@ -157,6 +198,27 @@ ReturnCode::type flush_send_queue(zhandle_t*zh, int timeout);
 int32_t get_xid();
 ReturnCode::type wakeup_io_thread(zhandle_t *zh);
 void free_completions(zhandle_t *zh, int reason);
+void do_resolve(boost::shared_ptr<resolver_t> resolver);
+void stop_resolver(zhandle_t *zh);
+/* The IO thread's side of the resolver: swap in freshly resolved addresses */
+void take_resolved_addrs(zhandle_t *zh);
+int install_addrs(zhandle_t *zh,
+    const std::vector<struct sockaddr_storage>& addrs, const std::vector<bool>& local);
+
+/* Timeouts of the IO thread, in ms, for a session timeout of recv_timeout */
+int liveness_timeout(int recv_timeout);
+int connect_timeout(int recv_timeout, int connect_rounds);
+/* Time left before a connection that received nothing for idle_recv is given up on */
+int recv_deadline(int recv_timeout, bool connected, int connect_rounds, int idle_recv);
+
+/* Time a TCP connect to addr, in ms, or RTT_UNREACHABLE */
+int probe_rtt(const struct sockaddr_storage *addr, int timeout);
+/* Sort the addresses, with their round trips and zones, by preference */
+void order_addrs(struct sockaddr_storage *addrs, std::vector<int>& rtt,
+    std::vector<bool>& local);
+/* The index of the address to move to from current, or -1 to stay */
+int find_faster_addr(const std::vector<int>& rtt, const std::vector<bool>& local,
+    int current);
 
 #ifdef __cplusplus
 }
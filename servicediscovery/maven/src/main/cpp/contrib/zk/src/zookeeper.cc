@@ -35,8 +35,16 @@ ZooKeeper::
 
 ReturnCode::type ZooKeeper::
 init(const std::string& hosts, int32_t sessionTimeoutMs,
-     boost::shared_ptr<Watch> watch) {
-  return impl_->init(hosts, sessionTimeoutMs, watch);
+     boost::shared_ptr<Watch> watch, int32_t flags) {
+  return impl_->init(hosts, sessionTimeoutMs, watch, flags);
+}
+
+ReturnCode::type ZooKeeper::
+init(const std::string& hosts, int32_t sessionTimeoutMs,
+     boost::shared_ptr<Watch> watch, int64_t sessionId,
+     const std::string& sessionPassword, int32_t flags) {
+  return impl_->init(hosts, sessionTimeoutMs, watch, sessionId,
+                     sessionPassword, flags);
 }
 
 ReturnCode::type ZooKeeper::
@@ -123,6 +131,18 @@ getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
   return impl_->getChildren(path, watch, children, stat);
 }
 
+ReturnCode::type ZooKeeper::
+getChildrenFlat(const std::string& path, boost::shared_ptr<Watch> watch,
+                boost::shared_ptr<GetChildrenFlatCallback> callback) {
+  return impl_->getChildrenFlat(path, watch, callback, false);
+}
+
+ReturnCode::type ZooKeeper::
+getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
+            FlatStringList& children, data::Stat& stat) {
+  return impl_->getChildren(path, watch, children, stat);
+}
+
 ReturnCode::type ZooKeeper::
 getAcl(const std::string& path, boost::shared_ptr<GetAclCallback> callback) {
   return impl_->getAcl(path, callback, false);
@@ -169,6 +189,16 @@ getState() {
   return impl_->getState();
 }
 
+ReturnCode::type ZooKeeper::
+getSessionId(int64_t& id) {
+  return impl_->getSessionId(id);
+}
+
+ReturnCode::type ZooKeeper::
+getSessionPassword(std::string& password) {
+  return impl_->getSessionPassword(password);
+}
+
 ReturnCode::type ZooKeeper::
 ZooKeeper::
 close() {
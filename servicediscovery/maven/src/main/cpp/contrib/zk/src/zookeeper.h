@@ -41,8 +41,14 @@ extern const int ZOOKEEPER_WRITE;
 extern const int ZOOKEEPER_READ;
 class zhandle_t;
 
+/* identifies a session, e.g. one for zookeeper_init to resume */
+typedef struct {
+    int64_t client_id;
+    std::string passwd;
+} clientid_t;
+
 zhandle_t *zookeeper_init(const char *host, boost::shared_ptr<Watch> watch,
-  int recv_timeout, int flags);
+  int recv_timeout, const clientid_t *clientid, int flags);
 int zookeeper_close(zhandle_t *zh);
 int zoo_recv_timeout(zhandle_t *zh);
 const void *zoo_get_context(zhandle_t *zh);
@@ -55,18 +61,22 @@ typedef void (*multi_completion_t)(int rc,
              const void *data);
 typedef void (*stat_completion_t)(int rc, const data::Stat& stat,
         const void *data);
-typedef void (*data_completion_t)(int rc, const std::string& value,
+/* completions hand results over by rvalue; the callee may move from them */
+typedef void (*data_completion_t)(int rc, std::string&& value,
         const org::apache::zookeeper::data::Stat& stat, const void *data);
 typedef void (*strings_completion_t)(int rc,
-        const std::vector<std::string>& strings, const void *data);
+        std::vector<std::string>&& strings, const void *data);
 typedef void (*strings_stat_completion_t)(int rc,
-        const std::vector<std::string>& strings, const data::Stat& stat,
+        std::vector<std::string>&& strings, const data::Stat& stat,
         const void *data);
+typedef void (*flat_strings_stat_completion_t)(int rc,
+        FlatStringList& strings, const data::Stat& stat, const void *data);
 typedef void
         (*string_completion_t)(int rc, const std::string& value, const void *data);
-typedef void (*acl_completion_t)(int rc, const std::vector<data::ACL>& acl,
+typedef void (*acl_completion_t)(int rc, std::vector<data::ACL>&& acl,
         const data::Stat& stat, const void *data);
 SessionState::type zoo_state(zhandle_t *zh);
+int zoo_client_id(zhandle_t *zh, clientid_t *clientid);
 ReturnCode::type zoo_acreate(zhandle_t *zh, const std::string& path, const char *value,
         int valuelen, const std::vector<org::apache::zookeeper::data::ACL>& acl,
         int flags, string_completion_t completion, const void *data,
@@ -88,6 +98,10 @@ int zoo_awget_children2(zhandle_t *zh, const std::string& path,
         boost::shared_ptr<Watch> watch,
         strings_stat_completion_t completion, const void *data,
         bool isSynchronous);
+int zoo_awget_children2_flat(zhandle_t *zh, const std::string& path,
+        boost::shared_ptr<Watch> watch,
+        flat_strings_stat_completion_t completion, const void *data,
+        bool isSynchronous);
 int zoo_async(zhandle_t *zh, const std::string& path,
         string_completion_t completion, const void *data);
 int zoo_aget_acl(zhandle_t *zh, const std::string& path, acl_completion_t completion, 
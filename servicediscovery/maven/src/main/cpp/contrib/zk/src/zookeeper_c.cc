@@ -27,12 +27,11 @@
 #include <boost/random.hpp>
 #include <boost/random/mersenne_twister.hpp> // mt19937
 #include <boost/random/normal_distribution.hpp>
+#include <algorithm>
 #include <string>
+#include <utility>
 #include "zookeeper.h"
-#include <zookeeper/memory_in_stream.hh>
-#include <zookeeper/string_out_stream.hh>
-#include <zookeeper/recordio.hh>
-#include <zookeeper/binarchive.hh>
+#include <zookeeper/inline_binarchive.hh>
 #include "zk_adaptor.h"
 #include <zookeeper/zookeeper.hh>
 #include <zookeeper/config.h>
@@ -82,6 +81,34 @@ const int ZOOKEEPER_READ = 1 << 1;
 #define COMPLETION_ACLLIST 5
 #define COMPLETION_STRING 6
 #define COMPLETION_MULTI 7
+#define COMPLETION_FLATSTRINGLIST_STAT 8
+
+/* A connected server that sends us nothing for this long, not even the response to the ping we
+ * send it halfway through, is given up on for the next one. Short sessions cap it at a third
+ * of the session timeout, leaving the rest to reach another server before the session expires. */
+#define LIVENESS_TIMEOUT 2000 // ms
+/* The first attempt to connect to a server, session handshake included, fails over after this
+ * long. Each round over every server that fails doubles it, up to 2/3 of the session timeout. */
+#define CONNECT_TIMEOUT 2000 // ms
+/* Once every server failed, the next round is delayed by a jittered backoff that doubles from
+ * the minimum up to the maximum with every round that fails. */
+#define CONNECT_BACKOFF_MIN 100 // ms
+#define CONNECT_BACKOFF_MAX 5000 // ms
+/* While connected and idle, we look for a faster server this often. We move to a server in
+ * our zone if we are not on one, or to one whose round trip is under half of ours and at
+ * least REBALANCE_MIN_GAIN shorter. The round trip to the server we are connected to is
+ * that of its pings; those to the others are timed by the resolver thread, which connects
+ * to each of them after every lookup. */
+#define REBALANCE_INTERVAL 60000 // ms
+#define REBALANCE_MIN_GAIN 5 // ms
+/* The environment variable naming the client's zone. Servers are placed in zones in the
+ * connect string, e.g. "zk1:2181@east,zk2:2181@west"; those in the client's zone are
+ * preferred. */
+#define CLIENT_ZONE_ENV "ZOOKEEPER_CLIENT_ZONE"
+/* The servers are resolved again this often, and whenever none of them can be reached. A
+ * lookup that fails is tried again after RESOLVE_RETRY. */
+#define RESOLVE_INTERVAL 300000 // ms
+#define RESOLVE_RETRY 1000 // ms
 
 const char*err2string(int err);
 static int queue_session_event(zhandle_t *zh, SessionState::type state);
@@ -90,10 +117,10 @@ static const char* format_current_endpoint_info(zhandle_t* zh);
 
 /* deserialize forward declarations */
 static void deserialize_response(int type, int xid, ReturnCode::type rc,
-    completion_list_t *cptr, hadoop::IBinArchive& iarchive,
+    completion_list_t *cptr, hadoop::InlineIBinArchive& iarchive,
      const std::string& chroot);
 static int deserialize_multi(int xid, completion_list_t *cptr,
-                             hadoop::IBinArchive& iarchive,
+                             hadoop::InlineIBinArchive& iarchive,
                              boost::ptr_vector<OpResult>& results);
 
 /* completion routine forward declarations */
@@ -108,6 +135,9 @@ static void queue_completion(completion_head_t *list, completion_list_t *c);
 static ReturnCode::type handle_socket_error_msg(zhandle_t *zh, int line, ReturnCode::type rc,
                                   const std::string& message);
 static void cleanup_bufs(zhandle_t *zh, int rc);
+static void fold_rtt(int& smoothed, int rtt);
+static inline int calculate_interval(const struct timeval *start,
+        const struct timeval *end);
 
 static int disable_conn_permute=0; // permute enabled by default
 
@@ -161,6 +191,7 @@ zhandle_t::
         // TODO introduce closed state?
         state = (SessionState::type)0;
     }
+    stop_resolver(this);
     if (addrs != 0) {
         free(addrs);
         addrs = NULL;
@@ -189,159 +220,407 @@ static int getaddrinfo_errno(int rc) {
 }
 
 /**
- * fill in the addrs array of the zookeeper servers in the zhandle. after filling
- * them in, we will permute them for load balancing.
+ * append the addresses host resolves to, with whether they are in the client's
+ * zone, and return the getaddrinfo() error if it does not resolve.
  */
-int getaddrs(zhandle_t *zh) {
-  char *hosts = strdup(zh->hostname);
-  char *host;
-  char *strtok_last;
-  struct sockaddr_storage *addr;
-  int i;
+static int resolve_host(const char *host, const char *port_spec, bool is_local,
+    std::vector<struct sockaddr_storage>& addrs, std::vector<bool>& local)
+{
+  struct addrinfo hints, *res, *res0;
   int rc;
-  int alen = 0; /* the allocated length of the addrs array */
 
-  zh->addrs_count = 0;
-  if (zh->addrs) {
-    free(zh->addrs);
-    zh->addrs = 0;
+  memset(&hints, 0, sizeof(hints));
+#ifdef AI_ADDRCONFIG
+  hints.ai_flags = AI_ADDRCONFIG;
+#else
+  hints.ai_flags = 0;
+#endif
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  rc = getaddrinfo(host, port_spec, &hints, &res0);
+#ifdef AI_ADDRCONFIG
+  //bug in getaddrinfo implementation when it returns
+  //EAI_BADFLAGS or EAI_ADDRFAMILY with AF_UNSPEC and
+  // ai_flags as AI_ADDRCONFIG
+  // ZOOKEEPER-1323 EAI_NODATA and EAI_ADDRFAMILY are deprecated in FreeBSD.
+#ifdef EAI_ADDRFAMILY
+  if ((rc == EAI_BADFLAGS) || (rc == EAI_ADDRFAMILY)) {
+#else
+  if (rc == EAI_BADFLAGS) {
+#endif
+    //reset ai_flags to null
+    hints.ai_flags = 0;
+    //retry getaddrinfo
+    rc = getaddrinfo(host, port_spec, &hints, &res0);
+  }
+#endif
+  if (rc != 0) {
+    return rc;
+  }
+
+  for (res = res0; res; res = res->ai_next) {
+    struct sockaddr_storage addr;
+    switch (res->ai_family) {
+      case AF_INET:
+#if defined(AF_INET6)
+      case AF_INET6:
+#endif
+        memset(&addr, 0, sizeof(addr));
+        memcpy(&addr, res->ai_addr, res->ai_addrlen);
+        addrs.push_back(addr);
+        local.push_back(is_local);
+        break;
+      default:
+        LOG_WARN(
+            boost::format("skipping unknown address family %x for %s") %
+            res->ai_family % host);
+        break;
+    }
   }
+
+  freeaddrinfo(res0);
+  return 0;
+}
+
+/**
+ * resolve the zookeeper servers of the connect string in hostname. Servers that
+ * do not resolve are skipped, so that one missing name does not keep us from
+ * the others; it fails if none of them resolves. With resolve false, the
+ * connect string is only checked.
+ */
+static int resolve_hosts(const char *hostname, bool resolve,
+    std::vector<struct sockaddr_storage>& addrs, std::vector<bool>& local)
+{
+  char *hosts = strdup(hostname);
+  char *host;
+  char *strtok_last;
+  int rc = ReturnCode::Ok;
+  int servers = 0;
+  const char *client_zone = getenv(CLIENT_ZONE_ENV);
+
+  addrs.clear();
+  local.clear();
   if (!hosts) {
     LOG_ERROR("out of memory");
     errno=ENOMEM;
     return ReturnCode::SystemError;
   }
-  zh->addrs = 0;
-  host=strtok_r(hosts, ",", &strtok_last);
-  while(host) {
-    char *port_spec = strrchr(host, ':');
+  for (host = strtok_r(hosts, ",", &strtok_last); host;
+       host = strtok_r(0, ",", &strtok_last)) {
+    char *zone = strchr(host, '@');
+    char *port_spec;
     char *end_port_spec;
     int port;
+    int gai_rc;
+    if (zone) {
+      *zone = '\0';
+      zone++;
+    }
+    port_spec = strrchr(host, ':');
     if (!port_spec) {
       LOG_ERROR("no port in " << host);
       errno=EINVAL;
       rc=ReturnCode::BadArguments;
-      goto fail;
+      break;
     }
     *port_spec = '\0';
     port_spec++;
     port = static_cast<int>(strtol(port_spec, &end_port_spec, 0));
-    if (!*port_spec || *end_port_spec || port == 0) {
+    if (!*port_spec || *end_port_spec || port <= 0 || port > 65535) {
       LOG_ERROR("invalid port in " << host);
       errno=EINVAL;
       rc=ReturnCode::BadArguments;
-      goto fail;
+      break;
+    }
+    while(isspace(*host) && host != strtok_last)
+      host++;
+    if (!*host) {
+      LOG_ERROR("no host before port " << port_spec);
+      errno=EINVAL;
+      rc=ReturnCode::BadArguments;
+      break;
+    }
+    servers++;
+    if (!resolve) {
+      continue;
     }
-    {
-      struct addrinfo hints, *res, *res0;
-
-      memset(&hints, 0, sizeof(hints));
-#ifdef AI_ADDRCONFIG
-      hints.ai_flags = AI_ADDRCONFIG;
-#else
-      hints.ai_flags = 0;
-#endif
-      hints.ai_family = AF_UNSPEC;
-      hints.ai_socktype = SOCK_STREAM;
-      hints.ai_protocol = IPPROTO_TCP;
-
-      while(isspace(*host) && host != strtok_last)
-        host++;
 
-      if ((rc = getaddrinfo(host, port_spec, &hints, &res0)) != 0) {
-        //bug in getaddrinfo implementation when it returns
-        //EAI_BADFLAGS or EAI_ADDRFAMILY with AF_UNSPEC and 
-        // ai_flags as AI_ADDRCONFIG
-#ifdef AI_ADDRCONFIG
-        if ((hints.ai_flags == AI_ADDRCONFIG) && 
-            // ZOOKEEPER-1323 EAI_NODATA and EAI_ADDRFAMILY are deprecated in FreeBSD.
-#ifdef EAI_ADDRFAMILY
-            ((rc ==EAI_BADFLAGS) || (rc == EAI_ADDRFAMILY))) {
-#else
-          (rc == EAI_BADFLAGS)) {
-#endif
-            //reset ai_flags to null
-            hints.ai_flags = 0;
-            //retry getaddrinfo
-            rc = getaddrinfo(host, port_spec, &hints, &res0);
-          }
-          if (rc != 0) {
-            errno = getaddrinfo_errno(rc);
+    gai_rc = resolve_host(host, port_spec,
+        zone && client_zone && strcmp(zone, client_zone) == 0, addrs, local);
+    if (gai_rc != 0) {
+      errno = getaddrinfo_errno(gai_rc);
 #if __linux__ && __GNUC__
-            LOG_ERROR("getaddrinfo: " << gai_strerror(rc));
+      LOG_WARN("getaddrinfo: " << host << ": " << gai_strerror(gai_rc));
 #else
-            LOG_ERROR("getaddrinfo: " << strerror(errno));
+      LOG_WARN("getaddrinfo: " << host << ": " << strerror(errno));
 #endif
-            rc=ReturnCode::SystemError;
-            goto fail;
-          }
-        }
-
-        for (res = res0; res; res = res->ai_next) {
-          // Expand address list if needed
-          if (zh->addrs_count == alen) {
-            void *tmpaddr;
-            alen += 16;
-            tmpaddr = realloc(zh->addrs, sizeof(*zh->addrs)*alen);
-            if (tmpaddr == 0) {
-              LOG_ERROR("out of memory");
-              errno=ENOMEM;
-              rc=ReturnCode::SystemError;
-              freeaddrinfo(res0);
-              goto fail;
-            }
-            zh->addrs=(sockaddr_storage*)tmpaddr;
-          }
+    }
+  }
+  free(hosts);
+
+  if (rc == ReturnCode::Ok && servers == 0) {
+    LOG_ERROR("no servers in " << hostname);
+    errno=EINVAL;
+    rc = ReturnCode::BadArguments;
+  } else if (rc == ReturnCode::Ok && resolve && addrs.empty()) {
+    LOG_ERROR("none of the servers in " << hostname << " resolved");
+    rc = ReturnCode::SystemError;
+  }
+  return rc;
+}
 
-          // Copy addrinfo into address list
-          addr = &zh->addrs[zh->addrs_count];
-          switch (res->ai_family) {
-            case AF_INET:
+static bool same_addr(const struct sockaddr_storage& a, const struct sockaddr_storage& b)
+{
+  if (a.ss_family != b.ss_family) {
+    return false;
+  }
 #if defined(AF_INET6)
-            case AF_INET6:
+  if (a.ss_family == AF_INET6) {
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6*)&a;
+    const struct sockaddr_in6 *b6 = (const struct sockaddr_in6*)&b;
+    return a6->sin6_port == b6->sin6_port &&
+        memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+  }
 #endif
-              memcpy(addr, res->ai_addr, res->ai_addrlen);
-              ++zh->addrs_count;
-              break;
-            default:
-              LOG_WARN(
-                  boost::format("skipping unknown address family %x for %s") %
-                  res->ai_family % zh->hostname);
-              break;
-          }
-        }
+  const struct sockaddr_in *a4 = (const struct sockaddr_in*)&a;
+  const struct sockaddr_in *b4 = (const struct sockaddr_in*)&b;
+  return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
 
-        freeaddrinfo(res0);
+/**
+ * replace the addrs array of the zhandle with freshly resolved addresses, and
+ * permute them for load balancing. Addresses that are still there keep their
+ * round trips, and the address we were about to connect to stays next. Only
+ * the IO thread calls this, while it is not connected.
+ */
+int install_addrs(zhandle_t *zh,
+    const std::vector<struct sockaddr_storage>& addrs, const std::vector<bool>& local)
+{
+  struct sockaddr_storage *array;
+  struct sockaddr_storage next;
+  bool has_next = zh->connect_index < zh->addrs_count;
+  std::vector<int> rtt(addrs.size(), RTT_UNKNOWN);
+  int count = static_cast<int>(addrs.size());
+  int i;
+
+  array = (sockaddr_storage*)malloc(sizeof(*array) * (count ? count : 1));
+  if (array == 0) {
+    LOG_ERROR("out of memory");
+    errno=ENOMEM;
+    return ReturnCode::SystemError;
+  }
+  std::copy(addrs.begin(), addrs.end(), array);
+  memset(&next, 0, sizeof(next));
+  if (has_next) {
+    next = zh->addrs[zh->connect_index];
+  }
+  for (i = 0; i < count; i++) {
+    for (int j = 0; j < zh->addrs_count; j++) {
+      if (same_addr(array[i], zh->addrs[j])) {
+        rtt[i] = zh->addrs_rtt[j];
+        break;
+      }
+    }
+  }
 
-        host = strtok_r(0, ",", &strtok_last);
+  boost::lock_guard<boost::mutex> lock(zh->addrs_lock);
+  free(zh->addrs);
+  zh->addrs = array;
+  zh->addrs_count = count;
+  zh->addrs_rtt.swap(rtt);
+  zh->addrs_local = local;
+  zh->connect_index = 0;
+
+  if(!disable_conn_permute){
+    /* Permute */
+    for (i = zh->addrs_count - 1; i > 0; --i) {
+      int j = static_cast<int>(zh->rng() % (i+1));
+      if (i != j) {
+        struct sockaddr_storage t = zh->addrs[i];
+        zh->addrs[i] = zh->addrs[j];
+        zh->addrs[j] = t;
+        std::swap(zh->addrs_rtt[i], zh->addrs_rtt[j]);
+        std::vector<bool>::swap(zh->addrs_local[i], zh->addrs_local[j]);
       }
+    }
+    /* the servers in our zone first; the shuffle spreads the load among them */
+    order_addrs(zh->addrs, zh->addrs_rtt, zh->addrs_local);
+  }
+  for (i = 0; has_next && i < zh->addrs_count; i++) {
+    if (same_addr(zh->addrs[i], next)) {
+      zh->connect_index = i;
+      break;
+    }
+  }
+  LOG_DEBUG(boost::format("%d addresses for %s") % zh->addrs_count % zh->hostname);
+  return ReturnCode::Ok;
+}
+
+/**
+ * time a TCP connect to addr, in ms. Returns RTT_UNREACHABLE if it is refused
+ * or does not complete within timeout. The connection is closed right away, so
+ * the server only logs a client that went away.
+ */
+int probe_rtt(const struct sockaddr_storage *addr, int timeout)
+{
+  struct timeval start, end;
+  socklen_t len = sizeof(struct sockaddr_in);
+  int fd = socket(addr->ss_family, SOCK_STREAM, 0);
+  int rc;
+
+  if (fd < 0) {
+    return RTT_UNREACHABLE;
+  }
+#if defined(AF_INET6)
+  if (addr->ss_family == AF_INET6) {
+    len = sizeof(struct sockaddr_in6);
+  }
 #endif
+  fcntl(fd, F_SETFL, O_NONBLOCK|fcntl(fd, F_GETFL, 0));
+  gettimeofday(&start, 0);
+  rc = connect(fd, (const struct sockaddr*) addr, len);
+  if (rc == -1 && (errno == EWOULDBLOCK || errno == EINPROGRESS)) {
+    struct pollfd pfd;
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeout) == 1 &&
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0) {
+      rc = 0;
     }
-    free(hosts);
-
-    if(!disable_conn_permute){
-      srandom(static_cast<unsigned int>(time(NULL)));
-      /* Permute */
-      for (i = zh->addrs_count - 1; i > 0; --i) {
-        long int j = random()%(i+1);
-        if (i != j) {
-          struct sockaddr_storage t = zh->addrs[i];
-          zh->addrs[i] = zh->addrs[j];
-          zh->addrs[j] = t;
-        }
+  }
+  gettimeofday(&end, 0);
+  close(fd);
+  return rc == 0 ? calculate_interval(&start, &end) : RTT_UNREACHABLE;
+}
+
+/**
+ * resolve the servers in the background: at start up, every RESOLVE_INTERVAL
+ * and whenever the IO thread could reach none of them, as names may have moved
+ * to other addresses. The addresses are handed over to the IO thread, which
+ * swaps them in the next time it connects. Then the round trip to each of them
+ * is timed, for the IO thread to find faster servers than the one it is on.
+ * The thread only holds on to the resolver, so closing the handle never waits
+ * for a lookup.
+ */
+void do_resolve(boost::shared_ptr<resolver_t> resolver)
+{
+  std::vector<struct sockaddr_storage> addrs;
+  std::vector<bool> local;
+
+  LOG_DEBUG("started resolver thread");
+  boost::unique_lock<boost::mutex> lock(resolver->lock);
+  while (!resolver->closed) {
+    int rc;
+    resolver->requested = false;
+    lock.unlock();
+    rc = resolve_hosts(resolver->hosts.c_str(), true, addrs, local);
+    lock.lock();
+    if (resolver->closed) {
+      break;
+    }
+    if (rc == ReturnCode::Ok) {
+      char c = 0;
+      std::vector<struct sockaddr_storage> probed(addrs);
+      std::vector<int> rtt;
+      resolver->addrs.swap(addrs);
+      resolver->local.swap(local);
+      resolver->ready = true;
+      if (write(resolver->wakeup_fd, &c, 1) != 1) {
+        LOG_WARN("Unable to wake up the IO thread with new addresses");
+      }
+
+      lock.unlock();
+      for (size_t i = 0; i < probed.size(); i++) {
+        rtt.push_back(probe_rtt(&probed[i], CONNECT_TIMEOUT));
+      }
+      lock.lock();
+      if (resolver->closed) {
+        break;
       }
+      resolver->probed.swap(probed);
+      resolver->probed_rtt.swap(rtt);
+      resolver->probed_ready = true;
     }
-    return ReturnCode::Ok;
-fail:
-    if (zh->addrs) {
-      free(zh->addrs);
-      zh->addrs=0;
+
+    boost::system_time next = boost::get_system_time() +
+        boost::posix_time::milliseconds(rc == ReturnCode::Ok ? RESOLVE_INTERVAL : RESOLVE_RETRY);
+    while (!resolver->requested && !resolver->closed &&
+           resolver->cond.timed_wait(lock, next)) {
     }
-    if (hosts) {
-      free(hosts);
+  }
+  LOG_DEBUG("resolver thread terminated");
+}
+
+/* Ask the resolver thread to resolve the servers again now */
+static void request_resolve(zhandle_t *zh)
+{
+  boost::lock_guard<boost::mutex> lock(zh->resolver->lock);
+  zh->resolver->requested = true;
+  zh->resolver->cond.notify_one();
+}
+
+/* Stop the resolver thread; a lookup in progress is abandoned */
+void stop_resolver(zhandle_t *zh)
+{
+  if (zh->resolver) {
+    boost::lock_guard<boost::mutex> lock(zh->resolver->lock);
+    zh->resolver->closed = true;
+    zh->resolver->cond.notify_one();
+  }
+}
+
+/* Swap in the addresses the resolver thread has ready, if any */
+void take_resolved_addrs(zhandle_t *zh)
+{
+  std::vector<struct sockaddr_storage> addrs;
+  std::vector<bool> local;
+  {
+    boost::lock_guard<boost::mutex> lock(zh->resolver->lock);
+    if (!zh->resolver->ready) {
+      return;
     }
-    return rc;
+    zh->resolver->ready = false;
+    addrs.swap(zh->resolver->addrs);
+    local.swap(zh->resolver->local);
   }
+  install_addrs(zh, addrs, local);
+}
+
+/* Fold the round trips the resolver thread timed into those of our addresses */
+static void take_probed_rtts(zhandle_t *zh)
+{
+  std::vector<struct sockaddr_storage> addrs;
+  std::vector<int> rtt;
+  {
+    boost::lock_guard<boost::mutex> lock(zh->resolver->lock);
+    if (!zh->resolver->probed_ready) {
+      return;
+    }
+    zh->resolver->probed_ready = false;
+    addrs.swap(zh->resolver->probed);
+    rtt.swap(zh->resolver->probed_rtt);
+  }
+  for (size_t i = 0; i < addrs.size(); i++) {
+    for (int j = 0; j < zh->addrs_count; j++) {
+      if (!same_addr(addrs[i], zh->addrs[j])) {
+        continue;
+      }
+      if (j == zh->connect_index && zh->fd != -1) {
+        /* measured by its own pings */
+      } else if (rtt[i] == RTT_UNREACHABLE) {
+        zh->addrs_rtt[j] = RTT_UNREACHABLE;
+      } else {
+        fold_rtt(zh->addrs_rtt[j], rtt[i]);
+      }
+      break;
+    }
+  }
+}
 
 struct sockaddr* zookeeper_get_connected_host(zhandle_t *zh,
                  struct sockaddr *addr, socklen_t *addr_len)
@@ -364,11 +643,13 @@ static void log_env() {
  * Create a zookeeper handle associated with the given host and port.
  */
 zhandle_t *zookeeper_init(const char *host, boost::shared_ptr<Watch> watch,
-  int recv_timeout, int flags)
+  int recv_timeout, const clientid_t *clientid, int flags)
 {
     int errnosave = 0;
     zhandle_t *zh = NULL;
     char *index_chroot = NULL;
+    std::vector<struct sockaddr_storage> addrs;
+    std::vector<bool> local;
 
     log_env();
     LOG_INFO(
@@ -384,6 +665,7 @@ zhandle_t *zookeeper_init(const char *host, boost::shared_ptr<Watch> watch,
 
     zh->fd = -1;
     zh->state = SessionState::Connecting;
+    zh->flags = flags;
     zh->recv_timeout = recv_timeout;
     zh->watchManager = boost::shared_ptr<WatchManager>(new WatchManager());
     zh->watchManager->setDefaultWatch(watch);
@@ -413,12 +695,30 @@ zhandle_t *zookeeper_init(const char *host, boost::shared_ptr<Watch> watch,
     if (zh->hostname == 0) {
         goto abort;
     }
-    if(getaddrs(zh)!=0) {
+    /* the servers are resolved by the resolver thread, so that we do not wait for DNS here */
+    if(resolve_hosts(zh->hostname, false, addrs, local)!=0) {
         goto abort;
     }
+    zh->resolver.reset(new resolver_t());
+    zh->resolver->hosts = zh->hostname;
+    zh->addrs = 0;
+    zh->addrs_count = 0;
     zh->connect_index = 0;
-    zh->sessionId = 0;
-    zh->sessionPassword = "";
+    zh->connect_rounds = 0;
+    zh->next_connect.tv_sec = zh->next_connect.tv_usec = 0;
+    gettimeofday(&zh->last_rebalance, 0);
+    zh->resolve_start = zh->last_rebalance;
+    zh->rng.seed(static_cast<uint32_t>(zh->resolve_start.tv_sec ^ zh->resolve_start.tv_usec ^
+                                       getpid()));
+    if (clientid && clientid->client_id) {
+        /* resume this session, e.g. the one of the process we replace */
+        LOG_INFO(boost::format("Resuming session %#llx") % clientid->client_id);
+        zh->sessionId = clientid->client_id;
+        zh->sessionPassword = clientid->passwd;
+    } else {
+        zh->sessionId = 0;
+        zh->sessionPassword = "";
+    }
     zh->last_zxid = 0;
     zh->next_deadline.tv_sec=zh->next_deadline.tv_usec=0;
 
@@ -572,8 +872,7 @@ void free_completions(zhandle_t *zh, int reason) {
         // Nothing to do with a ping response
         destroy_completion_entry(cptr);
       } else if (cptr->c.isSynchronous) {
-        MemoryInStream stream(NULL, 0);
-        hadoop::IBinArchive iarchive(stream);
+        hadoop::InlineIBinArchive iarchive(NULL, 0);
         deserialize_response(cptr->c.type, cptr->xid,
             (ReturnCode::type)reason, cptr, iarchive, zh->chroot);
         destroy_completion_entry(cptr);
@@ -582,13 +881,12 @@ void free_completions(zhandle_t *zh, int reason) {
         LOG_DEBUG(boost::format("Enqueueing a fake response: xid=%#08x") %
             cptr->xid);
         buffer_t *bptr = new buffer_t();
-        StringOutStream stream(bptr->buffer);
-        hadoop::OBinArchive oarchive(stream);
+        hadoop::InlineOBinArchive<> oarchive(bptr->buffer);
         proto::ReplyHeader header;
         header.setxid(cptr->xid);
         header.setzxid(-1);
         header.seterr(reason);
-        header.serialize(oarchive, "header");
+        header.serialize(oarchive);
         cptr->buffer = bptr;
         queue_completion(&zh->completions_to_process, cptr);
       }
@@ -619,6 +917,11 @@ static void cleanup_bufs(zhandle_t *zh, int rc) {
 static void handle_error(zhandle_t *zh, ReturnCode::type rc)
 {
     close(zh->fd);
+    if ((zh->state == SessionState::Connecting || zh->state == SessionState::Associating) &&
+        zh->connect_index < zh->addrs_count) {
+        /* rank it last until we get through to it again */
+        zh->addrs_rtt[zh->connect_index] = RTT_UNREACHABLE;
+    }
     if (is_unrecoverable(zh)) {
         queue_session_event(zh, zh->state);
     } else if (zh->state == SessionState::Connected) {
@@ -629,7 +932,19 @@ static void handle_error(zhandle_t *zh, ReturnCode::type rc)
     cleanup_bufs(zh, rc);
     zh->fd = -1;
     zh->connect_index++;
-    if (!is_unrecoverable(zh)) {
+    if (zh->state == SessionState::Expired &&
+        (zh->flags & InitFlag::RenewExpiredSession)) {
+      /* start over with a new session. last_zxid is kept so that the watches
+         re-armed on it fire for anything that changed in the meantime */
+      LOG_INFO(boost::format("Session %#llx expired, establishing a new one") %
+               zh->sessionId);
+      {
+        boost::lock_guard<boost::mutex> lock(zh->session_lock);
+        zh->sessionId = 0;
+        zh->sessionPassword.clear();
+      }
+      zh->state = SessionState::Connecting;
+    } else if (!is_unrecoverable(zh)) {
       // TODO introduce closed state?
       zh->state = SessionState::Connecting;
     }
@@ -669,42 +984,51 @@ static void auth_completion_func(int rc, zhandle_t* zh) {
   }
 }
 
-/**
- * The caller must acquire zh->mutex before calling this function.
- */
-static int send_info_packet(zhandle_t *zh, auth_info* auth) {
-  int rc = 0;
+static buffer_t* create_auth_packet(auth_info* auth) {
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(AUTH_XID);
   header.settype(OpCode::SetAuth);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
   proto::AuthPacket req;
   req.settype(0); // ignored by the server
   req.getscheme() = auth->scheme;
   req.getauth() = auth->auth;
-  req.serialize(oarchive, "req");
+  req.serialize(oarchive);
+  return buffer;
+}
 
-  queue_buffer(&zh->to_send, buffer);
+/**
+ * The caller must acquire zh->mutex before calling this function.
+ */
+static int send_info_packet(zhandle_t *zh, auth_info* auth) {
+  int rc = 0;
+  queue_buffer(&zh->to_send, create_auth_packet(auth));
   adaptor_send_queue(zh, 0);
   return rc;
 }
 
-/** send all auths, not just the last one **/
+/**
+ * send all auths, not just the last one. Called once a connection has been
+ * established, before anything has been sent on it: the auth packets go to
+ * the head of the send queue so that no request is sent unauthenticated.
+ **/
 static int send_auth_info(zhandle_t *zh) {
-    int rc = 0;
     {
         boost::lock_guard<boost::mutex> lock(zh->mutex);
+        boost::lock_guard<boost::recursive_mutex> sendLock(zh->to_send.mutex_);
+        boost::ptr_list<buffer_t>::iterator pos = zh->to_send.bufferList_.begin();
         BOOST_FOREACH(auth_info& info, zh->authList_) {
-          rc = send_info_packet(zh, &info);
+          pos = zh->to_send.bufferList_.insert(pos, create_auth_packet(&info));
+          ++pos;
         }
     }
+    adaptor_send_queue(zh, 0);
     LOG_DEBUG("Sending all auth info request to " << format_current_endpoint_info(zh));
-    return (rc <0) ? ReturnCode::MarshallingError:ReturnCode::Ok;
+    return ReturnCode::Ok;
 }
 
 static int send_last_auth_info(zhandle_t *zh) {
@@ -720,47 +1044,105 @@ static int send_last_auth_info(zhandle_t *zh) {
   return (rc < 0) ? ReturnCode::MarshallingError : ReturnCode::Ok;
 }
 
-static void
-send_set_watches(zhandle_t *zh) {
-  proto::SetWatches req;
-  zh->watchManager->getExistsPaths(req.getexistWatches());
-  zh->watchManager->getGetChildrenPaths(req.getchildWatches());
-  zh->watchManager->getGetDataPaths(req.getdataWatches());
-
-  // return if there are no pending watches
-  if (req.getdataWatches().empty() && req.getexistWatches().empty() &&
-      req.getchildWatches().empty()) {
-    return;
-  }
+/* The most path bytes put into one SetWatches packet, well under the
+ * server's default jute.maxbuffer; same as the Java client. */
+static const size_t SET_WATCHES_MAX_LENGTH = 128 * 1024;
 
+/*
+ * Encodes one SetWatches packet for the paths [begin[i], end[i]) of each of
+ * the three watch lists, in the order of the proto::SetWatches fields.
+ */
+static buffer_t*
+create_set_watches_packet(zhandle_t *zh, const std::vector<std::string> (&paths)[3],
+    const size_t (&begin)[3], const size_t (&end)[3]) {
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(SET_WATCHES_XID);
   header.settype(OpCode::SetWatches);
+  header.serialize(oarchive);
+
+  // proto::SetWatches
+  oarchive.serialize((int64_t)zh->last_zxid);
+  for (int i = 0; i < 3; i++) {
+    oarchive.serialize((int32_t)(end[i] - begin[i]));
+    for (size_t j = begin[i]; j < end[i]; j++) {
+      oarchive.serialize(paths[i][j]);
+    }
+  }
+  return buffer;
+}
 
-  std::vector<std::string> paths;
-  req.setrelativeZxid(zh->last_zxid);
+/*
+ * Re-arms the watches on a new connection. The paths are split into
+ * SetWatches packets of at most SET_WATCHES_MAX_LENGTH bytes, so that a
+ * client holding many watches neither exceeds the server's packet limit nor
+ * holds up the requests queued behind one giant frame: the packets are
+ * interleaved with the requests already waiting to be sent.
+ */
+static void
+send_set_watches(zhandle_t *zh) {
+  // in the order of the proto::SetWatches fields
+  std::vector<std::string> paths[3];
+  zh->watchManager->getGetDataPaths(paths[0]);
+  zh->watchManager->getExistsPaths(paths[1]);
+  zh->watchManager->getGetChildrenPaths(paths[2]);
 
-  header.serialize(oarchive, "header");
-  req.serialize(oarchive, "req");
+  // return if there are no pending watches
+  if (paths[0].empty() && paths[1].empty() && paths[2].empty()) {
+    return;
+  }
+
+  boost::ptr_list<buffer_t> packets;
+  size_t begin[3] = {0, 0, 0};
+  while (begin[0] < paths[0].size() || begin[1] < paths[1].size() ||
+         begin[2] < paths[2].size()) {
+    size_t end[3];
+    size_t length = 0;
+    for (int i = 0; i < 3; i++) {
+      end[i] = begin[i];
+      while (end[i] < paths[i].size()) {
+        size_t pathLength = paths[i][end[i]].length() + sizeof(int32_t);
+        // always take at least one path so that every packet makes progress
+        if (length > 0 && length + pathLength > SET_WATCHES_MAX_LENGTH) {
+          break;
+        }
+        length += pathLength;
+        end[i]++;
+      }
+    }
+    packets.push_back(create_set_watches_packet(zh, paths, begin, end));
+    std::copy(end, end + 3, begin);
+  }
+  size_t count = packets.size();
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
-    queue_buffer(&zh->to_send, buffer);
+    boost::lock_guard<boost::recursive_mutex> sendLock(zh->to_send.mutex_);
+    boost::ptr_list<buffer_t> queued;
+    queued.transfer(queued.end(), zh->to_send.bufferList_);
+    while (!packets.empty()) {
+      zh->to_send.bufferList_.transfer(zh->to_send.bufferList_.end(),
+                                       packets.begin(), packets);
+      if (!queued.empty()) {
+        zh->to_send.bufferList_.transfer(zh->to_send.bufferList_.end(),
+                                         queued.begin(), queued);
+      }
+    }
+    zh->to_send.bufferList_.transfer(zh->to_send.bufferList_.end(), queued);
   }
   adaptor_send_queue(zh, 0);
-  LOG_DEBUG("Sending SetWatches request to " << format_current_endpoint_info(zh));
+  LOG_DEBUG(boost::format("Sending %d SetWatches request(s) for %d path(s) to %s") %
+      count % (paths[0].size() + paths[1].size() + paths[2].size()) %
+      format_current_endpoint_info(zh));
 }
 
 static ReturnCode::type
 sendConnectRequest(zhandle_t *zh) {
   int rc;
   std::string serialized;
-  StringOutStream stream(serialized);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(serialized);
 
   proto::ConnectRequest request;
   request.setprotocolVersion(0);
@@ -768,7 +1150,7 @@ sendConnectRequest(zhandle_t *zh) {
   request.setlastZxidSeen(zh->last_zxid);
   request.setsessionId(zh->sessionId);
   request.getpasswd() = zh->sessionPassword;
-  request.serialize(oarchive, "connect");
+  request.serialize(oarchive);
   uint32_t len = htonl(static_cast<uint32_t>(serialized.size()));
   rc=static_cast<int>(zookeeper_send(zh->fd, &len, sizeof(len)));
   rc=rc<0 ? rc : static_cast<int>(zookeeper_send(zh->fd, serialized.data(), serialized.size()));
@@ -790,6 +1172,162 @@ static inline int calculate_interval(const struct timeval *start,
     return interval;
 }
 
+int liveness_timeout(int recv_timeout)
+{
+    return std::min(LIVENESS_TIMEOUT, recv_timeout/3);
+}
+
+int connect_timeout(int recv_timeout, int connect_rounds)
+{
+    return std::min(CONNECT_TIMEOUT << std::min(connect_rounds, 8), recv_timeout*2/3);
+}
+
+int recv_deadline(int recv_timeout, bool connected, int connect_rounds, int idle_recv)
+{
+    // a connection attempt only gets connect_timeout() to complete
+    return (connected ? liveness_timeout(recv_timeout) :
+            connect_timeout(recv_timeout, connect_rounds)) - idle_recv;
+}
+
+static int connect_backoff(zhandle_t *zh)
+{
+    int backoff = std::min(CONNECT_BACKOFF_MIN << std::min(zh->connect_rounds, 8),
+                           CONNECT_BACKOFF_MAX);
+    /* half of it fixed, the other half random, so that clients that lost the
+     * same ensemble do not come back in lockstep */
+    return backoff/2 + static_cast<int>(zh->rng() % (backoff/2 + 1));
+}
+
+/* Fail over quickly from a server that stopped answering: data it does not
+ * acknowledge, and a connection that stays quiet, error out at the socket */
+static void set_liveness_options(zhandle_t *zh)
+{
+    // the connection attempt itself is bound by the same timeout
+    int timeout = std::max(liveness_timeout(zh->recv_timeout),
+                           connect_timeout(zh->recv_timeout, zh->connect_rounds));
+#ifdef TCP_USER_TIMEOUT
+    unsigned int user_timeout = static_cast<unsigned int>(timeout);
+    if (setsockopt(zh->fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout)) != 0) {
+        LOG_WARN("Unable to set TCP_USER_TIMEOUT, failover may be slower");
+    }
+#endif
+    int enable_keepalive = 1;
+    if (setsockopt(zh->fd, SOL_SOCKET, SO_KEEPALIVE, &enable_keepalive, sizeof(enable_keepalive)) != 0) {
+        LOG_WARN("Unable to set SO_KEEPALIVE, failover may be slower");
+        return;
+    }
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    int keepalive_idle = std::max(timeout/1000, 1);
+    int keepalive_interval = 1;
+    int keepalive_count = 2;
+    setsockopt(zh->fd, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle));
+    setsockopt(zh->fd, IPPROTO_TCP, TCP_KEEPINTVL, &keepalive_interval, sizeof(keepalive_interval));
+    setsockopt(zh->fd, IPPROTO_TCP, TCP_KEEPCNT, &keepalive_count, sizeof(keepalive_count));
+#endif
+}
+
+/* Fold a round trip into a smoothed round trip */
+static void fold_rtt(int& smoothed, int rtt)
+{
+    smoothed = smoothed < 0 ? rtt : (smoothed*7 + rtt)/8;
+}
+
+/* Fold a round trip to the current address into its smoothed round trip */
+static void update_rtt(zhandle_t *zh, int rtt)
+{
+    fold_rtt(zh->addrs_rtt[zh->connect_index], rtt);
+}
+
+/* Orders addresses by preference: those in our zone first, then by round
+ * trip, fastest first, then those we have no round trip for, and those we
+ * could not reach last. Addresses ranked the same keep their order. */
+class addr_preference {
+  public:
+    addr_preference(const std::vector<int>& rtt, const std::vector<bool>& local) :
+        rtt_(rtt), local_(local) {}
+
+    bool operator()(int a, int b) const {
+      return rank(a) < rank(b);
+    }
+
+    std::pair<int, int> rank(int i) const {
+      int rtt = rtt_[i];
+      return std::make_pair(local_[i] ? 0 : 1,
+          rtt >= 0 ? rtt : (rtt == RTT_UNKNOWN ? INT_MAX - 1 : INT_MAX));
+    }
+
+  private:
+    const std::vector<int>& rtt_;
+    const std::vector<bool>& local_;
+};
+
+void order_addrs(struct sockaddr_storage *addrs, std::vector<int>& rtt,
+    std::vector<bool>& local)
+{
+    int count = static_cast<int>(rtt.size());
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), addr_preference(rtt, local));
+
+    std::vector<struct sockaddr_storage> old_addrs(addrs, addrs + count);
+    std::vector<int> old_rtt(rtt);
+    std::vector<bool> old_local(local);
+    for (int i = 0; i < count; i++) {
+        addrs[i] = old_addrs[order[i]];
+        rtt[i] = old_rtt[order[i]];
+        local[i] = old_local[order[i]];
+    }
+}
+
+int find_faster_addr(const std::vector<int>& rtt, const std::vector<bool>& local,
+    int current)
+{
+    addr_preference preference(rtt, local);
+    int count = static_cast<int>(rtt.size());
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+        if (i == current || rtt[i] == RTT_UNREACHABLE) {
+            continue;
+        }
+        if (best == -1 || preference(i, best)) {
+            best = i;
+        }
+    }
+    if (best == -1) {
+        return -1;
+    }
+    if (local[best] != local[current]) {
+        /* a server in our zone, even if we have not measured it yet */
+        return local[best] ? best : -1;
+    }
+    int best_rtt = rtt[best];
+    int current_rtt = rtt[current];
+    if (best_rtt < 0 || current_rtt < 0) {
+        return -1;
+    }
+    return (best_rtt*2 < current_rtt && current_rtt - best_rtt >= REBALANCE_MIN_GAIN) ? best : -1;
+}
+
+/* Drop an idle connection to move to the server at index */
+static void move_to_addr(zhandle_t *zh, int index)
+{
+    // format_endpoint_info() returns a static buffer, copy the first one out
+    std::string from = format_current_endpoint_info(zh);
+    LOG_INFO(boost::format("Moving from server [%s] (%dms) to faster server [%s] (%dms)") %
+             from % zh->addrs_rtt[zh->connect_index] %
+             format_endpoint_info(&zh->addrs[index]) % zh->addrs_rtt[index]);
+    close(zh->fd);
+    zh->fd = -1;
+    delete zh->input_buffer;
+    zh->input_buffer = NULL;
+    zh->state = SessionState::Connecting;
+    queue_session_event(zh, SessionState::Connecting);
+    cleanup_bufs(zh, ReturnCode::ConnectionLoss);
+    zh->connect_index = index;
+}
+
 static struct timeval get_timeval(int interval)
 {
     struct timeval tv;
@@ -811,13 +1349,12 @@ send_ping(zhandle_t* zh) {
   int rc = 0;
   std::string serialized;
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(PING_XID);
   header.settype(OpCode::Ping);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
     gettimeofday(&zh->last_ping, 0);
@@ -847,9 +1384,50 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
     tv->tv_sec = 0;
     tv->tv_usec = 0;
     if (*fd == -1) {
+        int backoff;
+        take_resolved_addrs(zh);
+        if (zh->addrs_count == 0) {
+            /* nothing resolved yet; the resolver wakes us up once something does. Requests
+             * do not wait for it longer than the session timeout */
+            if (calculate_interval(&zh->resolve_start, &now) >= zh->recv_timeout) {
+                if (!zh->sent_requests.completions.empty()) {
+                    LOG_ERROR("None of the servers in " << zh->hostname <<
+                              " resolved within the session timeout");
+                }
+                cleanup_bufs(zh, ReturnCode::ConnectionLoss);
+            }
+            *tv = get_timeval(RESOLVE_RETRY);
+            return ReturnCode::Ok;
+        }
+        backoff = calculate_interval(&now, &zh->next_connect);
+        if (backoff > 0) {
+            /* still backing off, even if a new request woke us up */
+            *tv = get_timeval(backoff);
+            return ReturnCode::Ok;
+        }
         if (zh->connect_index == zh->addrs_count) {
-            /* Wait a bit before trying again so that we don't spin */
+            /* Every server failed. Wait a bit before trying again so that we don't spin,
+             * and start the next round with the servers we prefer. Their names may have
+             * moved to other addresses, so look them up again in the meantime */
             zh->connect_index = 0;
+            request_resolve(zh);
+            take_probed_rtts(zh);
+            if (!disable_conn_permute) {
+                boost::lock_guard<boost::mutex> lock(zh->addrs_lock);
+                order_addrs(zh->addrs, zh->addrs_rtt, zh->addrs_local);
+            }
+            backoff = connect_backoff(zh);
+            zh->connect_rounds++;
+            zh->next_connect = now;
+            zh->next_connect.tv_sec += backoff / 1000;
+            zh->next_connect.tv_usec += (backoff % 1000) * 1000;
+            if (zh->next_connect.tv_usec >= 1000000) {
+                zh->next_connect.tv_sec++;
+                zh->next_connect.tv_usec -= 1000000;
+            }
+            LOG_DEBUG("Every server failed, trying again in " << backoff << "ms");
+            *tv = get_timeval(backoff);
+            return ReturnCode::Ok;
         }else {
             int rc;
             int enable_tcp_nodelay = 1;
@@ -864,6 +1442,7 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
             if (ssoresult != 0) {
                 LOG_WARN("Unable to set TCP_NODELAY, operation latency may be effected");
             }
+            set_liveness_options(zh);
             fcntl(zh->fd, F_SETFL, O_NONBLOCK|fcntl(zh->fd, F_GETFL, 0));
 #if defined(AF_INET6)
             if (zh->addrs[zh->connect_index].ss_family == AF_INET6) {
@@ -892,7 +1471,7 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
             }
         }
         *fd = zh->fd;
-        *tv = get_timeval(zh->recv_timeout/3);
+        *tv = get_timeval(connect_timeout(zh->recv_timeout, zh->connect_rounds));
         zh->last_recv = now;
         zh->last_send = now;
         zh->last_ping = now;
@@ -900,7 +1479,8 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
     if (zh->fd != -1) {
         int idle_recv = calculate_interval(&zh->last_recv, &now);
         int idle_send = calculate_interval(&zh->last_send, &now);
-        int recv_to = zh->recv_timeout*2/3 - idle_recv;
+        int recv_to = recv_deadline(zh->recv_timeout, zh->state==SessionState::Connected,
+                                    zh->connect_rounds, idle_recv);
         int send_to = zh->recv_timeout/3;
         // have we exceeded the receive timeout threshold?
         if (recv_to <= 0) {
@@ -912,10 +1492,14 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
             return handle_socket_error_msg(zh, __LINE__,ReturnCode::OperationTimeout, "");
         }
         // We only allow 1/3 of our timeout time to expire before sending
-        // a PING
+        // a PING. We also PING a server that has been quiet for half of the
+        // liveness timeout, to find out before it runs out whether it is alive
         if (zh->state==SessionState::Connected) {
             send_to = zh->recv_timeout/3 - idle_send;
-            if (send_to <= 0 && zh->sent_requests.completions.empty()) {
+            int probe_to = liveness_timeout(zh->recv_timeout)/2 - idle_recv;
+            bool ping_outstanding = timercmp(&zh->last_ping, &zh->last_recv, >=);
+            if ((send_to <= 0 && zh->sent_requests.completions.empty()) ||
+                (probe_to <= 0 && !ping_outstanding)) {
 //                LOG_DEBUG(("Sending PING to %s (exceeded idle by %dms)",
 //                                format_current_endpoint_info(zh),-send_to));
                 int rc=send_ping(zh);
@@ -924,6 +1508,27 @@ int zookeeper_interest(zhandle_t *zh, int *fd, int *interest,
                     return rc;
                 }
                 send_to = zh->recv_timeout/3;
+                ping_outstanding = true;
+            }
+            if (!ping_outstanding && probe_to < send_to) {
+                send_to = probe_to;
+            }
+
+            // move to a faster server while there is nothing in flight to lose
+            if (calculate_interval(&zh->last_rebalance, &now) >= REBALANCE_INTERVAL &&
+                !ping_outstanding && zh->sent_requests.completions.empty() &&
+                zh->to_send.bufferList_.empty()) {
+                zh->last_rebalance = now;
+                take_probed_rtts(zh);
+                int index = disable_conn_permute ? -1 :
+                    find_faster_addr(zh->addrs_rtt, zh->addrs_local, zh->connect_index);
+                if (index != -1) {
+                    move_to_addr(zh, index);
+                    *fd = -1;
+                    *interest = 0;
+                    *tv = get_timeval(0);
+                    return ReturnCode::Ok;
+                }
             }
         }
         // choose the lesser value as the timeout
@@ -965,6 +1570,12 @@ check_events(zhandle_t *zh, int events)
             return handle_socket_error_msg(zh, __LINE__,ReturnCode::ConnectionLoss,
                 "server refused to accept the client");
         }
+        {
+            /* the TCP handshake took one round trip */
+            struct timeval now;
+            gettimeofday(&now, 0);
+            update_rtt(zh, calculate_interval(&zh->last_recv, &now));
+        }
         if((returnCode = sendConnectRequest(zh)) != ReturnCode::Ok)
             return returnCode;
         LOG_INFO("initiated connection to server: " <<
@@ -1003,10 +1614,9 @@ check_events(zhandle_t *zh, int events)
             } else  {
                 // Process connect response.
                 int64_t oldid,newid;
-                MemoryInStream istream(zh->input_buffer->buffer.data(),
-                                       zh->input_buffer->length);
-                hadoop::IBinArchive iarchive(istream);
-                zh->connectResponse.deserialize(iarchive,"connect");
+                hadoop::InlineIBinArchive iarchive(zh->input_buffer->buffer.data(),
+                                                   zh->input_buffer->length);
+                zh->connectResponse.deserialize(iarchive);
 
                 /* We are processing the connect response , so we need to finish
                  * the connection handshake */
@@ -1021,16 +1631,19 @@ check_events(zhandle_t *zh, int events)
                     "");
                 } else {
                     zh->recv_timeout = zh->connectResponse.gettimeOut();
-                    zh->sessionId = newid;
-                    zh->sessionPassword = zh->connectResponse.getpasswd();
+                    {
+                        boost::lock_guard<boost::mutex> lock(zh->session_lock);
+                        zh->sessionId = newid;
+                        zh->sessionPassword = zh->connectResponse.getpasswd();
+                    }
                     zh->state = SessionState::Connected;
+                    zh->connect_rounds = 0;
                     LOG_INFO(
                       boost::format("session establishment complete on server [%s], sessionId=%#llx, negotiated timeout=%d") %
                               format_endpoint_info(&zh->addrs[zh->connect_index]) % newid % zh->recv_timeout);
-                    /* we want the auth to be sent for, but since both call push to front
-                       we need to call send_watch_set first */
+                    /* re-arm the watches in between the queued requests, then
+                       put the authentication packets in front of everything */
                     send_set_watches(zh);
-                    /* send the authentication packet now */
                     send_auth_info(zh);
                     queue_session_event(zh, SessionState::Connected);
                 }
@@ -1046,8 +1659,7 @@ static int queue_session_event(zhandle_t *zh, SessionState::type state) {
   LOG_DEBUG("Notifying watches of a session event: new state=" <<
             SessionState::toString(state));
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
   completion_list_t *cptr;
   proto::ReplyHeader header;
   header.setxid(WATCHER_EVENT_XID);
@@ -1058,8 +1670,8 @@ static int queue_session_event(zhandle_t *zh, SessionState::type state) {
   event.setstate(state);
   event.getpath() = "";
 
-  header.serialize(oarchive, "header");
-  event.serialize(oarchive, "event");
+  header.serialize(oarchive);
+  event.serialize(oarchive);
   cptr = create_completion_entry(WATCHER_EVENT_XID,-1,0,0,0,0, false);
 
   cptr->buffer = buffer;
@@ -1070,6 +1682,36 @@ static int queue_session_event(zhandle_t *zh, SessionState::type state) {
   return ReturnCode::Ok;
 }
 
+/*
+ * IO thread queues an event for a watcher that attached to a shared server
+ * watch which fired before the attaching request completed. The watcher
+ * never saw that event, so it gets one of its own and will re-read.
+ */
+static void queue_missed_event(zhandle_t *zh, WatchEvent::type type,
+    const std::string& path, boost::shared_ptr<Watch> watch) {
+  LOG_DEBUG(boost::format("Delivering a missed %s event for path [%s]") %
+            WatchEvent::toString(type) % path);
+  buffer_t* buffer = new buffer_t();
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
+  proto::ReplyHeader header;
+  header.setxid(WATCHER_EVENT_XID);
+  header.setzxid(0);
+  header.seterr(0);
+  proto::WatcherEvent event;
+  event.settype(type);
+  event.setstate(zh->state);
+  event.getpath() = path;
+
+  header.serialize(oarchive);
+  event.serialize(oarchive);
+  completion_list_t *cptr =
+    create_completion_entry(WATCHER_EVENT_XID,-1,0,0,0,0, false);
+  cptr->buffer = buffer;
+  cptr->buffer->offset = static_cast<int32_t>(buffer->buffer.size());
+  cptr->c.watches.push_back(watch);
+  queue_completion(&zh->completions_to_process, cptr);
+}
+
 completion_list_t*
 dequeue_completion(completion_head_t* list) {
   boost::lock_guard<boost::mutex> lock(*(list->lock));
@@ -1084,7 +1726,7 @@ dequeue_completion(completion_head_t* list) {
 
 static int
 deserialize_multi(int xid, completion_list_t *cptr,
-                  hadoop::IBinArchive& iarchive,
+                  hadoop::InlineIBinArchive& iarchive,
                   boost::ptr_vector<OpResult>& results) {
 
   boost::ptr_vector<OpResult> temp;
@@ -1092,11 +1734,11 @@ deserialize_multi(int xid, completion_list_t *cptr,
   boost::ptr_vector<OpResult>* clist = cptr->c.results.get();
   assert(clist);
   proto::MultiHeader mheader;
-  mheader.deserialize(iarchive, "multiheader");
+  mheader.deserialize(iarchive);
   while (!mheader.getdone()) {
     if (mheader.gettype() == -1) {
       proto::ErrorResponse errorResponse;
-      errorResponse.deserialize(iarchive, "error");
+      errorResponse.deserialize(iarchive);
       ReturnCode::type error = (ReturnCode::type)errorResponse.geterr();
       LOG_DEBUG("got error response for: " << ReturnCode::toString(error));
       OpResult* result = new OpResult::Error();
@@ -1116,7 +1758,7 @@ deserialize_multi(int xid, completion_list_t *cptr,
           }
         case OpCode::Create: {
           proto::CreateResponse res;
-          res.deserialize(iarchive, "reply");
+          res.deserialize(iarchive);
           ReturnCode::type zrc = (ReturnCode::type) mheader.geterr();
           LOG_DEBUG("got create response for: " << res.getpath() << ": " <<
                     ReturnCode::toString(zrc));
@@ -1127,7 +1769,7 @@ deserialize_multi(int xid, completion_list_t *cptr,
         }
         case OpCode::SetData: {
           proto::SetDataResponse res;
-          res.deserialize(iarchive, "reply");
+          res.deserialize(iarchive);
           ReturnCode::type zrc = (ReturnCode::type) mheader.geterr();
           LOG_DEBUG("got setData response: " << ReturnCode::toString(zrc));
           OpResult* result = clist->release(clist->begin()).release();
@@ -1146,14 +1788,14 @@ deserialize_multi(int xid, completion_list_t *cptr,
           LOG_ERROR("Unknown multi operation type: " << (clist->begin())->getType());
       }
     }
-    mheader.deserialize(iarchive, "multiheader");
+    mheader.deserialize(iarchive);
   }
   LOG_DEBUG("returning: " << ReturnCode::toString((ReturnCode::type)rc));
   return rc;
 }
 
 static void deserialize_response(int type, int xid, ReturnCode::type rc,
-    completion_list_t *cptr, hadoop::IBinArchive& iarchive,
+    completion_list_t *cptr, hadoop::InlineIBinArchive& iarchive,
     const std::string& chroot) {
   switch (type) {
     case COMPLETION_DATA:
@@ -1161,11 +1803,11 @@ static void deserialize_response(int type, int xid, ReturnCode::type rc,
           cptr->xid % ReturnCode::toString(rc));
       if (rc != ReturnCode::Ok) {
         data::Stat stat;
-        cptr->c.data_result(rc, "", stat, cptr->data);
+        cptr->c.data_result(rc, std::string(), stat, cptr->data);
       } else {
         proto::GetDataResponse res;
-        res.deserialize(iarchive, "reply");
-        cptr->c.data_result(rc, res.getdata(), res.getstat(), cptr->data);
+        res.deserialize(iarchive);
+        cptr->c.data_result(rc, std::move(res.getdata()), res.getstat(), cptr->data);
       }
       break;
     case COMPLETION_STAT:
@@ -1176,7 +1818,7 @@ static void deserialize_response(int type, int xid, ReturnCode::type rc,
         cptr->c.stat_result(rc, stat, cptr->data);
       } else {
         proto::SetDataResponse res;
-        res.deserialize(iarchive, "reply");
+        res.deserialize(iarchive);
         cptr->c.stat_result(rc, res.getstat(), cptr->data);
       }
       break;
@@ -1184,27 +1826,41 @@ static void deserialize_response(int type, int xid, ReturnCode::type rc,
       LOG_DEBUG(boost::format("Calling COMPLETION_STRINGLIST for xid=%#08x rc=%s") %
           cptr->xid % ReturnCode::toString(rc));
       if (rc != ReturnCode::Ok) {
-        std::vector<std::string> res;
-        cptr->c.strings_result(rc, res, cptr->data);
+        cptr->c.strings_result(rc, std::vector<std::string>(), cptr->data);
       } else {
         proto::GetChildrenResponse res;
-        res.deserialize(iarchive, "reply");
-        cptr->c.strings_result(rc, res.getchildren(), cptr->data);
+        res.deserialize(iarchive);
+        cptr->c.strings_result(rc, std::move(res.getchildren()), cptr->data);
       }
       break;
     case COMPLETION_STRINGLIST_STAT:
       LOG_DEBUG(boost::format("Calling COMPLETION_STRINGLIST_STAT for xid=%#08x rc=%s") %
           cptr->xid % ReturnCode::toString(rc));
       if (rc != ReturnCode::Ok) {
-        std::vector<std::string> children;
         data::Stat stat;
-        cptr->c.strings_stat_result(rc, children, stat, cptr->data);
+        cptr->c.strings_stat_result(rc, std::vector<std::string>(), stat, cptr->data);
       } else {
         proto::GetChildren2Response res;
-        res.deserialize(iarchive, "reply");
-        cptr->c.strings_stat_result(rc, res.getchildren(), res.getstat(), cptr->data);
+        res.deserialize(iarchive);
+        cptr->c.strings_stat_result(rc, std::move(res.getchildren()), res.getstat(),
+                                    cptr->data);
       }
       break;
+    case COMPLETION_FLATSTRINGLIST_STAT: {
+      LOG_DEBUG(boost::format("Calling COMPLETION_FLATSTRINGLIST_STAT for xid=%#08x rc=%s") %
+          cptr->xid % ReturnCode::toString(rc));
+      // decoded on the heap: callbacks keep the list, and swapping it into
+      // their own storage is then O(1)
+      FlatStringList children;
+      data::Stat stat;
+      if (rc == ReturnCode::Ok) {
+        // same wire format as GetChildren2Response, minus the per-child strings
+        children.deserialize(iarchive);
+        stat.deserialize(iarchive);
+      }
+      cptr->c.flat_strings_stat_result(rc, children, stat, cptr->data);
+      break;
+    }
     case COMPLETION_STRING:
       LOG_DEBUG(boost::format("Calling COMPLETION_STRING for xid=%#08x rc=%s") %
           cptr->xid % ReturnCode::toString(rc));
@@ -1212,7 +1868,7 @@ static void deserialize_response(int type, int xid, ReturnCode::type rc,
         cptr->c.string_result(rc, "", cptr->data);
       } else {
         proto::CreateResponse res;
-        res.deserialize(iarchive, "reply");
+        res.deserialize(iarchive);
 
         //ZOOKEEPER-1027
         cptr->c.string_result(rc, PathUtils::stripChroot(res.getpath(), chroot), cptr->data);
@@ -1222,13 +1878,12 @@ static void deserialize_response(int type, int xid, ReturnCode::type rc,
       LOG_DEBUG(boost::format("Calling COMPLETION_ACLLIST for xid=%#08x rc=%s") %
           cptr->xid % ReturnCode::toString(rc));
       if (rc != ReturnCode::Ok) {
-        std::vector<data::ACL> acl;
         data::Stat stat;
-        cptr->c.acl_result(rc, acl, stat, cptr->data);
+        cptr->c.acl_result(rc, std::vector<data::ACL>(), stat, cptr->data);
       } else {
         proto::GetACLResponse res;
-        res.deserialize(iarchive, "reply");
-        cptr->c.acl_result(rc, res.getacl(), res.getstat(), cptr->data);
+        res.deserialize(iarchive);
+        cptr->c.acl_result(rc, std::move(res.getacl()), res.getstat(), cptr->data);
       }
       break;
     case COMPLETION_VOID:
@@ -1269,16 +1924,15 @@ ReturnCode::type process_completions(zhandle_t *zh) {
       return ReturnCode::InvalidState;
     }
     buffer_t *bptr = cptr->buffer;
-    MemoryInStream stream(bptr->buffer.data(), bptr->buffer.size());
-    hadoop::IBinArchive iarchive(stream);
+    hadoop::InlineIBinArchive iarchive(bptr->buffer.data(), bptr->buffer.size());
     proto::ReplyHeader header;
-    header.deserialize(iarchive, "header");
+    header.deserialize(iarchive);
 
     if (header.getxid() == WATCHER_EVENT_XID) {
       /* We are doing a notification, so there is no pending request */
       int type, state;
       proto::WatcherEvent event;
-      event.deserialize(iarchive, "event");
+      event.deserialize(iarchive);
       type = event.gettype();
       state = event.getstate();
       LOG_DEBUG(boost::format("Calling a watcher for node [%s], type = %d event=%s") %
@@ -1308,10 +1962,9 @@ zookeeper_process(zhandle_t *zh, int events) {
     return rc;
   }
   while (rc >= 0 && (bptr=dequeue_buffer(&zh->to_process))) {
-    MemoryInStream stream(bptr->buffer.data(), bptr->length);
-    hadoop::IBinArchive iarchive(stream);
+    hadoop::InlineIBinArchive iarchive(bptr->buffer.data(), bptr->length);
     proto::ReplyHeader header;
-    header.deserialize(iarchive, "header");
+    header.deserialize(iarchive);
 
     if (header.getzxid() > 0) {
       zh->last_zxid = header.getzxid();
@@ -1320,7 +1973,7 @@ zookeeper_process(zhandle_t *zh, int events) {
     if (header.getxid() == WATCHER_EVENT_XID) {
       LOG_DEBUG("Processing WATCHER_EVENT");
       proto::WatcherEvent event;
-      event.deserialize(iarchive, "event");
+      event.deserialize(iarchive);
       completion_list_t* c =
         create_completion_entry(WATCHER_EVENT_XID,-1,0,0,0,0, false);
       c->buffer = bptr;
@@ -1367,6 +2020,11 @@ zookeeper_process(zhandle_t *zh, int events) {
               " xid=%#08x path=%s, rc=%s") % header.getxid() %
             "FIXME" % ReturnCode::toString(rc));
         cptr->watch->activate(rc);
+        WatchEvent::type missed;
+        if (cptr->watch->getMissedEvent(missed)) {
+          queue_missed_event(zh, missed, cptr->watch->getPath().str(),
+                             cptr->watch->getWatch());
+        }
       }
       if (header.getxid() == PING_XID) {
         int elapsed = 0;
@@ -1374,6 +2032,9 @@ zookeeper_process(zhandle_t *zh, int events) {
         gettimeofday(&now, 0);
         elapsed = calculate_interval(&zh->last_ping, &now);
         LOG_DEBUG("Got ping response in " << elapsed << "ms");
+        if (zh->connect_index < zh->addrs_count) {
+            update_rtt(zh, elapsed);
+        }
         delete bptr;
         destroy_completion_entry(cptr);
       } else {
@@ -1402,6 +2063,20 @@ SessionState::type zoo_state(zhandle_t *zh)
   return zh->state;
 }
 
+int zoo_client_id(zhandle_t *zh, clientid_t *clientid)
+{
+  if (!zh || !clientid) {
+    return ReturnCode::BadArguments;
+  }
+  boost::lock_guard<boost::mutex> lock(zh->session_lock);
+  if (zh->sessionId == 0) {
+    return ReturnCode::InvalidState;
+  }
+  clientid->client_id = zh->sessionId;
+  clientid->passwd = zh->sessionPassword;
+  return ReturnCode::Ok;
+}
+
 static completion_list_t* create_completion_entry(int xid, int completion_type,
     const void *dc, const void *data, WatchRegistration* wo,
     boost::ptr_vector<OpResult>* results, bool isSynchronous) {
@@ -1427,6 +2102,9 @@ static completion_list_t* create_completion_entry(int xid, int completion_type,
     case COMPLETION_STRINGLIST_STAT:
       c->c.strings_stat_result = (strings_stat_completion_t)dc;
       break;
+    case COMPLETION_FLATSTRINGLIST_STAT:
+      c->c.flat_strings_stat_result = (flat_strings_stat_completion_t)dc;
+      break;
     case COMPLETION_ACLLIST:
       c->c.acl_result = (acl_completion_t)dc;
       break;
@@ -1488,13 +2166,6 @@ static int add_stat_completion(zhandle_t *zh, int xid, stat_completion_t dc,
     return add_completion(zh, xid, COMPLETION_STAT, (const void*)dc, data, wo, 0, isSynchronous);
 }
 
-static int add_strings_stat_completion(zhandle_t *zh, int xid,
-        strings_stat_completion_t dc, const void *data,
-        WatchRegistration* wo, bool isSynchronous)
-{
-    return add_completion(zh, xid, COMPLETION_STRINGLIST_STAT, (const void*)dc, data, wo, 0, isSynchronous);
-}
-
 static int add_acl_completion(zhandle_t *zh, int xid, acl_completion_t dc,
         const void *data, bool isSynchronous)
 {
@@ -1527,6 +2198,7 @@ zookeeper_close(zhandle_t *zh) {
     return ReturnCode::Ok;
   }
   zh->close_requested = 1;
+  stop_resolver(zh);
   LOG_DEBUG("Enqueueing the completion of death");
   queue_completion(&zh->completions_to_process, &zhandle_t::completionOfDeath);
   if (boost::this_thread::get_id() == zh->threads.completion.get_id()) {
@@ -1547,13 +2219,12 @@ zookeeper_close(zhandle_t *zh) {
    * destroy the handle later. */
   if(zh->state==SessionState::Connected){
     buffer_t* buffer = new buffer_t();
-    StringOutStream stream(buffer->buffer);
-    hadoop::OBinArchive oarchive(stream);
+    hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
     proto::RequestHeader header;
     header.setxid(get_xid());
     header.settype(OpCode::CloseSession);
-    header.serialize(oarchive, "header");
+    header.serialize(oarchive);
     LOG_INFO(boost::format("Closing zookeeper sessionId=%#llx to [%s]\n") %
         zh->sessionId % format_current_endpoint_info(zh));
     {
@@ -1578,6 +2249,90 @@ static ReturnCode::type getRealString(zhandle_t *zh, int flags, const std::strin
   return ReturnCode::Ok;
 }
 
+/*
+ * Request encoders for the write path. These produce the same bytes as the
+ * matching jute request records, but write the fields straight from the
+ * caller's arguments, so a request costs no intermediate record, path or
+ * data copies.
+ */
+
+/* Encodes the server side path: the chroot is written in place ahead of the
+ * client path, as PathUtils::prependChroot would join them. */
+template <typename A>
+static void serializePath(A& oarchive, const std::string& chroot,
+    const std::string& path) {
+  if (chroot.empty()) {
+    oarchive.serialize(path);
+  } else if (path == "/") {
+    oarchive.serialize(chroot);
+  } else {
+    oarchive.serialize(chroot, path);
+  }
+}
+
+template <typename A>
+static void serializeData(A& oarchive, const char* value, int valuelen) {
+  if (value != NULL && valuelen >= 0) {
+    oarchive.serialize(value, (size_t)valuelen);
+  } else {
+    oarchive.serialize("", (size_t)0);
+  }
+}
+
+/* Encodes an ACL through the const accessors; serializing the records
+ * themselves would clear their field-set bits and fail the next time. */
+template <typename A>
+static void encodeAcl(A& oarchive, const std::vector<data::ACL>& acl) {
+  oarchive.serialize((int32_t)acl.size());
+  for (size_t i = 0; i < acl.size(); i++) {
+    oarchive.serialize(acl[i].getperms());
+    oarchive.serialize(acl[i].getid().getscheme());
+    oarchive.serialize(acl[i].getid().getid());
+  }
+}
+
+static bool isOpenAcl(const std::vector<data::ACL>& acl) {
+  return acl.size() == 1 && acl[0].getperms() == Permission::All &&
+      acl[0].getid().getscheme() == "world" &&
+      acl[0].getid().getid() == "anyone";
+}
+
+/* world:anyone with all permissions (the service discovery default ACL) is
+ * used by nearly every create, so it is encoded once up front. */
+static std::string encodeOpenAcl() {
+  data::ACL open;
+  open.setperms(Permission::All);
+  open.getid().getscheme() = "world";
+  open.getid().getid() = "anyone";
+  std::string encoded;
+  hadoop::InlineOBinArchive<> oarchive(encoded);
+  encodeAcl(oarchive, std::vector<data::ACL>(1, open));
+  return encoded;
+}
+
+static const std::string& encodedOpenAcl() {
+  static const std::string encoded = encodeOpenAcl();
+  return encoded;
+}
+
+template <typename A>
+static void serializeAcl(A& oarchive, const std::vector<data::ACL>& acl) {
+  if (isOpenAcl(acl)) {
+    oarchive.append(encodedOpenAcl());
+  } else {
+    encodeAcl(oarchive, acl);
+  }
+}
+
+static size_t encodedAclSize(const std::vector<data::ACL>& acl) {
+  size_t size = sizeof(int32_t);
+  for (size_t i = 0; i < acl.size(); i++) {
+    size += 3 * sizeof(int32_t) + acl[i].getid().getscheme().length() +
+        acl[i].getid().getid().length();
+  }
+  return size;
+}
+
 /*---------------------------------------------------------------------------*
  * ASYNC API
  *---------------------------------------------------------------------------*/
@@ -1592,23 +2347,23 @@ int zoo_awget(zhandle_t *zh, const std::string& path,
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::GetData);
-  header.serialize(oarchive, "header");
-
-  proto::GetDataRequest req;
-  req.getpath() = pathStr;
-  req.setwatch(watch.get() != NULL);
-  req.serialize(oarchive, "req");
+  header.serialize(oarchive);
 
   WatchRegistration* reg = NULL;
   if (watch.get() != NULL) {
     reg = new GetDataWatchRegistration(zh->watchManager, pathStr, watch);
   }
+
+  proto::GetDataRequest req;
+  req.getpath() = pathStr;
+  // the server keeps one watch per path; share it if it is already armed
+  req.setwatch(reg != NULL && !reg->shareServerWatch());
+  req.serialize(oarchive);
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
     rc = rc < 0 ? rc : add_data_completion(zh, header.getxid(), dc, data,
@@ -1626,30 +2381,25 @@ int zoo_awget(zhandle_t *zh, const std::string& path,
 int zoo_aset(zhandle_t *zh, const std::string& path, const char *buf, int buflen,
         int version, stat_completion_t dc, const void *data, bool isSynchronous)
 {
-  std::string pathStr;
-  int rc = getRealString(zh, 0, path, pathStr);
-  if (rc != ReturnCode::Ok) {
-    return rc;
+  if (zh == NULL) {
+    return ReturnCode::BadArguments;
   }
+  int rc = ReturnCode::Ok;
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  buffer->buffer.reserve(5 * sizeof(int32_t) + zh->chroot.length() +
+      path.length() + (buflen > 0 ? buflen : 0));
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::SetData);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
-  proto::SetDataRequest req;
-  req.getpath() = pathStr;
-  if (buf != NULL && buflen >= 0) {
-    req.getdata() = std::string(buf, buflen);
-  } else {
-    req.getdata() = "";
-  }
-  req.setversion(version);
-  req.serialize(oarchive, "req");
+  // proto::SetDataRequest
+  serializePath(oarchive, zh->chroot, path);
+  serializeData(oarchive, buf, buflen);
+  oarchive.serialize((int32_t)version);
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -1670,31 +2420,26 @@ ReturnCode::type zoo_acreate(zhandle_t *zh, const std::string& path, const char
         int flags, string_completion_t completion, const void *data,
         bool isSynchronous) {
   LOG_DEBUG("Entering zoo_acreate()");
-  std::string pathStr;
-  ReturnCode::type rc = getRealString(zh, flags, path, pathStr);
-  if (rc != ReturnCode::Ok) {
-    return rc;
+  if (zh == NULL) {
+    return ReturnCode::BadArguments;
   }
+  ReturnCode::type rc = ReturnCode::Ok;
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  buffer->buffer.reserve(5 * sizeof(int32_t) + zh->chroot.length() +
+      path.length() + (valuelen > 0 ? valuelen : 0) + encodedAclSize(acl));
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::Create);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
-  proto::CreateRequest req;
-  req.getpath() = pathStr;
-  if (value != NULL && valuelen >= 0) {
-    req.getdata() = std::string(value, valuelen);
-  } else {
-    req.getdata() = "";
-  }
-  req.getacl() = acl;
-  req.setflags(flags);
-  req.serialize(oarchive, "req");
+  // proto::CreateRequest
+  serializePath(oarchive, zh->chroot, path);
+  serializeData(oarchive, value, valuelen);
+  serializeAcl(oarchive, acl);
+  oarchive.serialize((int32_t)flags);
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -1718,18 +2463,17 @@ int zoo_adelete(zhandle_t *zh, const std::string& path, int version,
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::Remove);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
   proto::DeleteRequest req;
   req.getpath() = pathStr;
   req.setversion(version);
-  req.serialize(oarchive, "req");
+  req.serialize(oarchive);
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -1756,18 +2500,17 @@ int zoo_awexists(zhandle_t *zh, const std::string& path,
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::Exists);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
   proto::ExistsRequest req;
   req.getpath() = pathStr;
   req.setwatch(watch.get() != NULL);
-  req.serialize(oarchive, "req");
+  req.serialize(oarchive);
 
   WatchRegistration* reg = NULL;
   if (watch.get() != NULL) {
@@ -1788,10 +2531,11 @@ int zoo_awexists(zhandle_t *zh, const std::string& path,
   return (rc < 0)?ReturnCode::MarshallingError:ReturnCode::Ok;
 }
 
-int zoo_awget_children2(zhandle_t *zh, const std::string& path,
-         boost::shared_ptr<Watch> watch,
-         strings_stat_completion_t ssc, const void *data,
-         bool isSynchronous) {
+/* Queue a GetChildren2 request. Its result is decoded by the completion of
+ * completion_type, so the flat and the vector results share the request */
+static int awget_children2(zhandle_t *zh, const std::string& path,
+         boost::shared_ptr<Watch> watch, int completion_type, const void *dc,
+         const void *data, bool isSynchronous) {
   std::string pathStr;
   int rc = getRealString(zh, 0, path, pathStr);
   if (rc != ReturnCode::Ok) {
@@ -1799,28 +2543,27 @@ int zoo_awget_children2(zhandle_t *zh, const std::string& path,
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::GetChildren2);
-  header.serialize(oarchive, "header");
-
-  proto::GetChildren2Request req;
-  req.getpath() = pathStr;
-  req.setwatch(watch.get() != NULL);
-  req.serialize(oarchive, "req");
+  header.serialize(oarchive);
 
   WatchRegistration* reg = NULL;
   if (watch.get() != NULL) {
-    reg = new GetChildrenWatchRegistration(zh->watchManager, req.getpath(),
-                                           watch);
+    reg = new GetChildrenWatchRegistration(zh->watchManager, pathStr, watch);
   }
+
+  proto::GetChildren2Request req;
+  req.getpath() = pathStr;
+  // the server keeps one watch per path; share it if it is already armed
+  req.setwatch(reg != NULL && !reg->shareServerWatch());
+  req.serialize(oarchive);
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
-    rc = rc < 0 ? rc : add_strings_stat_completion(zh, header.getxid(), ssc,
-        data, reg, isSynchronous);
+    rc = rc < 0 ? rc : add_completion(zh, header.getxid(), completion_type, dc,
+        data, reg, 0, isSynchronous);
     queue_buffer(&zh->to_send, buffer);
   }
 
@@ -1831,6 +2574,22 @@ int zoo_awget_children2(zhandle_t *zh, const std::string& path,
   return (rc < 0)?ReturnCode::MarshallingError:ReturnCode::Ok;
 }
 
+int zoo_awget_children2(zhandle_t *zh, const std::string& path,
+         boost::shared_ptr<Watch> watch,
+         strings_stat_completion_t ssc, const void *data,
+         bool isSynchronous) {
+  return awget_children2(zh, path, watch, COMPLETION_STRINGLIST_STAT,
+      (const void*)ssc, data, isSynchronous);
+}
+
+int zoo_awget_children2_flat(zhandle_t *zh, const std::string& path,
+         boost::shared_ptr<Watch> watch,
+         flat_strings_stat_completion_t ssc, const void *data,
+         bool isSynchronous) {
+  return awget_children2(zh, path, watch, COMPLETION_FLATSTRINGLIST_STAT,
+      (const void*)ssc, data, isSynchronous);
+}
+
 int zoo_async(zhandle_t *zh, const std::string& path,
               string_completion_t completion, const void *data) {
   std::string pathStr;
@@ -1840,17 +2599,16 @@ int zoo_async(zhandle_t *zh, const std::string& path,
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::Sync);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
   proto::SyncRequest req;
   req.getpath() = pathStr;
-  req.serialize(oarchive, "req");
+  req.serialize(oarchive);
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -1875,17 +2633,16 @@ int zoo_aget_acl(zhandle_t *zh, const std::string& path, acl_completion_t comple
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::GetAcl);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
   proto::GetACLRequest req;
   req.getpath() = pathStr;
-  req.serialize(oarchive, "req");
+  req.serialize(oarchive);
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -1911,19 +2668,18 @@ int zoo_aset_acl(zhandle_t *zh, const std::string& path, int version,
   }
 
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::SetAcl);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
 
   proto::SetACLRequest req;
   req.getpath() = pathStr;
   req.setversion(version);
   req.getacl() = acl;
-  req.serialize(oarchive, "req");
+  req.serialize(oarchive);
 
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
@@ -1942,50 +2698,43 @@ int zoo_aset_acl(zhandle_t *zh, const std::string& path, int version,
 int zoo_amulti(zhandle_t *zh,
     const boost::ptr_vector<org::apache::zookeeper::Op>& ops,
     multi_completion_t completion, const void *data, bool isSynchronous) {
+  if (zh == NULL) {
+    return ReturnCode::BadArguments;
+  }
   buffer_t* buffer = new buffer_t();
-  StringOutStream stream(buffer->buffer);
-  hadoop::OBinArchive oarchive(stream);
+  hadoop::InlineOBinArchive<> oarchive(buffer->buffer);
 
   proto::RequestHeader header;
   header.setxid(get_xid());
   header.settype(OpCode::Multi);
-  header.serialize(oarchive, "header");
+  header.serialize(oarchive);
   boost::ptr_vector<OpResult>* results = new boost::ptr_vector<OpResult>();
 
   size_t index = 0;
   for (index = 0; index < ops.size(); index++) {
-    std::string pathStr;
     proto::MultiHeader mheader;
     mheader.settype(ops[index].getType());
     mheader.setdone(0);
     mheader.seterr(-1);
-    mheader.serialize(oarchive, "req");
-
-    int rc = getRealString(zh, 0, ops[index].getPath().c_str(), pathStr);
-    if (rc != ReturnCode::Ok) {
-      return rc;
-    }
+    mheader.serialize(oarchive);
 
+    // the sub-requests are encoded field by field, see serializePath()
     switch(ops[index].getType()) {
       case OpCode::Create: {
         const Op::Create* createOp = dynamic_cast<const Op::Create*>(&(ops[index]));
         assert(createOp != NULL);
-        proto::CreateRequest createReq;
-        createReq.getpath() = pathStr;
-        createReq.getdata() = createOp->getData();
-        createReq.getacl() = createOp->getAcl();
-        createReq.setflags(createOp->getMode());
-        createReq.serialize(oarchive, "req");
+        serializePath(oarchive, zh->chroot, createOp->getPath());
+        oarchive.serialize(createOp->getData());
+        serializeAcl(oarchive, createOp->getAcl());
+        oarchive.serialize((int32_t)createOp->getMode());
         results->push_back(new OpResult::Create());
         break;
       }
       case OpCode::Remove: {
         const Op::Remove* removeOp = dynamic_cast<const Op::Remove*>(&(ops[index]));
         assert(removeOp != NULL);
-        proto::DeleteRequest removeReq;
-        removeReq.getpath() = pathStr;
-        removeReq.setversion(removeOp->getVersion());
-        removeReq.serialize(oarchive, "req");
+        serializePath(oarchive, zh->chroot, removeOp->getPath());
+        oarchive.serialize((int32_t)removeOp->getVersion());
         results->push_back(new OpResult::Remove());
         break;
       }
@@ -1993,11 +2742,9 @@ int zoo_amulti(zhandle_t *zh,
       case OpCode::SetData: {
         const Op::SetData* setDataOp = dynamic_cast<const Op::SetData*>(&(ops[index]));
         assert(setDataOp != NULL);
-        proto::SetDataRequest setDataReq;
-        setDataReq.getpath() = pathStr;
-        setDataReq.getdata() = setDataOp->getData();
-        setDataReq.setversion(setDataOp->getVersion());
-        setDataReq.serialize(oarchive, "req");
+        serializePath(oarchive, zh->chroot, setDataOp->getPath());
+        oarchive.serialize(setDataOp->getData());
+        oarchive.serialize((int32_t)setDataOp->getVersion());
         results->push_back(new OpResult::SetData());
         break;
      }
@@ -2005,10 +2752,8 @@ int zoo_amulti(zhandle_t *zh,
       case OpCode::Check: {
         const Op::Check* checkOp = dynamic_cast<const Op::Check*>(&(ops[index]));
         assert(checkOp != NULL);
-        proto::CheckVersionRequest checkReq;
-        checkReq.getpath() = pathStr;
-        checkReq.setversion(checkOp->getVersion());
-        checkReq.serialize(oarchive, "req");
+        serializePath(oarchive, zh->chroot, checkOp->getPath());
+        oarchive.serialize((int32_t)checkOp->getVersion());
         results->push_back(new OpResult::Check());
         break;
       }
@@ -2024,7 +2769,7 @@ int zoo_amulti(zhandle_t *zh,
   mheader.settype(-1);
   mheader.setdone(1);
   mheader.seterr(-1);
-  mheader.serialize(oarchive, "req");
+  mheader.serialize(oarchive);
   {
     boost::lock_guard<boost::mutex> lock(zh->mutex);
     add_multi_completion(zh, header.getxid(), completion, data, results, isSynchronous);
@@ -2155,6 +2900,10 @@ static const char* format_endpoint_info(const struct sockaddr_storage* ep)
 
 static const char* format_current_endpoint_info(zhandle_t* zh)
 {
+    boost::lock_guard<boost::mutex> lock(zh->addrs_lock);
+    if (zh->connect_index >= zh->addrs_count) {
+        return "null";
+    }
     return format_endpoint_info(&zh->addrs[zh->connect_index]);
 }
 
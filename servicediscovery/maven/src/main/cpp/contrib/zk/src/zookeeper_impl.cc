@@ -120,8 +120,13 @@ class MyGetCallback : public GetCallback, public Waitable {
       data_(data), stat_(stat) {}
     void process(ReturnCode::type rc, const std::string& path,
                  const std::string& data, const data::Stat& stat) {
+      process(rc, path, std::string(data), stat);
+    }
+
+    void process(ReturnCode::type rc, const std::string& path,
+                 std::string&& data, const data::Stat& stat) {
       if (rc == ReturnCode::Ok) {
-        data_ = data;
+        data_ = std::move(data);
         stat_ = stat;
       }
       rc_ = rc;
@@ -143,8 +148,14 @@ class MyGetAclCallback : public GetAclCallback, public Waitable {
     void process(ReturnCode::type rc, const std::string& path,
                  const std::vector<data::ACL>& acl,
                  const data::Stat& stat) {
+      process(rc, path, std::vector<data::ACL>(acl), stat);
+    }
+
+    void process(ReturnCode::type rc, const std::string& path,
+                 std::vector<data::ACL>&& acl,
+                 const data::Stat& stat) {
       if (rc == ReturnCode::Ok) {
-        acl_ = acl;
+        acl_ = std::move(acl);
         stat_ = stat;
       }
       rc_ = rc;
@@ -180,8 +191,14 @@ class MyGetChildrenCallback : public GetChildrenCallback, public Waitable {
     void process(ReturnCode::type rc, const std::string& path,
                  const std::vector<std::string>& children,
                  const data::Stat& stat) {
+      process(rc, path, std::vector<std::string>(children), stat);
+    }
+
+    void process(ReturnCode::type rc, const std::string& path,
+                 std::vector<std::string>&& children,
+                 const data::Stat& stat) {
       if (rc == ReturnCode::Ok) {
-        children_ = children;
+        children_ = std::move(children);
         stat_ = stat;
       }
       rc_ = rc;
@@ -195,6 +212,29 @@ class MyGetChildrenCallback : public GetChildrenCallback, public Waitable {
     data::Stat& stat_;
 };
 
+class MyGetChildrenFlatCallback : public GetChildrenFlatCallback, public Waitable {
+  public:
+    MyGetChildrenFlatCallback(FlatStringList& children, data::Stat& stat) :
+      children_(children), stat_(stat) {}
+
+    void process(ReturnCode::type rc, const std::string& path,
+                 FlatStringList& children,
+                 const data::Stat& stat) {
+      if (rc == ReturnCode::Ok) {
+        children_.swap(children);
+        stat_ = stat;
+      }
+      rc_ = rc;
+      path_ = path;
+      notifyCompleted();
+    }
+
+    ReturnCode::type rc_;
+    std::string path_;
+    FlatStringList& children_;
+    data::Stat& stat_;
+};
+
 
 class MySetCallback : public SetCallback, public Waitable {
   public:
@@ -324,19 +364,19 @@ setCompletion(int rc, const data::Stat& stat, const void* data) {
 }
 
 void ZooKeeperImpl::
-dataCompletion(int rc, const std::string& value,
+dataCompletion(int rc, std::string&& value,
                const data::Stat& stat, const void *data) {
   CompletionContext* context = (CompletionContext*)data;
-  std::string result;
   GetCallback* callback = (GetCallback*)context->callback_.get();
   if (callback) {
-    callback->process((ReturnCode::type)rc, context->path_, value, stat);
+    callback->process((ReturnCode::type)rc, context->path_, std::move(value),
+                      stat);
   }
   delete context;
 }
 
 void ZooKeeperImpl::
-childrenCompletion(int rc, const std::vector<std::string>& children,
+childrenCompletion(int rc, std::vector<std::string>&& children,
                    const data::Stat& stat, const void *data) {
   CompletionContext* context = (CompletionContext*)data;
   LOG_DEBUG("getChildren() for " << context->path_ << " returned: " <<
@@ -344,12 +384,26 @@ childrenCompletion(int rc, const std::vector<std::string>& children,
   GetChildrenCallback* callback =
     (GetChildrenCallback*)context->callback_.get();
   assert(callback);
+  callback->process((ReturnCode::type)rc, context->path_, std::move(children),
+                    stat);
+  delete context;
+}
+
+void ZooKeeperImpl::
+flatChildrenCompletion(int rc, FlatStringList& children,
+                       const data::Stat& stat, const void *data) {
+  CompletionContext* context = (CompletionContext*)data;
+  LOG_DEBUG("getChildrenFlat() for " << context->path_ << " returned: " <<
+            ReturnCode::toString((ReturnCode::type)rc));
+  GetChildrenFlatCallback* callback =
+    (GetChildrenFlatCallback*)context->callback_.get();
+  assert(callback);
   callback->process((ReturnCode::type)rc, context->path_, children, stat);
   delete context;
 }
 
 void ZooKeeperImpl::
-aclCompletion(int rc, const std::vector<data::ACL>& acl,
+aclCompletion(int rc, std::vector<data::ACL>&& acl,
               const data::Stat& stat, const void *data) {
   CompletionContext* context = (CompletionContext*)data;
   LOG_DEBUG("getAcl() for " << context->path_ << " returned: " <<
@@ -365,7 +419,7 @@ aclCompletion(int rc, const std::vector<data::ACL>& acl,
                       Permission::toString(acl[i].getperms()));
     }
   }
-  callback->process((ReturnCode::type)rc, context->path_, acl, stat);
+  callback->process((ReturnCode::type)rc, context->path_, std::move(acl), stat);
   delete context;
 }
 
@@ -413,8 +467,24 @@ ZooKeeperImpl::
 
 ReturnCode::type ZooKeeperImpl::
 init(const std::string& hosts, int32_t sessionTimeoutMs,
-     boost::shared_ptr<Watch> watch) {
-  handle_ = zookeeper_init(hosts.c_str(), watch, sessionTimeoutMs, 0);
+     boost::shared_ptr<Watch> watch, int32_t flags) {
+  handle_ = zookeeper_init(hosts.c_str(), watch, sessionTimeoutMs, NULL, flags);
+  if (handle_ == NULL) {
+    return ReturnCode::Error;
+  }
+  inited_ = true;
+  return ReturnCode::Ok;
+}
+
+ReturnCode::type ZooKeeperImpl::
+init(const std::string& hosts, int32_t sessionTimeoutMs,
+     boost::shared_ptr<Watch> watch, int64_t sessionId,
+     const std::string& sessionPassword, int32_t flags) {
+  clientid_t clientid;
+  clientid.client_id = sessionId;
+  clientid.passwd = sessionPassword;
+  handle_ = zookeeper_init(hosts.c_str(), watch, sessionTimeoutMs, &clientid,
+                           flags);
   if (handle_ == NULL) {
     return ReturnCode::Error;
   }
@@ -631,6 +701,38 @@ getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
   return callback->rc_;
 }
 
+ReturnCode::type ZooKeeperImpl::
+getChildrenFlat(const std::string& path, boost::shared_ptr<Watch> watch,
+                boost::shared_ptr<GetChildrenFlatCallback> cb,
+                bool isSynchronous) {
+  flat_strings_stat_completion_t completion = NULL;
+  CompletionContext* context = NULL;
+
+  if (cb.get()) {
+    completion = &flatChildrenCompletion;
+    context = new CompletionContext(cb, path);
+  }
+
+  int rc = zoo_awget_children2_flat(handle_, path.c_str(), watch,
+                                    completion, (void*)context,
+                                    isSynchronous);
+  return (ReturnCode::type)rc;
+}
+
+ReturnCode::type ZooKeeperImpl::
+getChildren(const std::string& path, boost::shared_ptr<Watch> watch,
+            FlatStringList& children, data::Stat& stat) {
+  boost::shared_ptr<MyGetChildrenFlatCallback>
+    callback(new MyGetChildrenFlatCallback(children, stat));
+  ReturnCode::type rc = getChildrenFlat(path, watch, callback, true);
+  if (rc != ReturnCode::Ok) {
+    return rc;
+  }
+  callback->waitForCompleted();
+  assert(path == callback->path_);
+  return callback->rc_;
+}
+
 ReturnCode::type ZooKeeperImpl::
 getAcl(const std::string& path, boost::shared_ptr<GetAclCallback> cb,
        bool isSynchronous) {
@@ -739,6 +841,26 @@ close() {
   return ReturnCode::Ok;
 }
 
+ReturnCode::type ZooKeeperImpl::
+getSessionId(int64_t& id) {
+  clientid_t clientid;
+  ReturnCode::type rc = (ReturnCode::type)zoo_client_id(handle_, &clientid);
+  if (rc == ReturnCode::Ok) {
+    id = clientid.client_id;
+  }
+  return rc;
+}
+
+ReturnCode::type ZooKeeperImpl::
+getSessionPassword(std::string& password) {
+  clientid_t clientid;
+  ReturnCode::type rc = (ReturnCode::type)zoo_client_id(handle_, &clientid);
+  if (rc == ReturnCode::Ok) {
+    password.swap(clientid.passwd);
+  }
+  return rc;
+}
+
 SessionState::type ZooKeeperImpl::
 getState() {
   if (!inited_) {
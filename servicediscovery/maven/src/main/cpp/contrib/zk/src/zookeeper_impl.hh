@@ -30,7 +30,10 @@ class ZooKeeperImpl {
     ZooKeeperImpl();
     ~ZooKeeperImpl();
     ReturnCode::type init(const std::string& hosts, int32_t sessionTimeoutMs,
-                    boost::shared_ptr<Watch> watch);
+                    boost::shared_ptr<Watch> watch, int32_t flags);
+    ReturnCode::type init(const std::string& hosts, int32_t sessionTimeoutMs,
+                    boost::shared_ptr<Watch> watch, int64_t sessionId,
+                    const std::string& sessionPassword, int32_t flags);
     ReturnCode::type addAuth(const std::string& scheme, const std::string& cert,
                        boost::shared_ptr<AddAuthCallback> callback,
                        bool isSynchronous);
@@ -73,6 +76,14 @@ class ZooKeeperImpl {
                            boost::shared_ptr<Watch> watch,
                            std::vector<std::string>& children,
                            data::Stat& stat);
+    ReturnCode::type getChildrenFlat(const std::string& path,
+                           boost::shared_ptr<Watch> watch,
+                           boost::shared_ptr<GetChildrenFlatCallback> callback,
+                           bool isSynchronous);
+    ReturnCode::type getChildren(const std::string& path,
+                           boost::shared_ptr<Watch> watch,
+                           FlatStringList& children,
+                           data::Stat& stat);
     ReturnCode::type getAcl(const std::string& path,
                       boost::shared_ptr<GetAclCallback> callback,
                       bool isSynchronous);
@@ -94,6 +105,8 @@ class ZooKeeperImpl {
     ReturnCode::type close();
     SessionState::type getState();
     void setState(SessionState::type state);
+    ReturnCode::type getSessionId(int64_t& id);
+    ReturnCode::type getSessionPassword(std::string& password);
 
   private:
     static void watchCallback(zhandle_t *zh, int type, int state, const char *path,
@@ -107,11 +120,13 @@ class ZooKeeperImpl {
                                  const void* data);
     static void setCompletion(int rc, const data::Stat& stat,
                               const void* data);
-    static void dataCompletion(int rc, const std::string& value,
+    static void dataCompletion(int rc, std::string&& value,
                                const data::Stat& stat, const void *data);
-    static void childrenCompletion(int rc, const std::vector<std::string>& children,
+    static void childrenCompletion(int rc, std::vector<std::string>&& children,
                                    const data::Stat& stat, const void *data);
-    static void aclCompletion(int rc, const std::vector<data::ACL>& acl,
+    static void flatChildrenCompletion(int rc, FlatStringList& children,
+                                       const data::Stat& stat, const void *data);
+    static void aclCompletion(int rc, std::vector<data::ACL>&& acl,
                               const data::Stat& stat, const void *data);
     static void authCompletion(int rc, const void *data);
     static void syncCompletion(int rc, const char *value, const void *data);
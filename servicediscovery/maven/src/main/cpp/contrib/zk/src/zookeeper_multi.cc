@@ -36,7 +36,7 @@ getType() const {
   return type_;
 }
 
-std::string Op::
+const std::string& Op::
 getPath() const {
   return path_;
 }
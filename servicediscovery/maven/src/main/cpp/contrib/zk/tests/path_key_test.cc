@@ -0,0 +1,133 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <zookeeper/path_key.hh>
+
+using namespace org::apache::zookeeper;
+
+TEST(PathKeyTest, intern) {
+  PathKey null;
+  EXPECT_TRUE(null.isNull());
+  EXPECT_EQ("", null.str());
+  EXPECT_EQ(0, (int)null.id());
+
+  PathKey key = PathKey::intern("/path_key_test/a");
+  EXPECT_FALSE(key.isNull());
+  EXPECT_EQ("/path_key_test/a", key.str());
+  EXPECT_EQ(boost::hash<std::string>()("/path_key_test/a"), key.hash());
+  EXPECT_LT((uint32_t)0, key.id());
+  EXPECT_GE(PathKey::count(), key.id());
+
+  // interning the same path again returns the same entry
+  PathKey again = PathKey::intern(std::string("/path_key_test/") + "a");
+  EXPECT_EQ(key, again);
+  EXPECT_EQ(&key.str(), &again.str());
+
+  PathKey other = PathKey::intern("/path_key_test/b");
+  EXPECT_NE(key, other);
+  EXPECT_NE(key.id(), other.id());
+}
+
+TEST(PathKeyTest, find) {
+  PathKey key;
+  EXPECT_FALSE(PathKey::find("/path_key_test/never_interned", key));
+  EXPECT_TRUE(key.isNull());
+
+  PathKey interned = PathKey::intern("/path_key_test/found");
+  EXPECT_TRUE(PathKey::find("/path_key_test/found", key));
+  EXPECT_EQ(interned, key);
+}
+
+TEST(PathKeyTest, hashMap) {
+  boost::unordered_map<PathKey, int> map;
+  map[PathKey::intern("/path_key_test/x")] = 1;
+  map[PathKey::intern("/path_key_test/y")] = 2;
+  EXPECT_EQ(1, map[PathKey::intern("/path_key_test/x")]);
+  EXPECT_EQ(2, map[PathKey::intern("/path_key_test/y")]);
+  EXPECT_EQ(2, (int)map.size());
+}
+
+static void internPaths(std::vector<PathKey>* keys) {
+  for (int i = 0; i < 1000; i++) {
+    keys->push_back(PathKey::intern(
+        str(boost::format("/path_key_test/concurrent%d") % i)));
+  }
+}
+
+TEST(PathKeyTest, concurrentIntern) {
+  std::vector<PathKey> keys[4];
+  boost::thread_group threads;
+  for (int i = 0; i < 4; i++) {
+    threads.create_thread(boost::bind(internPaths, &keys[i]));
+  }
+  threads.join_all();
+  for (int i = 1; i < 4; i++) {
+    EXPECT_TRUE(keys[0] == keys[i]);
+  }
+}
+
+TEST(PathKeyTest, releasedOnLastKey) {
+  uint32_t id;
+  {
+    PathKey key = PathKey::intern("/path_key_test/released");
+    PathKey copy = key;
+    id = key.id();
+    key = PathKey();
+    // the copy still holds the entry
+    PathKey found;
+    EXPECT_TRUE(PathKey::find("/path_key_test/released", found));
+    EXPECT_EQ(copy, found);
+  }
+  PathKey found;
+  EXPECT_FALSE(PathKey::find("/path_key_test/released", found));
+
+  // the id is handed out again instead of growing the id space
+  uint32_t count = PathKey::count();
+  PathKey reused = PathKey::intern("/path_key_test/reused");
+  EXPECT_EQ(id, reused.id());
+  EXPECT_EQ(count, PathKey::count());
+  EXPECT_EQ("/path_key_test/reused", reused.str());
+}
+
+static void internAndRelease(int thread) {
+  for (int i = 0; i < 1000; i++) {
+    PathKey key = PathKey::intern(
+        str(boost::format("/path_key_test/churn%d") % (i % 8)));
+    PathKey copy = key;
+    EXPECT_EQ(str(boost::format("/path_key_test/churn%d") % (i % 8)),
+              copy.str());
+  }
+}
+
+TEST(PathKeyTest, concurrentRelease) {
+  boost::thread_group threads;
+  for (int i = 0; i < 4; i++) {
+    threads.create_thread(boost::bind(internAndRelease, i));
+  }
+  threads.join_all();
+  PathKey found;
+  for (int i = 0; i < 8; i++) {
+    EXPECT_FALSE(PathKey::find(
+        str(boost::format("/path_key_test/churn%d") % i), found));
+  }
+}
@@ -16,11 +16,15 @@
  * limitations under the License.
  */
 #include <gtest/gtest.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
 #include <memory_in_stream.hh>
 #include <string_out_stream.hh>
 #include <zookeeper.jute.hh>
 #include <recordio.hh>
 #include <binarchive.hh>
+#include <flat_string_list.hh>
+#include <inline_binarchive.hh>
 
 using namespace boost;
 using namespace org::apache::zookeeper;
@@ -118,3 +122,284 @@ TEST(TestRecordIo, testConnectResponse) {
   res2.deserialize(iarchive, "something else?");
   EXPECT_TRUE(res1 == res2);
 }
+
+TEST(TestRecordIo, testMoveRecord) {
+  proto::GetChildren2Response res1;
+  res1.getchildren().push_back("child1");
+  res1.getchildren().push_back("child2");
+  res1.getstat().setpzxid(11);
+  const std::string* first = &res1.getchildren()[0];
+
+  // moving hands over the children storage instead of copying it
+  proto::GetChildren2Response res2(std::move(res1));
+  ASSERT_EQ(2, (int)res2.getchildren().size());
+  EXPECT_EQ(first, &res2.getchildren()[0]);
+  EXPECT_EQ(11, res2.getstat().getpzxid());
+
+  proto::GetChildren2Response res3;
+  res3 = std::move(res2);
+  EXPECT_EQ(first, &res3.getchildren()[0]);
+
+  // copies are still deep
+  proto::GetChildren2Response res4(res3);
+  EXPECT_TRUE(res3 == res4);
+  EXPECT_NE(first, &res4.getchildren()[0]);
+}
+
+TEST(TestRecordIo, testInlineArchiveMatchesBinArchive) {
+  proto::GetChildren2Response res1, res2;
+  res1.getchildren().push_back("child1");
+  res1.getchildren().push_back("");
+  res1.getchildren().push_back("child3");
+  res1.getstat().setczxid(0x0102030405060708LL);
+  res1.getstat().setmzxid(-1);
+  res1.getstat().setctime(3);
+  res1.getstat().setmtime(4);
+  res1.getstat().setversion(-5);
+  res1.getstat().setcversion(6);
+  res1.getstat().setaversion(7);
+  res1.getstat().setephemeralOwner(8);
+  res1.getstat().setdataLength(9);
+  res1.getstat().setnumChildren(3);
+  res1.getstat().setpzxid(11);
+
+  // the inline archive must produce the same bytes as OBinArchive. Records
+  // clear their field bits once serialized, so encode a copy here.
+  proto::GetChildren2Response copy(res1);
+  std::string expected;
+  StringOutStream stream(expected);
+  hadoop::OBinArchive oarchive(stream);
+  copy.serialize(oarchive, "mytag");
+
+  std::string serialized;
+  hadoop::InlineOBinArchive<> ioarchive(serialized);
+  res1.serialize(ioarchive);
+  EXPECT_EQ(expected, serialized);
+
+  hadoop::InlineIBinArchive iarchive(serialized.data(), serialized.size());
+  res2.deserialize(iarchive);
+  EXPECT_TRUE(res1 == res2);
+  EXPECT_EQ(0, (int)iarchive.remaining());
+}
+
+TEST(TestRecordIo, testInlineArchivePiecewise) {
+  proto::CreateRequest req;
+  req.getpath() = "/chroot/a/b";
+  req.getdata() = "data";
+  data::ACL acl;
+  acl.setperms(31);
+  acl.getid().getscheme() = "world";
+  acl.getid().getid() = "anyone";
+  req.getacl().push_back(acl);
+  req.setflags(1);
+  std::string expected;
+  hadoop::InlineOBinArchive<> oarchive(expected);
+  req.serialize(oarchive);
+
+  // the same request written field by field, with the chroot in place and
+  // the ACL appended pre-encoded
+  std::string encodedAcl;
+  hadoop::InlineOBinArchive<> aclarchive(encodedAcl);
+  aclarchive.serialize((int32_t)1);
+  aclarchive.serialize((int32_t)31);
+  aclarchive.serialize(std::string("world"));
+  aclarchive.serialize(std::string("anyone"));
+
+  std::string serialized;
+  hadoop::InlineOBinArchive<> ioarchive(serialized);
+  ioarchive.serialize(std::string("/chroot"), std::string("/a/b"));
+  ioarchive.serialize("data", (size_t)4);
+  ioarchive.append(encodedAcl);
+  ioarchive.serialize((int32_t)1);
+  EXPECT_EQ(expected, serialized);
+}
+
+TEST(TestRecordIo, testFlatStringList) {
+  proto::GetChildren2Response res;
+  res.getchildren().push_back("child1");
+  res.getchildren().push_back("");
+  res.getchildren().push_back("child3");
+  res.getstat().setczxid(1);
+  res.getstat().setmzxid(2);
+  res.getstat().setctime(3);
+  res.getstat().setmtime(4);
+  res.getstat().setversion(5);
+  res.getstat().setcversion(6);
+  res.getstat().setaversion(7);
+  res.getstat().setephemeralOwner(8);
+  res.getstat().setdataLength(9);
+  res.getstat().setnumChildren(3);
+  res.getstat().setpzxid(11);
+  std::vector<std::string> expected = res.getchildren();
+
+  std::string serialized;
+  hadoop::InlineOBinArchive<> oarchive(serialized);
+  res.serialize(oarchive);
+
+  // decode the children straight from the response buffer
+  FlatStringList children;
+  data::Stat stat;
+  hadoop::InlineIBinArchive iarchive(serialized.data(), serialized.size());
+  children.deserialize(iarchive);
+  stat.deserialize(iarchive);
+  EXPECT_EQ(0, (int)iarchive.remaining());
+  EXPECT_EQ(11, stat.getpzxid());
+
+  ASSERT_EQ(expected.size(), children.size());
+  EXPECT_EQ(expected, children.toVector());
+  EXPECT_EQ(boost::string_ref("child3"), children[2]);
+  size_t count = 0;
+  for (FlatStringList::const_iterator i = children.begin();
+       i != children.end(); ++i) {
+    EXPECT_EQ(expected[count++], (*i).to_string());
+  }
+  EXPECT_EQ(expected.size(), count);
+
+  // moving leaves the source empty but usable
+  FlatStringList moved(std::move(children));
+  EXPECT_EQ(expected.size(), moved.size());
+  EXPECT_TRUE(children.empty());
+  children.push_back("x", 1);
+  EXPECT_EQ(boost::string_ref("x"), children[0]);
+}
+
+TEST(TestRecordIo, testFlatStringListTruncated) {
+  proto::GetChildrenResponse res;
+  res.getchildren().push_back("child1");
+  res.getchildren().push_back("child2");
+  std::string serialized;
+  hadoop::InlineOBinArchive<> oarchive(serialized);
+  res.serialize(oarchive);
+
+  // a count or a length past the end of the input is rejected before any
+  // room is reserved for it
+  serialized[0] = serialized[1] = serialized[2] = '\x7f';
+  for (size_t len = 1; len <= serialized.size(); len++) {
+    hadoop::InlineIBinArchive iarchive(serialized.data(), len);
+    FlatStringList children;
+    try {
+      children.deserialize(iarchive);
+      FAIL() << "deserialized a truncated list of length " << len;
+    } catch (hadoop::IOException* e) {
+      delete e;
+    }
+  }
+}
+
+TEST(TestRecordIo, testInlineArchiveTruncated) {
+  proto::ConnectResponse res1, res2;
+  res1.setprotocolVersion(10);
+  res1.settimeOut(123);
+  res1.setsessionId(2);
+  res1.getpasswd() = "mypass";
+
+  std::string serialized;
+  hadoop::InlineOBinArchive<> oarchive(serialized);
+  res1.serialize(oarchive);
+
+  // every proper prefix of the record must be rejected
+  for (size_t len = 0; len < serialized.size(); len++) {
+    hadoop::InlineIBinArchive iarchive(serialized.data(), len);
+    try {
+      res2.deserialize(iarchive);
+      FAIL() << "deserialized a truncated record of length " << len;
+    } catch (hadoop::IOException* e) {
+      delete e;
+    }
+  }
+}
+
+/**
+ * The stream archives used to do their reads and writes inside assert(), so
+ * they must keep working (and keep failing on short input) under NDEBUG.
+ */
+TEST(TestRecordIo, testBinArchiveTruncated) {
+  proto::ConnectResponse res1, res2;
+  res1.setprotocolVersion(10);
+  res1.settimeOut(123);
+  res1.setsessionId(0x1122334455667788LL);
+  res1.getpasswd() = "mypass";
+
+  std::string serialized;
+  StringOutStream stream(serialized);
+  hadoop::OBinArchive oarchive(stream);
+  res1.serialize(oarchive, "mytag");
+  EXPECT_EQ(4 + 4 + 8 + 4 + 6, (int)serialized.size());
+
+  for (size_t len = 0; len < serialized.size(); len++) {
+    MemoryInStream istream(serialized.data(), len);
+    hadoop::IBinArchive iarchive(istream);
+    try {
+      res2.deserialize(iarchive, "mytag");
+      FAIL() << "deserialized a truncated record of length " << len;
+    } catch (hadoop::IOException* e) {
+      delete e;
+    }
+  }
+}
+
+/**
+ * Encodes and decodes the same children response through both archives and
+ * records the time taken as test properties (see --gtest_output=xml). Too
+ * slow for the unit suite, run it with --gtest_also_run_disabled_tests
+ * against both the debug and the optimized (-DNDEBUG) builds.
+ */
+TEST(TestRecordIo, DISABLED_benchmarkArchives) {
+  const int kIterations = 20000;
+  proto::GetChildren2Response res;
+  for (int i = 0; i < 32; i++) {
+    res.getchildren().push_back(str(boost::format("endpoint-%04d:%d") % i % (8000 + i)));
+  }
+  res.getstat().setczxid(1);
+  res.getstat().setmzxid(2);
+  res.getstat().setctime(3);
+  res.getstat().setmtime(4);
+  res.getstat().setversion(5);
+  res.getstat().setcversion(6);
+  res.getstat().setaversion(7);
+  res.getstat().setephemeralOwner(8);
+  res.getstat().setdataLength(9);
+  res.getstat().setnumChildren(32);
+  res.getstat().setpzxid(11);
+
+  std::string reference;
+  {
+    proto::GetChildren2Response copy(res);
+    StringOutStream stream(reference);
+    hadoop::OBinArchive oarchive(stream);
+    copy.serialize(oarchive, "reply");
+  }
+
+  int64_t checksum = 0;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (int i = 0; i < kIterations; i++) {
+    std::string serialized;
+    proto::GetChildren2Response in(res), out;
+    StringOutStream stream(serialized);
+    hadoop::OBinArchive oarchive(stream);
+    in.serialize(oarchive, "reply");
+    MemoryInStream istream(serialized.data(), serialized.size());
+    hadoop::IBinArchive iarchive(istream);
+    out.deserialize(iarchive, "reply");
+    ASSERT_EQ(reference, serialized);
+    checksum += out.getchildren().size() + out.getstat().getpzxid();
+  }
+  boost::posix_time::ptime middle = boost::posix_time::microsec_clock::universal_time();
+  for (int i = 0; i < kIterations; i++) {
+    std::string serialized;
+    proto::GetChildren2Response in(res), out;
+    hadoop::InlineOBinArchive<> oarchive(serialized);
+    in.serialize(oarchive);
+    hadoop::InlineIBinArchive iarchive(serialized.data(), serialized.size());
+    out.deserialize(iarchive);
+    ASSERT_EQ(reference, serialized);
+    checksum += out.getchildren().size() + out.getstat().getpzxid();
+  }
+  boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time();
+
+  EXPECT_EQ(2 * kIterations * (32 + 11), checksum);
+  ::testing::Test::RecordProperty("streamMicros",
+      static_cast<int>((middle - start).total_microseconds()));
+  ::testing::Test::RecordProperty("inlineMicros",
+      static_cast<int>((end - middle).total_microseconds()));
+}
@@ -20,6 +20,9 @@
 ENABLE_LOGGING;
 
 #include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include "watch_manager.hh"
 #include "zk_server.hh"
 
@@ -68,6 +71,11 @@ class EmptyWatch : public Watch {
 TEST(WatchManager, activate) {
   std::vector<std::string> paths;
   shared_ptr<WatchManager> manager(new WatchManager());
+  std::vector<shared_ptr<Watch> > watchers;
+  for (int i = 0; i < 300; i++) {
+    watchers.push_back(shared_ptr<Watch>(new EmptyWatch()));
+  }
+  int next = 0;
   manager->setDefaultWatch(boost::shared_ptr<Watch>(new EmptyWatch()));
 
   // GetWatches should return the default watch for session events.
@@ -80,21 +88,21 @@ TEST(WatchManager, activate) {
     // 10 watches for /exists{i}
     std::string path = str(boost::format("/exists%d") % i);
     for (int j = 0; j < 10; j++) {
-      ExistsWatchRegistration exists(manager, path, shared_ptr<Watch>());
+      ExistsWatchRegistration exists(manager, path, watchers[next++]);
       EXPECT_TRUE(exists.activate(ReturnCode::NoNode));
     }
 
     // 10 watches for /data{i}
     path = str(boost::format("/data%d") % i);
     for (int j = 0; j < 10; j++) {
-      GetDataWatchRegistration data(manager, path, shared_ptr<Watch>());
+      GetDataWatchRegistration data(manager, path, watchers[next++]);
       EXPECT_TRUE(data.activate(ReturnCode::Ok));
     }
 
     // 10 watches for /children{i}
     path = str(boost::format("/children%d") % i);
     for (int j = 0; j < 10; j++) {
-      GetChildrenWatchRegistration children(manager, path, shared_ptr<Watch>());
+      GetChildrenWatchRegistration children(manager, path, watchers[next++]);
       EXPECT_TRUE(children.activate(ReturnCode::Ok));
     }
   }
@@ -193,3 +201,224 @@ TEST(WatchManager, activate) {
   EXPECT_EQ(1, watches.size());
 }
 
+
+TEST(WatchManager, sessionEventsGoToEachWatcherOnce) {
+  shared_ptr<WatchManager> manager(new WatchManager());
+  shared_ptr<Watch> defaultWatch(new EmptyWatch());
+  shared_ptr<Watch> watch(new EmptyWatch());
+  manager->setDefaultWatch(defaultWatch);
+
+  // one watcher on many paths, plus the default watch on a path
+  for (int i = 0; i < 100; i++) {
+    std::string path = str(boost::format("/dedup%d") % i);
+    GetDataWatchRegistration data(manager, path, watch);
+    EXPECT_TRUE(data.activate(ReturnCode::Ok));
+    GetChildrenWatchRegistration children(manager, path, watch);
+    EXPECT_TRUE(children.activate(ReturnCode::Ok));
+  }
+  GetDataWatchRegistration data(manager, "/dedup0", defaultWatch);
+  EXPECT_TRUE(data.activate(ReturnCode::Ok));
+
+  std::list<boost::shared_ptr<Watch> > watches;
+  manager->getWatches(WatchEvent::SessionStateChanged, SessionState::Connected,
+                      "", watches);
+  ASSERT_EQ(2, watches.size());
+  EXPECT_EQ(defaultWatch, watches.front());
+  EXPECT_EQ(watch, watches.back());
+
+  // /dedup0 has three watches: two data watches and a child watch
+  manager->getWatches(WatchEvent::ZnodeRemoved, SessionState::Connected,
+                      "/dedup0", watches);
+  EXPECT_EQ(3, watches.size());
+
+  // the remaining paths still hold the watcher
+  std::vector<std::string> paths;
+  manager->getGetDataPaths(paths);
+  EXPECT_EQ(99, paths.size());
+  EXPECT_EQ(paths.end(), find(paths.begin(), paths.end(), "/dedup0"));
+  manager->getWatches(WatchEvent::SessionStateChanged, SessionState::Connected,
+                      "", watches);
+  EXPECT_EQ(2, watches.size());
+
+  // once every path has fired the watcher is dropped from the table
+  for (int i = 1; i < 100; i++) {
+    std::string path = str(boost::format("/dedup%d") % i);
+    manager->getWatches(WatchEvent::ZnodeRemoved, SessionState::Connected,
+                        path, watches);
+    EXPECT_EQ(2, watches.size());
+  }
+  manager->getWatches(WatchEvent::SessionStateChanged, SessionState::Connected,
+                      "", watches);
+  EXPECT_EQ(1, watches.size());
+  manager->getGetDataPaths(paths);
+  EXPECT_TRUE(paths.empty());
+  manager->getGetChildrenPaths(paths);
+  EXPECT_TRUE(paths.empty());
+}
+
+TEST(WatchManager, manyWatchesOnOnePath) {
+  shared_ptr<WatchManager> manager(new WatchManager());
+  std::vector<shared_ptr<Watch> > watchers;
+  for (int i = 0; i < 50; i++) {
+    watchers.push_back(shared_ptr<Watch>(new EmptyWatch()));
+    GetChildrenWatchRegistration children(manager, "/many", watchers.back());
+    EXPECT_TRUE(children.activate(ReturnCode::Ok));
+    // interleave another path so that slots get moved around
+    GetDataWatchRegistration data(manager, str(boost::format("/other%d") % i),
+                                  watchers.back());
+    EXPECT_TRUE(data.activate(ReturnCode::Ok));
+  }
+
+  std::list<boost::shared_ptr<Watch> > watches;
+  manager->getWatches(WatchEvent::ZnodeDataChanged, SessionState::Connected,
+                      "/other0", watches);
+  EXPECT_EQ(1, watches.size());
+
+  // watches come back in registration order
+  manager->getWatches(WatchEvent::ZnodeChildrenChanged, SessionState::Connected,
+                      "/many", watches);
+  ASSERT_EQ(50, watches.size());
+  int i = 0;
+  BOOST_FOREACH(const shared_ptr<Watch>& watch, watches) {
+    EXPECT_EQ(watchers[i++], watch);
+  }
+
+  std::vector<std::string> paths;
+  manager->getGetDataPaths(paths);
+  EXPECT_EQ(49, paths.size());
+  manager->getGetChildrenPaths(paths);
+  EXPECT_TRUE(paths.empty());
+}
+
+static void registerWatches(shared_ptr<WatchManager> manager, int thread,
+                            shared_ptr<Watch> watch) {
+  for (int i = 0; i < 200; i++) {
+    std::string path = str(boost::format("/concurrent%d/%d") % thread % i);
+    GetDataWatchRegistration data(manager, path, watch);
+    EXPECT_TRUE(data.activate(ReturnCode::Ok));
+    GetChildrenWatchRegistration children(manager, "/concurrent", watch);
+    EXPECT_TRUE(children.activate(ReturnCode::Ok));
+  }
+}
+
+static void fireWatches(shared_ptr<WatchManager> manager, int thread,
+                        int* fired) {
+  std::list<boost::shared_ptr<Watch> > watches;
+  for (int i = 0; i < 200; i++) {
+    std::string path = str(boost::format("/concurrent%d/%d") % thread % i);
+    // spin until the registering thread has caught up
+    do {
+      manager->getWatches(WatchEvent::ZnodeDataChanged,
+                          SessionState::Connected, path, watches);
+      *fired += watches.size();
+    } while (watches.empty());
+    manager->getWatches(WatchEvent::SessionStateChanged,
+                        SessionState::Connected, "", watches);
+  }
+}
+
+TEST(WatchManager, concurrentAccess) {
+  shared_ptr<WatchManager> manager(new WatchManager());
+  const int numThreads = 4;
+  std::vector<shared_ptr<Watch> > watchers;
+  int fired[numThreads] = {0};
+  boost::thread_group threads;
+  for (int i = 0; i < numThreads; i++) {
+    watchers.push_back(shared_ptr<Watch>(new EmptyWatch()));
+    threads.create_thread(boost::bind(registerWatches, manager, i,
+                                      watchers.back()));
+    threads.create_thread(boost::bind(fireWatches, manager, i, &fired[i]));
+  }
+  threads.join_all();
+
+  for (int i = 0; i < numThreads; i++) {
+    EXPECT_EQ(200, fired[i]);
+  }
+  std::vector<std::string> paths;
+  manager->getGetDataPaths(paths);
+  EXPECT_TRUE(paths.empty());
+
+  // only the shared child watches are left, one per watcher
+  std::list<boost::shared_ptr<Watch> > watches;
+  manager->getWatches(WatchEvent::ZnodeChildrenChanged,
+                      SessionState::Connected, "/concurrent", watches);
+  EXPECT_EQ(numThreads, watches.size());
+  manager->getWatches(WatchEvent::SessionStateChanged,
+                      SessionState::Connected, "", watches);
+  EXPECT_TRUE(watches.empty());
+}
+
+TEST(WatchManager, dedup) {
+  shared_ptr<WatchManager> manager(new WatchManager());
+  shared_ptr<Watch> watch1(new EmptyWatch());
+  shared_ptr<Watch> watch2(new EmptyWatch());
+  PathKey path = PathKey::intern("/dedup");
+
+  EXPECT_EQ(WatchManager::ADDED,
+            manager->addWatch(WatchManager::GET_DATA, path, watch1));
+  EXPECT_EQ(WatchManager::DUPLICATE,
+            manager->addWatch(WatchManager::GET_DATA, path, watch1));
+  EXPECT_EQ(WatchManager::ADDED,
+            manager->addWatch(WatchManager::GET_DATA, path, watch2));
+  // the same watcher with a different type is a separate watch
+  EXPECT_EQ(WatchManager::ADDED,
+            manager->addWatch(WatchManager::GET_CHILDREN, path, watch1));
+
+  // many registrations through the registration path collapse too
+  for (int i = 0; i < 10; i++) {
+    GetChildrenWatchRegistration children(manager, "/dedup", watch2);
+    EXPECT_TRUE(children.activate(ReturnCode::Ok));
+  }
+
+  std::list<boost::shared_ptr<Watch> > watches;
+  manager->getWatches(WatchEvent::ZnodeDataChanged, SessionState::Connected,
+                      "/dedup", watches);
+  ASSERT_EQ(4, watches.size());
+  EXPECT_EQ(watch1, watches.front());
+  EXPECT_EQ(watch2, watches.back());
+
+  // the duplicate adds did not leak references to the watchers
+  manager->getWatches(WatchEvent::SessionStateChanged, SessionState::Connected,
+                      "", watches);
+  EXPECT_TRUE(watches.empty());
+}
+
+TEST(WatchManager, shareServerWatch) {
+  shared_ptr<WatchManager> manager(new WatchManager());
+  shared_ptr<Watch> watch1(new EmptyWatch());
+  shared_ptr<Watch> watch2(new EmptyWatch());
+  shared_ptr<Watch> watch3(new EmptyWatch());
+  WatchEvent::type missed;
+
+  // the first watcher has to ask the server for a watch
+  GetChildrenWatchRegistration first(manager, "/shared", watch1);
+  EXPECT_FALSE(first.shareServerWatch());
+  EXPECT_TRUE(first.activate(ReturnCode::Ok));
+  EXPECT_FALSE(first.getMissedEvent(missed));
+
+  // the second one can share it; a data watch can not
+  GetChildrenWatchRegistration second(manager, "/shared", watch2);
+  EXPECT_TRUE(second.shareServerWatch());
+  GetDataWatchRegistration data(manager, "/shared", watch2);
+  EXPECT_FALSE(data.shareServerWatch());
+  EXPECT_TRUE(second.activate(ReturnCode::Ok));
+  EXPECT_FALSE(second.getMissedEvent(missed));
+
+  // a third one shares it, but the watch fires before the response
+  GetChildrenWatchRegistration third(manager, "/shared", watch3);
+  EXPECT_TRUE(third.shareServerWatch());
+  std::list<boost::shared_ptr<Watch> > watches;
+  manager->getWatches(WatchEvent::ZnodeChildrenChanged, SessionState::Connected,
+                      "/shared", watches);
+  EXPECT_EQ(2, watches.size());
+  EXPECT_TRUE(third.activate(ReturnCode::Ok));
+  EXPECT_TRUE(third.getMissedEvent(missed));
+  EXPECT_EQ(WatchEvent::ZnodeChildrenChanged, missed);
+
+  // the third watcher was not left behind without a server watch
+  manager->getWatches(WatchEvent::ZnodeChildrenChanged, SessionState::Connected,
+                      "/shared", watches);
+  EXPECT_TRUE(watches.empty());
+  GetChildrenWatchRegistration rearm(manager, "/shared", watch3);
+  EXPECT_FALSE(rearm.shareServerWatch());
+}
@@ -0,0 +1,265 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <boost/thread.hpp>
+#include "zk_adaptor.h"
+
+TEST(ZooKeeperCTest, livenessTimeoutIsCappedBySessionTimeout) {
+  EXPECT_EQ(2000, liveness_timeout(30000));
+  EXPECT_EQ(2000, liveness_timeout(120000));
+  // a short session leaves itself time to reach another server
+  EXPECT_EQ(2000, liveness_timeout(6000));
+  EXPECT_EQ(1000, liveness_timeout(3000));
+}
+
+TEST(ZooKeeperCTest, recvDeadline) {
+  // a connected server has the liveness timeout, less the time it has been quiet
+  EXPECT_EQ(2000, recv_deadline(30000, true, 0, 0));
+  EXPECT_EQ(500, recv_deadline(30000, true, 0, 1500));
+  EXPECT_GE(0, recv_deadline(30000, true, 0, 2000));
+  EXPECT_EQ(1000, recv_deadline(3000, true, 0, 0));
+
+  // an attempt to connect has the connect timeout, doubling with every round that failed
+  EXPECT_EQ(2000, recv_deadline(30000, false, 0, 0));
+  EXPECT_EQ(4000, recv_deadline(30000, false, 1, 0));
+  EXPECT_EQ(3000, recv_deadline(30000, false, 1, 1000));
+  // up to 2/3 of the session timeout
+  EXPECT_EQ(20000, recv_deadline(30000, false, 8, 0));
+  EXPECT_EQ(20000, recv_deadline(30000, false, 100, 0));
+  EXPECT_EQ(2000, recv_deadline(3000, false, 0, 0));
+}
+
+static std::vector<struct sockaddr_storage> make_addrs(int count) {
+  std::vector<struct sockaddr_storage> addrs(count);
+  for (int i = 0; i < count; i++) {
+    struct sockaddr_in *addr = reinterpret_cast<struct sockaddr_in*>(&addrs[i]);
+    memset(&addrs[i], 0, sizeof(addrs[i]));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(static_cast<uint16_t>(2181 + i));
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  }
+  return addrs;
+}
+
+static int port_of(const struct sockaddr_storage& addr) {
+  return ntohs(reinterpret_cast<const struct sockaddr_in*>(&addr)->sin_port) - 2181;
+}
+
+TEST(ZooKeeperCTest, orderAddrs) {
+  std::vector<struct sockaddr_storage> addrs = make_addrs(6);
+  int rtts[] = {RTT_UNREACHABLE, 30, RTT_UNKNOWN, 10, 50, 10};
+  bool locals[] = {false, false, true, false, true, false};
+  std::vector<int> rtt(rtts, rtts + 6);
+  std::vector<bool> local(locals, locals + 6);
+
+  order_addrs(&addrs[0], rtt, local);
+
+  // our zone first, then the fastest, then those we have no round trip for, then the unreachable
+  int expected[] = {4, 2, 3, 5, 1, 0};
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(expected[i], port_of(addrs[i])) << i;
+    EXPECT_EQ(rtts[expected[i]], rtt[i]) << i;
+    EXPECT_EQ(locals[expected[i]], local[i]) << i;
+  }
+}
+
+TEST(ZooKeeperCTest, findFasterAddr) {
+  std::vector<bool> remote(3, false);
+  std::vector<int> rtt(3);
+
+  // only for a round trip under half of ours, and REBALANCE_MIN_GAIN shorter
+  rtt[0] = 40; rtt[1] = 30; rtt[2] = 19;
+  EXPECT_EQ(2, find_faster_addr(rtt, remote, 0));
+  rtt[2] = 20;
+  EXPECT_EQ(-1, find_faster_addr(rtt, remote, 0));
+  rtt[0] = 5; rtt[1] = 2; rtt[2] = 1;
+  EXPECT_EQ(-1, find_faster_addr(rtt, remote, 0));
+
+  // not to servers we have no round trip for, or could not reach
+  rtt[0] = 40; rtt[1] = RTT_UNKNOWN; rtt[2] = RTT_UNREACHABLE;
+  EXPECT_EQ(-1, find_faster_addr(rtt, remote, 0));
+
+  // to a server in our zone, however fast the one we are on
+  std::vector<bool> local(3, false);
+  local[2] = true;
+  rtt[0] = 1; rtt[1] = 1; rtt[2] = RTT_UNKNOWN;
+  EXPECT_EQ(2, find_faster_addr(rtt, local, 0));
+  EXPECT_EQ(-1, find_faster_addr(rtt, local, 2));
+  rtt[2] = RTT_UNREACHABLE;
+  EXPECT_EQ(-1, find_faster_addr(rtt, local, 0));
+}
+
+TEST(ZooKeeperCTest, probeRtt) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(-1, fd);
+  struct sockaddr_storage addr = make_addrs(1)[0];
+  struct sockaddr_in *in = reinterpret_cast<struct sockaddr_in*>(&addr);
+  socklen_t len = sizeof(*in);
+  in->sin_port = 0;
+  ASSERT_EQ(0, bind(fd, reinterpret_cast<struct sockaddr*>(in), len));
+  ASSERT_EQ(0, listen(fd, 1));
+  ASSERT_EQ(0, getsockname(fd, reinterpret_cast<struct sockaddr*>(in), &len));
+
+  int rtt = probe_rtt(&addr, 1000);
+  EXPECT_LE(0, rtt);
+  EXPECT_GT(1000, rtt);
+
+  // refused once nothing listens any more
+  close(fd);
+  EXPECT_EQ(RTT_UNREACHABLE, probe_rtt(&addr, 1000));
+}
+
+/* A handle with what the resolver functions use, and no threads */
+class ResolverTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      zh = new zhandle_t();
+      zh->fd = -1;
+      zh->threads.self_pipe[0] = zh->threads.self_pipe[1] = -1;
+      zh->sent_requests.lock.reset(new boost::mutex());
+      zh->sent_requests.cond.reset(new boost::condition_variable());
+      zh->completions_to_process.lock.reset(new boost::mutex());
+      zh->completions_to_process.cond.reset(new boost::condition_variable());
+      zh->hostname = strdup("localhost:2181");
+      zh->resolver.reset(new resolver_t());
+      zh->resolver->hosts = zh->hostname;
+    }
+
+    virtual void TearDown() {
+      delete zh;
+    }
+
+    int index_of(int port) {
+      for (int i = 0; i < zh->addrs_count; i++) {
+        if (port_of(zh->addrs[i]) == port) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    zhandle_t *zh;
+};
+
+TEST_F(ResolverTest, installAddrs) {
+  std::vector<struct sockaddr_storage> addrs = make_addrs(4);
+  std::vector<struct sockaddr_storage> first(addrs.begin(), addrs.begin() + 3);
+  ASSERT_EQ(ReturnCode::Ok, install_addrs(zh, first, std::vector<bool>(3, false)));
+  ASSERT_EQ(3, zh->addrs_count);
+  EXPECT_EQ(0, zh->connect_index);
+  for (int port = 0; port < 3; port++) {
+    ASSERT_NE(-1, index_of(port));
+    EXPECT_EQ(RTT_UNKNOWN, zh->addrs_rtt[index_of(port)]);
+  }
+
+  // addresses that are still there keep their round trips, and the next one stays next
+  zh->addrs_rtt[index_of(1)] = 7;
+  zh->connect_index = index_of(2);
+  std::vector<struct sockaddr_storage> second(addrs.begin() + 1, addrs.end());
+  ASSERT_EQ(ReturnCode::Ok, install_addrs(zh, second, std::vector<bool>(3, false)));
+  ASSERT_EQ(3, zh->addrs_count);
+  EXPECT_EQ(-1, index_of(0));
+  EXPECT_EQ(7, zh->addrs_rtt[index_of(1)]);
+  EXPECT_EQ(RTT_UNKNOWN, zh->addrs_rtt[index_of(3)]);
+  EXPECT_EQ(index_of(2), zh->connect_index);
+}
+
+TEST_F(ResolverTest, installAddrsPrefersOurZone) {
+  std::vector<bool> local(4, false);
+  local[2] = true;
+  ASSERT_EQ(ReturnCode::Ok, install_addrs(zh, make_addrs(4), local));
+  EXPECT_EQ(2, port_of(zh->addrs[0]));
+  EXPECT_TRUE(zh->addrs_local[0]);
+}
+
+TEST_F(ResolverTest, takeResolvedAddrs) {
+  // nothing ready
+  take_resolved_addrs(zh);
+  EXPECT_EQ(0, zh->addrs_count);
+
+  zh->resolver->addrs = make_addrs(2);
+  zh->resolver->local.assign(2, false);
+  zh->resolver->ready = true;
+  take_resolved_addrs(zh);
+  EXPECT_EQ(2, zh->addrs_count);
+  EXPECT_FALSE(zh->resolver->ready);
+  EXPECT_TRUE(zh->resolver->addrs.empty());
+
+  // taken only once
+  install_addrs(zh, make_addrs(1), std::vector<bool>(1, false));
+  take_resolved_addrs(zh);
+  EXPECT_EQ(1, zh->addrs_count);
+}
+
+static void resolve(boost::shared_ptr<resolver_t> resolver) {
+  do_resolve(resolver);
+}
+
+TEST_F(ResolverTest, stopResolverDuringLookup) {
+  int wakeup[2];
+  ASSERT_EQ(0, pipe(wakeup));
+  fcntl(wakeup[0], F_SETFL, O_NONBLOCK|fcntl(wakeup[0], F_GETFL, 0));
+  boost::shared_ptr<resolver_t> first = zh->resolver;
+
+  for (int i = 0; i < 50; i++) {
+    boost::shared_ptr<resolver_t> resolver(new resolver_t());
+    resolver->hosts = "localhost:2181,127.0.0.1:2182";
+    resolver->wakeup_fd = wakeup[1];
+    zh->resolver = resolver;
+    boost::thread thread(resolve, resolver);
+    // stop it at different points of the lookup
+    boost::this_thread::sleep(boost::posix_time::microseconds((i % 10) * 100));
+    stop_resolver(zh);
+
+    bool ready, probed_ready;
+    {
+      boost::lock_guard<boost::mutex> lock(resolver->lock);
+      ready = resolver->ready;
+      probed_ready = resolver->probed_ready;
+    }
+    char c;
+    while (read(wakeup[0], &c, 1) == 1) {
+    }
+    ASSERT_TRUE(thread.timed_join(boost::posix_time::seconds(10)));
+
+    // nothing is handed over once stopped
+    EXPECT_EQ(-1, read(wakeup[0], &c, 1));
+    EXPECT_EQ(ready, resolver->ready);
+    EXPECT_EQ(probed_ready, resolver->probed_ready);
+    EXPECT_EQ(ready, !resolver->addrs.empty());
+  }
+  zh->resolver = first;
+  close(wakeup[0]);
+  close(wakeup[1]);
+}
+
+TEST(ZooKeeperCTest, initFailsForBadConnectStrings) {
+  const char *hosts[] = {"", "/chroot", ",,", "localhost", "localhost:", "localhost:0",
+                         "localhost:70000", ":2181", "localhost:2181,:2181", " :2181"};
+  for (size_t i = 0; i < sizeof(hosts)/sizeof(hosts[0]); i++) {
+    errno = 0;
+    EXPECT_TRUE(zookeeper_init(hosts[i], boost::shared_ptr<Watch>(), 10000, 0, 0) == NULL)
+        << hosts[i];
+    EXPECT_EQ(EINVAL, errno) << hosts[i];
+  }
+}
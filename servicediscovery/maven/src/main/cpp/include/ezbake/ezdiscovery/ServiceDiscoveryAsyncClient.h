@@ -24,6 +24,9 @@
 
 #include <ezbake/ezdiscovery/ServiceDiscoveryClient.h>
 #include <ezbake/ezdiscovery/ServiceDiscoveryCallbacks.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryLastKnown.h>
+#include <ezbake/ezdiscovery/ServiceDiscoverySingleFlight.h>
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
@@ -38,8 +41,23 @@ public:
     /**
      * Constructor/Destructor
      */
-    ServiceDiscoveryAsyncClient() {}
-    virtual ~ServiceDiscoveryAsyncClient() {}
+    ServiceDiscoveryAsyncClient()
+        : _existsCalls(::boost::make_shared<Calls>()),
+          _childrenCalls(::boost::make_shared<Calls>()),
+          _flatCalls(::boost::make_shared<Calls>()),
+          _existsKnown(::boost::make_shared<KnownStats>()),
+          _childrenKnown(::boost::make_shared<KnownChildren>()),
+          _flatKnown(::boost::make_shared<KnownFlatChildren>()),
+          _retryTimer(::boost::make_shared<RetryTimer>()) {}
+    virtual ~ServiceDiscoveryAsyncClient() {
+        close();
+    }
+
+    /**
+     * Drop the retries still waiting to be sent, then terminate our connection to zookeeper.
+     * Their callbacks are not called.
+     */
+    virtual void close();
 
     /**
      * Register a service end point for service discovery
@@ -48,13 +66,40 @@ public:
      *@param serviceName the name of the service that we are registering
      *@param point the host:port number of a service end point
      *@param callback create callback that will be called for asynchronous response
+     *@param mode IF_ABSENT to leave an end point that is already registered untouched, e.g. when
+     *            re-registering periodically
      *
      *@throws ServiceDiscoveryException for any zookeeper errors
      */
     void registerEndpoint(const ::std::string& serviceName, const ::std::string& point,
-            ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback);
+            ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+            RegistrationMode mode = REPLACE_EXISTING);
     void registerEndpoint(const ::std::string& appName, const ::std::string& serviceName,
-            const ::std::string& point, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback);
+            const ::std::string& point, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+            RegistrationMode mode = REPLACE_EXISTING);
+
+    /**
+     * Register a service end point that lives as long as this client's session
+     *
+     * The end point goes away when the client is closed or stops talking to zookeeper. If the
+     * session expires the end point is registered again on the new session, until it is
+     * unregistered.
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *@param point the host:port number of a service end point
+     *@param callback create callback that will be called for asynchronous response
+     *@param mode IF_ABSENT to leave an end point that is already registered by this session
+     *            untouched. One registered persistently or by another session is replaced
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    void registerEphemeralEndpoint(const ::std::string& serviceName, const ::std::string& point,
+            ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+            RegistrationMode mode = REPLACE_EXISTING);
+    void registerEphemeralEndpoint(const ::std::string& appName, const ::std::string& serviceName,
+            const ::std::string& point, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+            RegistrationMode mode = REPLACE_EXISTING);
 
     /**
      * Unregister a service end point for service discovery
@@ -106,6 +151,47 @@ public:
     void getEndpoints(const ::std::string& appName, const ::std::string& serviceName,
             ::boost::shared_ptr<ServiceDiscoveryListCallback> callback);
 
+    /**
+     * Get the end points for a service in an application as a flat string list
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *@param callback flat list callback that will be called for asynchronous response
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    void getEndpoints(const ::std::string& serviceName,
+            ::boost::shared_ptr<ServiceDiscoveryFlatListCallback> callback);
+    void getEndpoints(const ::std::string& appName, const ::std::string& serviceName,
+            ::boost::shared_ptr<ServiceDiscoveryFlatListCallback> callback);
+
+    /**
+     * Get the number of end points for a service in an application without listing them
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *@param callback count callback that will be called for asynchronous response
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    void getEndpointCount(const ::std::string& serviceName,
+            ::boost::shared_ptr<ServiceDiscoveryCountCallback> callback);
+    void getEndpointCount(const ::std::string& appName, const ::std::string& serviceName,
+            ::boost::shared_ptr<ServiceDiscoveryCountCallback> callback);
+
+    /**
+     * Get every application with its services and their end points, e.g. to build a routing
+     * table, with a breadth-first crawl that keeps up to maxConcurrency reads in flight on our
+     * session. It takes about one round trip per level of the tree, rather than one per node.
+     *
+     *@param callback registry callback that will be called for asynchronous response
+     *@param maxConcurrency the maximum number of getChildren requests kept in flight
+     *
+     *@throws ServiceDiscoveryException if the crawl could not be started
+     */
+    void getRegistrySnapshot(::boost::shared_ptr<ServiceDiscoveryRegistryCallback> callback,
+            unsigned int maxConcurrency = DEFAULT_CRAWL_CONCURRENCY);
+
     /**
      * Sets the security Id for an application
      *
@@ -165,17 +251,191 @@ public:
     void isServiceCommon(const ::std::string& serviceName,
             ::boost::shared_ptr<ServiceDiscoveryStatusCallback> callback);
 
+    /**
+     * Keep the last result read of up to maxPaths paths, each for up to maxAgeMs (0 for no
+     * limit). A read lost with the session is then answered with STALE and the last result
+     * read for its path, rather than with ERROR. Nothing is kept by default.
+     */
+    void setLastKnownReads(unsigned int maxPaths, unsigned int maxAgeMs);
+
 protected:
     virtual void checkPathExists(const ::std::string& path,
             ::boost::shared_ptr<ServiceDiscoveryCallback> callback);
 
     virtual void createPath(const ::std::string& path,
-            ::boost::shared_ptr<ServiceDiscoveryCallback> callback);
+            ::boost::shared_ptr<ServiceDiscoveryCallback> callback,
+            RegistrationMode mode = REPLACE_EXISTING,
+            ::org::apache::zookeeper::CreateMode::type createMode =
+                    ::org::apache::zookeeper::CreateMode::Persistent);
 
     virtual void getChildren(const ::std::string& path,
             ::boost::shared_ptr<ServiceDiscoveryCallback> callback);
 
+    virtual void getChildrenFlat(const ::std::string& path,
+            ::boost::shared_ptr<ServiceDiscoveryCallback> callback);
+
 private:
+    typedef SingleFlightCallbacks<ServiceDiscoveryCallback> Calls;
+
+    typedef LastKnownReads< ::org::apache::zookeeper::data::Stat> KnownStats;
+    typedef LastKnownReads< ::std::vector< ::std::string> > KnownChildren;
+    typedef LastKnownReads< ::org::apache::zookeeper::FlatStringList> KnownFlatChildren;
+
+    /*
+     * Retry state of one request. Requests lost with the connection are sent again from the
+     * retry timer's thread, since the completion thread must not wait for the backoff.
+     */
+    class Retries {
+    public:
+        Retries(::org::apache::zookeeper::ZooKeeper& handle, ::boost::shared_ptr<RetryPolicy> policy,
+                ::boost::shared_ptr<RetryTimer> timer)
+            : _handle(handle), _policy(policy), _timer(timer), _attempts(1) {}
+
+        /**
+         * Account for the outcome of an attempt
+         *
+         * @return true if send was scheduled to send the request again
+         */
+        bool retry(::org::apache::zookeeper::ReturnCode::type rc, const ::boost::function<void ()>& send);
+
+        ::org::apache::zookeeper::ZooKeeper& handle() {
+            return _handle;
+        }
+
+    private:
+        ::org::apache::zookeeper::ZooKeeper& _handle;
+        ::boost::shared_ptr<RetryPolicy> _policy;
+        ::boost::shared_ptr<RetryTimer> _timer;
+        unsigned int _attempts; //since the last answer
+    };
+
+    Retries retries() {
+        return Retries(_handle, _retryPolicy, _retryTimer);
+    }
+
+    /*
+     * A write of path has completed; later reads must not join reads sent before it
+     */
+    void written(const ::std::string& path);
+
+    /*
+     * Callbacks of a coalesced read: each hands the one response to every callback that joined
+     * the read while it was outstanding. A response lost with the session is retried as the
+     * retry policy allows, and is otherwise answered with STALE and the last known result of the
+     * path, if one is kept.
+     */
+    class ExistsFlight : public ::org::apache::zookeeper::ExistsCallback,
+                         public ::boost::enable_shared_from_this<ExistsFlight> {
+    public:
+        ExistsFlight(const Retries& retries, ::boost::shared_ptr<Calls> calls, const Calls::Group& group,
+                ::boost::shared_ptr<KnownStats> known)
+            : _retries(retries), _calls(calls), _group(group), _known(known) {}
+
+        /**
+         * Take over a request that failed: retry it, or answer it from the last known result
+         *
+         * @return false if the caller has to report rc
+         */
+        bool recover(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::org::apache::zookeeper::data::Stat& stat);
+
+    private:
+        void send(const ::std::string& path);
+        void deliver(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::org::apache::zookeeper::data::Stat& stat);
+        void deliverStale(const ::std::string& path, const ::org::apache::zookeeper::data::Stat& stat);
+
+        Retries _retries;
+        ::boost::shared_ptr<Calls> _calls;
+        Calls::Group _group;
+        ::boost::shared_ptr<KnownStats> _known;
+    };
+
+    class ChildrenFlight : public ::org::apache::zookeeper::GetChildrenCallback,
+                           public ::boost::enable_shared_from_this<ChildrenFlight> {
+    public:
+        ChildrenFlight(const Retries& retries, ::boost::shared_ptr<Calls> calls, const Calls::Group& group,
+                ::boost::shared_ptr<KnownChildren> known)
+            : _retries(retries), _calls(calls), _group(group), _known(known) {}
+
+        bool recover(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::std::vector< ::std::string>& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, ::std::vector< ::std::string>&& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+
+    private:
+        void send(const ::std::string& path);
+        void deliver(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::std::vector< ::std::string>& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        void deliver(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, ::std::vector< ::std::string>&& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        void deliverStale(const ::std::string& path, const ::std::vector< ::std::string>& children);
+
+        Retries _retries;
+        ::boost::shared_ptr<Calls> _calls;
+        Calls::Group _group;
+        ::boost::shared_ptr<KnownChildren> _known;
+    };
+
+    class FlatFlight : public ::org::apache::zookeeper::GetChildrenFlatCallback,
+                       public ::boost::enable_shared_from_this<FlatFlight> {
+    public:
+        FlatFlight(const Retries& retries, ::boost::shared_ptr<Calls> calls, const Calls::Group& group,
+                ::boost::shared_ptr<KnownFlatChildren> known)
+            : _retries(retries), _calls(calls), _group(group), _known(known) {}
+
+        bool recover(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, ::org::apache::zookeeper::FlatStringList& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+
+    private:
+        void send(const ::std::string& path);
+        void deliver(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, ::org::apache::zookeeper::FlatStringList& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        void deliverStale(const ::std::string& path, ::org::apache::zookeeper::FlatStringList& children);
+
+        Retries _retries;
+        ::boost::shared_ptr<Calls> _calls;
+        Calls::Group _group;
+        ::boost::shared_ptr<KnownFlatChildren> _known;
+    };
+
+    /*
+     * Callback of an end point removal, retried as the retry policy allows. A retried removal
+     * that finds no node reports NoNode, which the callback takes as a success.
+     */
+    class RemoveDelegate : public ::org::apache::zookeeper::RemoveCallback,
+                           public ::boost::enable_shared_from_this<RemoveDelegate> {
+    public:
+        RemoveDelegate(ServiceDiscoveryAsyncClient& client,
+                ::boost::shared_ptr< ::org::apache::zookeeper::RemoveCallback> callback)
+            : _client(client), _retries(client.retries()), _callback(callback) {}
+
+        /**
+         * @return true if a failed removal was scheduled to be sent again
+         */
+        bool retry(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+
+    private:
+        void send(const ::std::string& path);
+
+        ServiceDiscoveryAsyncClient& _client;
+        Retries _retries;
+        ::boost::shared_ptr< ::org::apache::zookeeper::RemoveCallback> _callback;
+    };
 
     /**
      * Delegate class that handles creating each node along a specified
@@ -195,12 +455,26 @@ private:
          *@param client reference to the asynchronous client requested in the path created
          *@param path the full path to be created
          *@param callback create callback that will be called for asynchronous response
+         *@param mode with IF_ABSENT the full path is tried first, and an existing node is a success.
+         *            So it is when the full path was lost with the connection and sent again
+         *@param createMode the mode of the last node; its parents are always persistent. An
+         *            existing ephemeral node is only a success if it is of our session; any
+         *            other is replaced once
          */
         CreatePathDelegate(ServiceDiscoveryAsyncClient& client,
-                const ::std::string& path, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback)
+                const ::std::string& path, ::boost::shared_ptr<ServiceDiscoveryOpCallback> callback,
+                RegistrationMode mode = REPLACE_EXISTING,
+                ::org::apache::zookeeper::CreateMode::type createMode =
+                        ::org::apache::zookeeper::CreateMode::Persistent)
                 : _client(client),
                   _principalPath(path),
-                  _principalCallback(callback) {}
+                  _principalCallback(callback),
+                  _mode(mode),
+                  _createMode(createMode),
+                  _probing(false),
+                  _retried(false),
+                  _replaced(false),
+                  _retries(client.retries()) {}
 
         virtual ~CreatePathDelegate() {}
 
@@ -221,15 +495,52 @@ private:
         virtual void process(org::apache::zookeeper::ReturnCode::type rc,
                 const ::std::string& pathRequested, const ::std::string& pathCreated);
 
+        /**
+         * Handle the check of who owns the ephemeral node we found at the full path
+         */
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::org::apache::zookeeper::data::Stat& stat);
+
+        /**
+         * Handle the removal of an ephemeral node at the full path that is not ours
+         */
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+
     private:
         void createPath(const ::std::string& path);
+        bool retry(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+        void checkOwner();
+        void replace();
+        void fail();
 
     private:
         ServiceDiscoveryAsyncClient& _client;
         ::std::string _principalPath;
         ::boost::shared_ptr<ServiceDiscoveryOpCallback> _principalCallback;
+        RegistrationMode _mode;
+        ::org::apache::zookeeper::CreateMode::type _createMode;
+        bool _probing; //the full path was requested before its parents
+        bool _retried; //the full path was requested more than once
+        bool _replaced; //a node of someone else at the full path was removed
+        Retries _retries;
     };
     friend class CreatePathDelegate;
+
+    /*
+     * Outstanding watch-less reads, by path
+     */
+    ::boost::shared_ptr<Calls> _existsCalls;
+    ::boost::shared_ptr<Calls> _childrenCalls;
+    ::boost::shared_ptr<Calls> _flatCalls;
+
+    /*
+     * Last results of those reads, served as STALE while the session is lost
+     */
+    ::boost::shared_ptr<KnownStats> _existsKnown;
+    ::boost::shared_ptr<KnownChildren> _childrenKnown;
+    ::boost::shared_ptr<KnownFlatChildren> _flatKnown;
+
+    ::boost::shared_ptr<RetryTimer> _retryTimer;
 };
 
 } /* namespace ezdiscovery */
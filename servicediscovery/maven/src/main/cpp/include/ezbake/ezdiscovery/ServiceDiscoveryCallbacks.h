@@ -23,6 +23,7 @@
 #define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYCALLBACKS_H_
 
 #include <ezbake/ezdiscovery/ZKContrib.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryRegistry.h>
 
 namespace ezbake {
 namespace ezdiscovery {
@@ -37,12 +38,14 @@ namespace ezdiscovery {
  */
 class ServiceDiscoveryCallback : public ::org::apache::zookeeper::ExistsCallback,
                                  public ::org::apache::zookeeper::GetChildrenCallback,
+                                 public ::org::apache::zookeeper::GetChildrenFlatCallback,
                                  public ::org::apache::zookeeper::CreateCallback,
                                  public ::org::apache::zookeeper::RemoveCallback {
 public:
     enum CallbackResponse {
         OK, //ZooKeeper command was successful
-        ERROR //ZooKeeper command reported an error
+        ERROR, //ZooKeeper command reported an error
+        STALE //read lost with the session; the values are the last ones read, see setLastKnownReads
     };
 
 public:
@@ -56,6 +59,8 @@ public:
              * Send error to callback and indicate node was not found
              */
             process(ERROR, false);
+            process(ERROR, ::org::apache::zookeeper::data::Stat());
+            return;
         }
 
         /*
@@ -63,6 +68,8 @@ public:
          * Send response via status to callback
          */
         process(OK, (rc == ::org::apache::zookeeper::ReturnCode::Ok));
+        process(OK, (rc == ::org::apache::zookeeper::ReturnCode::Ok) ? stat :
+                ::org::apache::zookeeper::data::Stat());
     }
 
     //GetChildren callback
@@ -72,16 +79,56 @@ public:
         if (rc != ::org::apache::zookeeper::ReturnCode::Ok &&
             rc != ::org::apache::zookeeper::ReturnCode::NoNode) {
             process(ERROR, children);
+            return;
         }
         process(OK, children);
     }
 
+    //GetChildren callback, taking ownership of the decoded children
+    void process(::org::apache::zookeeper::ReturnCode::type rc,
+            const ::std::string& path, ::std::vector< ::std::string>&& children,
+            const ::org::apache::zookeeper::data::Stat& stat) {
+        if (rc != ::org::apache::zookeeper::ReturnCode::Ok &&
+            rc != ::org::apache::zookeeper::ReturnCode::NoNode) {
+            process(ERROR, children);
+            return;
+        }
+        process(OK, ::std::move(children));
+    }
+
+    //GetChildrenFlat callback
+    void process(::org::apache::zookeeper::ReturnCode::type rc,
+            const ::std::string& path, ::org::apache::zookeeper::FlatStringList& children,
+            const ::org::apache::zookeeper::data::Stat& stat) {
+        if (rc != ::org::apache::zookeeper::ReturnCode::Ok &&
+            rc != ::org::apache::zookeeper::ReturnCode::NoNode) {
+            process(ERROR, children);
+            return;
+        }
+        process(OK, children);
+    }
+
+    //Answers of a read lost with the session, from the last result read for its path
+    void stale(const ::org::apache::zookeeper::data::Stat& stat) {
+        process(STALE, true);
+        process(STALE, stat);
+    }
+
+    void stale(const ::std::vector< ::std::string>& children) {
+        process(STALE, children);
+    }
+
+    void stale(::org::apache::zookeeper::FlatStringList& children) {
+        process(STALE, children);
+    }
+
     //Create callback
     virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
             const ::std::string& pathRequested, const ::std::string& pathCreated) {
         if (rc != ::org::apache::zookeeper::ReturnCode::Ok &&
             rc != ::org::apache::zookeeper::ReturnCode::NodeExists) {
             process(ERROR);
+            return;
         }
         process(OK);
     }
@@ -92,6 +139,7 @@ public:
         if (rc != ::org::apache::zookeeper::ReturnCode::Ok &&
             rc != ::org::apache::zookeeper::ReturnCode::NoNode) {
             process(ERROR);
+            return;
         }
         process(OK);
     }
@@ -104,8 +152,18 @@ private:
      */
     virtual void process(CallbackResponse response) {}
     virtual void process(CallbackResponse response, bool status) {}
+    virtual void process(CallbackResponse response, const ::org::apache::zookeeper::data::Stat& stat) {}
     virtual void process(CallbackResponse response, const ::std::string& value) {}
     virtual void process(CallbackResponse response, const ::std::vector< ::std::string>& values) {}
+    virtual void process(CallbackResponse response, ::org::apache::zookeeper::FlatStringList& values) {}
+
+    /*
+     * Receives list values by rvalue. Sub-classes may override this to take ownership of the
+     * values without copying; by default it forwards to the const reference version.
+     */
+    virtual void process(CallbackResponse response, ::std::vector< ::std::string>&& values) {
+        process(response, static_cast<const ::std::vector< ::std::string>&>(values));
+    }
 };
 
 
@@ -127,6 +185,18 @@ public:
     virtual void process(CallbackResponse response, bool status) = 0;
 };
 
+/*
+ * Callback class for reporting the number of children of a node, taken from its Stat.
+ * A node that does not exist has no children.
+ */
+class ServiceDiscoveryCountCallback : public ServiceDiscoveryCallback {
+public:
+    void process(CallbackResponse response, const ::org::apache::zookeeper::data::Stat& stat) {
+        process(response, static_cast<unsigned int>(stat.getnumChildren()));
+    }
+    virtual void process(CallbackResponse response, unsigned int count) = 0;
+};
+
 /*
  * Callback class for reporting a node from a list of children
  */
@@ -146,6 +216,28 @@ public:
     virtual void process(CallbackResponse response, const ::std::vector< ::std::string>& values) = 0;
 };
 
+/*
+ * Callback class for reporting a list value as a flat string list.
+ * The callee may swap the values out to take ownership of them.
+ */
+class ServiceDiscoveryFlatListCallback : public ServiceDiscoveryCallback {
+public:
+    virtual void process(CallbackResponse response, ::org::apache::zookeeper::FlatStringList& values) = 0;
+};
+
+/*
+ * Callback class for reporting a snapshot of the whole registry.
+ * The callee may swap the registry out to take ownership of it.
+ */
+class ServiceDiscoveryRegistryCallback : public ServiceDiscoveryCallback {
+public:
+    //Registry crawl callback
+    void process(::org::apache::zookeeper::ReturnCode::type rc, RegistrySnapshot& registry) {
+        process((rc == ::org::apache::zookeeper::ReturnCode::Ok) ? OK : ERROR, registry);
+    }
+    virtual void process(CallbackResponse response, RegistrySnapshot& registry) = 0;
+};
+
 } //namespace ezdiscovery
 } //namespace ezbake
 
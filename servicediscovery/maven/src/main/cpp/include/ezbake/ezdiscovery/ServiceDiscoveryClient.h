@@ -22,17 +22,35 @@
 #ifndef EZBAKE_EZDISCOVERY_SERVICEDISCOVERYCLIENT_H_
 #define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYCLIENT_H_
 
+#include <deque>
+#include <set>
 #include <string>
 #include <vector>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <ezbake/ezdiscovery/SDACL.h>
 #include <ezbake/ezdiscovery/ServiceDiscoveryExceptions.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryRegistry.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryRetryPolicy.h>
 
 namespace ezbake { namespace ezdiscovery {
 
 class ServiceDiscoveryClient : private ::boost::noncopyable {
 public:
     static const ::std::string NAMESPACE;
+    static const unsigned int DEFAULT_CRAWL_CONCURRENCY = 256;
+
+    /**
+     * How a registration treats an end point that is already registered
+     */
+    enum RegistrationMode {
+        REPLACE_EXISTING, //remove and re-create the node; watchers see it go and come back
+        IF_ABSENT //leave an existing node untouched; no watch fires if it is already there
+    };
 
 protected:
     static const unsigned int MAX_NUM_OF_TRIES = 5;
@@ -53,21 +71,67 @@ public:
     /**
      * Constructor/Destructor
      */
-    ServiceDiscoveryClient() {}
+    ServiceDiscoveryClient();
     virtual ~ServiceDiscoveryClient() {
         close();
     }
 
     /**
-     * Terminates our connectio to zookeeper
+     * Terminates our connectio to zookeeper. Ephemeral end points go away with the session.
+     *
+     * Clients with background work of their own override this to stop it, then call it last.
      */
-    void close();
+    virtual void close();
 
     /**
      * Establishes the connection to zookeeper so we can look up services
+     *
+     * If the session expires, watchers see it expire and a new one is established in the
+     * background, so that the client keeps working: reads and watches carry on on the new
+     * session, and the ephemeral end points registered through this client are registered
+     * again on it.
      */
     void init(const ::std::string& zookeeperConnectString);
 
+    /**
+     * Same as init, but resumes the session of a client that went away, e.g. that of the
+     * process this one replaces, as given by its getSessionId() and getSessionPassword()
+     *
+     * The end points the session registered stay registered. Registering them again with
+     * IF_ABSENT takes them over without watchers seeing them go. If the session expired in
+     * the meantime a new one is established instead, on which they are gone.
+     * If sessionId is 0 this is the same as init without a session.
+     */
+    void init(const ::std::string& zookeeperConnectString, int64_t sessionId,
+            const ::std::string& sessionPassword);
+
+    /**
+     * @return the id of our session, for a replacement process to resume it
+     *
+     * @throws ServiceDiscoveryException if we have no session yet
+     */
+    int64_t getSessionId();
+
+    /**
+     * @return the password of our session, for a replacement process to resume it
+     *
+     * @throws ServiceDiscoveryException if we have no session yet
+     */
+    ::std::string getSessionPassword();
+
+    /**
+     * Set how requests that fail because we lost the connection are retried. By default a
+     * request is sent up to MAX_NUM_OF_TRIES times, backing off exponentially between
+     * attempts, within a retry budget shared by all the requests of the client.
+     *
+     * Retried creates are idempotent: a create that finds its node already there after an
+     * earlier attempt was lost is a success, as is a retried remove that finds no node.
+     * Set it before the client is shared between threads.
+     *
+     * @throws ServiceDiscoveryException if policy is null
+     */
+    void setRetryPolicy(::boost::shared_ptr<RetryPolicy> policy);
+
     /**
      * Seperates a given path into it's respective nodes
      */
@@ -92,32 +156,173 @@ public:
      * @throws ServiceDiscoveryException if path arguments are invalid
      */
     template<typename... Args>
-    static const ::std::string makeZKPath(Args... paths) {
-        ::std::string thepath = buildZKPath(paths...);
+    static const ::std::string makeZKPath(const Args&... paths) {
+        ::std::string thepath;
+        thepath.reserve(64);
+        appendZKPath(thepath, paths...);
 
-        if (thepath.find("//") == 0) {
+        if (thepath.compare(0, 2, "//") == 0) {
             //strip any extra path delimiter at start of path
-            thepath = thepath.substr(1);
+            thepath.erase(0, 1);
         }
 
         return thepath;
     }
 
+protected:
+    /**
+     * Remember an ephemeral end point, so that it is registered again on a new session
+     */
+    void trackEphemeral(const ::std::string& path);
+
+    /**
+     * Forget an ephemeral end point, e.g. once it is unregistered
+     */
+    void untrackEphemeral(const ::std::string& path);
+
+    /**
+     * @return true if stat is that of an ephemeral node of our current session
+     */
+    bool ownsEphemeral(const ::org::apache::zookeeper::data::Stat& stat);
+
+    typedef ::boost::function<void (::org::apache::zookeeper::ReturnCode::type, RegistrySnapshot&)>
+            RegistryDone;
+
+    /**
+     * Start a crawl of the whole registry, see RegistryCrawl. done is called once, from a
+     * zookeeper or retry thread, with Ok and the registry or with the error that ended it.
+     *
+     * @param timer runs the retries of reads lost with the connection
+     *
+     * @return Ok, or the error the first read could not be sent with, in which case done is
+     *         not called
+     */
+    ::org::apache::zookeeper::ReturnCode::type crawlRegistry(unsigned int maxConcurrency,
+            ::boost::shared_ptr<RetryTimer> timer, const RegistryDone& done);
+
 private:
+    /*
+     * Default watch of our handle; it only sees session events
+     */
+    class SessionWatch : public ::org::apache::zookeeper::Watch {
+    public:
+        explicit SessionWatch(ServiceDiscoveryClient& client) : _client(client) {}
+
+        virtual void process(::org::apache::zookeeper::WatchEvent::type event,
+                ::org::apache::zookeeper::SessionState::type state, const ::std::string& path);
+
+    private:
+        ServiceDiscoveryClient& _client;
+    };
+
+    /*
+     * Callback of an ephemeral end point registered again; a failure is retried as the retry
+     * policy allows, and otherwise on the next connection
+     */
+    class EphemeralCallback : public ::org::apache::zookeeper::CreateCallback {
+    public:
+        EphemeralCallback(ServiceDiscoveryClient& client, unsigned int attempts)
+            : _client(client), _attempts(attempts) {}
+
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& pathRequested, const ::std::string& pathCreated);
+
+    private:
+        ServiceDiscoveryClient& _client;
+        unsigned int _attempts;
+    };
+
+    /*
+     * Breadth-first crawl of the registry that keeps up to maxConcurrency getChildren requests
+     * in flight on our session. Each response queues the reads of the level below it, so with
+     * enough concurrency for the widest level the crawl takes about one round trip per level
+     * (applications, services, end points) rather than one per node.
+     *
+     * Nodes removed while the crawl runs are left out. Reads lost with the connection are
+     * retried as the retry policy allows; any other error ends the crawl.
+     */
+    class RegistryCrawl : public ::org::apache::zookeeper::GetChildrenCallback,
+                          public ::boost::enable_shared_from_this<RegistryCrawl> {
+    public:
+        RegistryCrawl(::org::apache::zookeeper::ZooKeeper& handle, ::boost::shared_ptr<RetryPolicy> policy,
+                ::boost::shared_ptr<RetryTimer> timer, unsigned int maxConcurrency, const RegistryDone& done);
+        virtual ~RegistryCrawl() {}
+
+        ::org::apache::zookeeper::ReturnCode::type start();
+
+        //GetChildren callback
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::std::vector< ::std::string>& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, ::std::vector< ::std::string>&& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+
+    private:
+        /*
+         * A node to list: the root, an application or the end points of a service
+         */
+        struct Read {
+            Read() : attempts(1) {}
+            ::std::string path;
+            ::std::string app; //empty for the root
+            ::std::string service; //empty for the root and applications
+            unsigned int attempts;
+        };
+
+        void resend(const Read& read);
+        void dispatch();
+        void add(const Read& read, ::std::vector< ::std::string>& children);
+        bool retry(const Read& read, ::org::apache::zookeeper::ReturnCode::type rc);
+        bool finished();
+        void complete();
+
+    private:
+        ::org::apache::zookeeper::ZooKeeper& _handle;
+        ::boost::shared_ptr<RetryPolicy> _policy;
+        ::boost::shared_ptr<RetryTimer> _timer;
+        unsigned int _maxConcurrency;
+        RegistryDone _done;
+        ::std::deque<Read> _queue; //ready to be read
+        ::boost::unordered_map< ::std::string, Read> _inFlight; //by path
+        unsigned int _retrying; //waiting on the timer to be sent again
+        ::org::apache::zookeeper::ReturnCode::type _rc;
+        bool _finished; //done was called, or is about to be
+        RegistrySnapshot _registry;
+        ::boost::mutex _mutex;
+    };
+
     void initializeNamespace(const ::std::string& connectString);
+    ::std::string namespacedConnectString(const ::std::string& connectString);
+    void sessionStateChanged(::org::apache::zookeeper::SessionState::type state);
+    void reregisterEphemerals();
+    void reregisterEphemeral(const ::std::string& path, unsigned int attempts);
+    void resendEphemeral(const ::std::string& path, unsigned int attempts);
+    void retryEphemeral(const ::std::string& path, unsigned int attempts,
+            ::org::apache::zookeeper::ReturnCode::type rc);
 
-    static const ::std::string buildZKPath() { return ""; }
+    static void appendZKPath(::std::string&) {}
 
     template<typename... Args>
-    static const ::std::string buildZKPath(const ::std::string& path, Args... paths) {
+    static void appendZKPath(::std::string& thepath, const ::std::string& path,
+                             const Args&... paths) {
         if (path.find(PATH_DELIM, 1) != ::std::string::npos) {
             THROW_EXCEPTION(ServiceDiscoveryException, "ZK path should not contain \"" + PATH_DELIM + "\": " + path);
         }
-        return PATH_DELIM + path + buildZKPath(paths...);
+        thepath += PATH_DELIM;
+        thepath += path;
+        appendZKPath(thepath, paths...);
     }
 
 protected:
     org::apache::zookeeper::ZooKeeper _handle;
+    ::boost::shared_ptr<RetryPolicy> _retryPolicy;
+
+private:
+    ::boost::mutex _ephemeralMutex;
+    ::std::set< ::std::string> _ephemerals;
+    bool _reregister; //the ephemerals are not registered on the current session
+    RetryTimer _ephemeralTimer; //last, so that it is stopped before the rest goes
 };
 
 }} // namespace ::ezbake::ezdiscovery
@@ -0,0 +1,166 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryLastKnown.h
+ */
+
+#ifndef EZBAKE_EZDISCOVERY_SERVICEDISCOVERYLASTKNOWN_H_
+#define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYLASTKNOWN_H_
+
+#include <ezbake/ezdiscovery/ZKContrib.h>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/unordered_map.hpp>
+#include <list>
+#include <string>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+/*
+ * Errors that mean we are not talking to the ensemble right now, rather than anything about
+ * the path that was read. InvalidState is not one: a handle that is closed, or whose session
+ * expired for good, does not come back however often a request is retried.
+ */
+inline bool isSessionLoss(::org::apache::zookeeper::ReturnCode::type rc) {
+    return rc == ::org::apache::zookeeper::ReturnCode::ConnectionLoss ||
+           rc == ::org::apache::zookeeper::ReturnCode::OperationTimeout ||
+           rc == ::org::apache::zookeeper::ReturnCode::SessionExpired;
+}
+
+
+/**
+ * Last result read for each path, for clients that would rather keep finding the end points
+ * they found before than fail while the session is lost (e.g. while an expired session is
+ * being replaced)
+ *
+ * Nothing is kept until configure() is called. Then the results of up to maxPaths paths are
+ * kept, each for up to maxAgeMs after it was read; the path read longest ago goes first.
+ * Results are shared, so recalling one copies it outside the lock.
+ */
+template<typename Result>
+class LastKnownReads : private ::boost::noncopyable {
+public:
+    LastKnownReads() : _maxPaths(0), _maxAgeMs(0) {}
+
+    /**
+     * @param maxPaths the number of paths to keep results for, 0 to keep none
+     * @param maxAgeMs how long a result is kept after it was read, 0 for as long as it is
+     *                 not pushed out by others
+     */
+    void configure(unsigned int maxPaths, unsigned int maxAgeMs) {
+        ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+        _maxPaths = maxPaths;
+        _maxAgeMs = maxAgeMs;
+        trim();
+    }
+
+    /**
+     * Record the outcome of a read of path; only Ok and NoNode tell us anything
+     */
+    void record(const ::std::string& path, ::org::apache::zookeeper::ReturnCode::type rc,
+            const Result& result) {
+        if (rc != ::org::apache::zookeeper::ReturnCode::Ok &&
+                rc != ::org::apache::zookeeper::ReturnCode::NoNode) {
+            return;
+        }
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        if (!_maxPaths) {
+            return;
+        }
+        typename Results::iterator it = _results.find(path);
+        if (rc == ::org::apache::zookeeper::ReturnCode::NoNode) {
+            if (it != _results.end()) {
+                _order.erase(it->second.order);
+                _results.erase(it);
+            }
+            return;
+        }
+
+        //copy it unlocked
+        lock.unlock();
+        ::boost::shared_ptr<const Result> known = ::boost::make_shared<Result>(result);
+        ::boost::system_time now = ::boost::get_system_time();
+        lock.lock();
+
+        it = _results.find(path);
+        if (it == _results.end()) {
+            _order.push_front(path);
+            it = _results.insert(::std::make_pair(path, Known())).first;
+        } else {
+            _order.splice(_order.begin(), _order, it->second.order);
+        }
+        it->second.result.swap(known);
+        it->second.read = now;
+        it->second.order = _order.begin();
+        trim();
+    }
+
+    /**
+     * @return true if there is a result for path that is not too old, and result was set to it
+     */
+    bool recall(const ::std::string& path, Result& result) {
+        ::boost::shared_ptr<const Result> known;
+        {
+            ::boost::lock_guard< ::boost::mutex> lock(_mutex);
+            typename Results::iterator it = _results.find(path);
+            if (it == _results.end()) {
+                return false;
+            }
+            if (expired(it->second)) {
+                _order.erase(it->second.order);
+                _results.erase(it);
+                return false;
+            }
+            known = it->second.result;
+        }
+        result = *known;
+        return true;
+    }
+
+private:
+    struct Known {
+        ::boost::shared_ptr<const Result> result;
+        ::boost::system_time read;
+        ::std::list< ::std::string>::iterator order;
+    };
+    typedef ::boost::unordered_map< ::std::string, Known> Results;
+
+    bool expired(const Known& known) const {
+        return _maxAgeMs &&
+                known.read + ::boost::posix_time::milliseconds(_maxAgeMs) < ::boost::get_system_time();
+    }
+
+    void trim() {
+        while (_results.size() > _maxPaths) {
+            _results.erase(_order.back());
+            _order.pop_back();
+        }
+    }
+
+    ::boost::mutex _mutex;
+    unsigned int _maxPaths;
+    unsigned int _maxAgeMs;
+    Results _results;
+    ::std::list< ::std::string> _order; //most recently read first
+};
+
+}} // namespace ::ezbake::ezdiscovery
+
+#endif /* EZBAKE_EZDISCOVERY_SERVICEDISCOVERYLASTKNOWN_H_ */
@@ -0,0 +1,42 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryRegistry.h
+ */
+
+#ifndef EZBAKE_EZDISCOVERY_SERVICEDISCOVERYREGISTRY_H_
+#define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYREGISTRY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+/*
+ * The host:port end points of each service of an application, by service name
+ */
+typedef ::std::map< ::std::string, ::std::vector< ::std::string> > ServiceEndpoints;
+
+/*
+ * Everything registered with service discovery: the services of each application, by
+ * application name. Common services are listed under "common_services".
+ */
+typedef ::std::map< ::std::string, ServiceEndpoints> RegistrySnapshot;
+
+}} // namespace ::ezbake::ezdiscovery
+
+#endif /* EZBAKE_EZDISCOVERY_SERVICEDISCOVERYREGISTRY_H_ */
@@ -0,0 +1,181 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryRetryPolicy.h
+ */
+
+#ifndef EZBAKE_EZDISCOVERY_SERVICEDISCOVERYRETRYPOLICY_H_
+#define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYRETRYPOLICY_H_
+
+#include <ezbake/ezdiscovery/ZKContrib.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryLastKnown.h>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <map>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+/**
+ * Decides whether, and when, a request that failed because we lost the ensemble is sent again
+ *
+ * Only failures for which isSessionLoss() holds are offered to the policy; any other outcome
+ * is an answer from the ensemble and is reported to the policy with onAnswer(). A policy is
+ * shared by every request of a client, so implementations must be thread safe.
+ */
+class RetryPolicy : private ::boost::noncopyable {
+public:
+    virtual ~RetryPolicy() {}
+
+    /**
+     * @param attempts the number of times the request has been sent so far
+     * @param rc the error the last attempt failed with
+     * @param delayMs set to how long to wait before sending the request again
+     *
+     * @return true to send the request again
+     */
+    virtual bool shouldRetry(unsigned int attempts, ::org::apache::zookeeper::ReturnCode::type rc,
+            unsigned int& delayMs) = 0;
+
+    /**
+     * A request got an answer from the ensemble
+     */
+    virtual void onAnswer() {}
+
+    /**
+     * Account for the outcome of an attempt
+     *
+     * @return true if the request is to be sent again after delayMs
+     */
+    bool retryAfter(unsigned int attempts, ::org::apache::zookeeper::ReturnCode::type rc,
+            unsigned int& delayMs) {
+        if (!isSessionLoss(rc)) {
+            onAnswer();
+            return false;
+        }
+        return shouldRetry(attempts, rc, delayMs);
+    }
+
+    /**
+     * Account for the outcome of a synchronous attempt, and sleep until the next one is due
+     *
+     * @return true if the request is to be sent again
+     */
+    bool awaitRetry(unsigned int attempts, ::org::apache::zookeeper::ReturnCode::type rc) {
+        unsigned int delayMs = 0;
+        if (!retryAfter(attempts, rc, delayMs)) {
+            return false;
+        }
+        ::boost::this_thread::sleep(::boost::posix_time::milliseconds(delayMs));
+        return true;
+    }
+};
+
+
+/**
+ * Never retries
+ */
+class NoRetry : public RetryPolicy {
+public:
+    virtual bool shouldRetry(unsigned int, ::org::apache::zookeeper::ReturnCode::type, unsigned int&) {
+        return false;
+    }
+};
+
+
+/**
+ * Exponential backoff with full jitter and a retry budget
+ *
+ * The n-th retry of a request waits a random time of up to min(maxDelayMs, baseDelayMs * 2^n).
+ * Retries draw on a budget shared by every request of the client: each retry spends one token,
+ * and every answer from the ensemble earns a tenth of one back, up to maxTokens. While an
+ * ensemble is down, retries are bounded by the budget rather than multiplied by the number of
+ * outstanding requests.
+ */
+class ExponentialBackoffRetry : public RetryPolicy {
+public:
+    static const unsigned int DEFAULT_BASE_DELAY = 50; //ms
+    static const unsigned int DEFAULT_MAX_DELAY = 2000; //ms
+    static const unsigned int DEFAULT_MAX_TOKENS = 10;
+
+    /**
+     * Constructor
+     *
+     *@param maxTries the maximum number of times a request is sent, the first time included
+     *@param baseDelayMs the maximum delay before the first retry
+     *@param maxDelayMs the cap on the delay before any retry
+     *@param maxTokens the size of the retry budget
+     */
+    ExponentialBackoffRetry(unsigned int maxTries, unsigned int baseDelayMs = DEFAULT_BASE_DELAY,
+            unsigned int maxDelayMs = DEFAULT_MAX_DELAY, unsigned int maxTokens = DEFAULT_MAX_TOKENS);
+    virtual ~ExponentialBackoffRetry() {}
+
+    virtual bool shouldRetry(unsigned int attempts, ::org::apache::zookeeper::ReturnCode::type rc,
+            unsigned int& delayMs);
+    virtual void onAnswer();
+
+private:
+    static const int TOKEN = 10; //tokens are kept in tenths
+
+    unsigned int _maxTries;
+    unsigned int _baseDelayMs;
+    unsigned int _maxDelayMs;
+    int _maxTokens;
+    ::boost::atomic<int> _tokens;
+    ::boost::mutex _randomMutex;
+    ::boost::random::mt19937 _random;
+};
+
+
+/**
+ * Runs functions after a delay on a thread of its own, e.g. asynchronous retries, which must
+ * not sleep on the zookeeper completion thread
+ */
+class RetryTimer : private ::boost::noncopyable {
+public:
+    RetryTimer() : _stopped(false) {}
+    ~RetryTimer() {
+        stop();
+    }
+
+    /**
+     * @return false if the timer has been stopped, in which case fn will not run
+     */
+    bool schedule(unsigned int delayMs, const ::boost::function<void ()>& fn);
+
+    /**
+     * Drop everything still scheduled and wait for the thread to exit
+     */
+    void stop();
+
+private:
+    void run();
+
+    bool _stopped;
+    ::std::multimap< ::boost::system_time, ::boost::function<void ()> > _timers;
+    ::boost::mutex _mutex;
+    ::boost::condition_variable _cond;
+    ::boost::thread _thread;
+};
+
+}} // namespace ::ezbake::ezdiscovery
+
+#endif /* EZBAKE_EZDISCOVERY_SERVICEDISCOVERYRETRYPOLICY_H_ */
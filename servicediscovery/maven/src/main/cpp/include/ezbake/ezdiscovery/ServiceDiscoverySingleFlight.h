@@ -0,0 +1,265 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoverySingleFlight.h
+ */
+
+#ifndef EZBAKE_EZDISCOVERY_SERVICEDISCOVERYSINGLEFLIGHT_H_
+#define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYSINGLEFLIGHT_H_
+
+#include <ezbake/ezdiscovery/ZKContrib.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryLastKnown.h>
+#include <ezbake/ezdiscovery/ServiceDiscoveryRetryPolicy.h>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+/*
+ * Synchronous reads of one path, in the shape SingleFlightReads expects
+ */
+inline ::org::apache::zookeeper::ReturnCode::type readPath(::org::apache::zookeeper::ZooKeeper& handle,
+        const ::std::string& path, ::org::apache::zookeeper::data::Stat& stat) {
+    return handle.exists(path, ::boost::shared_ptr< ::org::apache::zookeeper::Watch>(), stat);
+}
+
+inline ::org::apache::zookeeper::ReturnCode::type readPath(::org::apache::zookeeper::ZooKeeper& handle,
+        const ::std::string& path, ::std::vector< ::std::string>& children) {
+    ::org::apache::zookeeper::data::Stat stat;
+    return handle.getChildren(path, ::boost::shared_ptr< ::org::apache::zookeeper::Watch>(),
+            children, stat);
+}
+
+inline ::org::apache::zookeeper::ReturnCode::type readPath(::org::apache::zookeeper::ZooKeeper& handle,
+        const ::std::string& path, ::org::apache::zookeeper::FlatStringList& children) {
+    ::org::apache::zookeeper::data::Stat stat;
+    return handle.getChildren(path, ::boost::shared_ptr< ::org::apache::zookeeper::Watch>(),
+            children, stat);
+}
+
+
+/*
+ * The paths whose reads a write of path may change: the node itself, and its parent, whose
+ * children it is one of
+ */
+inline void writtenPaths(const ::std::string& path, ::std::vector< ::std::string>& paths) {
+    paths.push_back(path);
+    ::std::string::size_type slash = path.rfind('/');
+    if (slash != ::std::string::npos) {
+        paths.push_back(path.substr(0, slash));
+        if (slash == 0) {
+            //the namespace root is read as either "" or "/"
+            paths.push_back("/");
+        }
+    }
+}
+
+
+/**
+ * Coalesces identical synchronous reads
+ *
+ * The first thread to read a path sends the request; threads that read the same path while it
+ * is outstanding wait for it and get a copy of its result instead of sending their own.
+ * A request lost with the connection is retried as the retry policy allows. If that does not
+ * get it through, readers that accept stale results are answered with the last result read
+ * for the path, when last known reads are kept (see keepLastKnown()).
+ *
+ * A read is only joined until a local write of the path completes (see written()), so a thread
+ * that reads after its own write never gets the result of a read sent before the write.
+ */
+template<typename Result>
+class SingleFlightReads : private ::boost::noncopyable {
+public:
+    /**
+     * @param handle anything readPath() is overloaded for, normally a ZooKeeper handle
+     * @param stale if not NULL, a read lost with the session may be answered with the last known
+     *              result, in which case Ok is returned and stale is set to true
+     */
+    template<typename Handle>
+    ::org::apache::zookeeper::ReturnCode::type read(Handle& handle, RetryPolicy& policy,
+            const ::std::string& path, Result& result, bool* stale = NULL) {
+        if (stale) {
+            *stale = false;
+        }
+        ::boost::shared_ptr<Call> call;
+        {
+            ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+            typename Calls::iterator it = _calls.find(path);
+            if (it != _calls.end()) {
+                //attach to the outstanding read
+                call = it->second;
+                ++call->waiters;
+                while (!call->done) {
+                    _cond.wait(lock);
+                }
+                result = call->result;
+                return answer(call->rc, call->known, stale);
+            }
+            call = ::boost::make_shared<Call>();
+            _calls.insert(::std::make_pair(path, call));
+        }
+
+        //the waiters retry along with us
+        ::org::apache::zookeeper::ReturnCode::type rc;
+        unsigned int attempts = 0;
+        do {
+            rc = readPath(handle, path, result);
+        } while (policy.awaitRetry(++attempts, rc));
+        bool known = false;
+        if (isSessionLoss(rc)) {
+            known = _lastKnown.recall(path, result);
+        } else {
+            _lastKnown.record(path, rc, result);
+        }
+
+        {
+            ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+            typename Calls::iterator it = _calls.find(path);
+            if (it != _calls.end() && it->second == call) {
+                _calls.erase(it);
+            }
+            call->rc = rc;
+            call->known = known;
+            call->done = true;
+            if (call->waiters) {
+                call->result = result;
+            }
+        }
+        _cond.notify_all();
+        return answer(rc, known, stale);
+    }
+
+    /**
+     * Keep the last known results of up to maxPaths paths, see LastKnownReads::configure()
+     */
+    void keepLastKnown(unsigned int maxPaths, unsigned int maxAgeMs) {
+        _lastKnown.configure(maxPaths, maxAgeMs);
+    }
+
+    /**
+     * A write of path has completed: reads of the paths it may change that are outstanding now
+     * were possibly sent before it, so later reads do not join them
+     */
+    void written(const ::std::string& path) {
+        ::std::vector< ::std::string> paths;
+        writtenPaths(path, paths);
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        for (::std::vector< ::std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it) {
+            _calls.erase(*it);
+        }
+    }
+
+private:
+    struct Call {
+        Call() : rc(::org::apache::zookeeper::ReturnCode::Ok), known(false), done(false), waiters(0) {}
+
+        ::org::apache::zookeeper::ReturnCode::type rc;
+        bool known; //the read was lost, and the result is the last known one
+        bool done;
+        unsigned int waiters;
+        Result result;
+    };
+    typedef ::boost::unordered_map< ::std::string, ::boost::shared_ptr<Call> > Calls;
+
+    static ::org::apache::zookeeper::ReturnCode::type answer(::org::apache::zookeeper::ReturnCode::type rc,
+            bool known, bool* stale) {
+        if (known && stale) {
+            *stale = true;
+            return ::org::apache::zookeeper::ReturnCode::Ok;
+        }
+        return rc;
+    }
+
+    ::boost::mutex _mutex;
+    ::boost::condition_variable _cond;
+    Calls _calls;
+    LastKnownReads<Result> _lastKnown;
+};
+
+
+/**
+ * Coalesces identical asynchronous reads
+ *
+ * join() records a callback against a path and tells the caller whether it has to send the
+ * request; the request's own callback then collects every callback joined in the meantime with
+ * complete() and hands each of them the one result. As with SingleFlightReads, a read stops
+ * taking callbacks once a local write of the path completes.
+ */
+template<typename Callback>
+class SingleFlightCallbacks : private ::boost::noncopyable {
+public:
+    typedef ::std::vector< ::boost::shared_ptr<Callback> > Waiters;
+    typedef ::boost::shared_ptr<Waiters> Group;
+
+    /**
+     * @return the callbacks of a new read if no read of path can be joined, i.e. the caller has
+     *         to send it and pass them to complete(); NULL if callback joined an outstanding read
+     */
+    Group join(const ::std::string& path, ::boost::shared_ptr<Callback> callback) {
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        ::std::pair<typename Calls::iterator, bool> inserted =
+                _calls.insert(::std::make_pair(path, Group()));
+        if (!inserted.second) {
+            inserted.first->second->push_back(callback);
+            return Group();
+        }
+        inserted.first->second = ::boost::make_shared<Waiters>(1, callback);
+        return inserted.first->second;
+    }
+
+    /**
+     * End the read of path, e.g. because it could not be sent or has completed
+     *
+     * @param group the callbacks join() returned for the read
+     * @param waiters receives every callback that joined the read
+     */
+    void complete(const ::std::string& path, const Group& group, Waiters& waiters) {
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        typename Calls::iterator it = _calls.find(path);
+        if (it != _calls.end() && it->second == group) {
+            _calls.erase(it);
+        }
+        waiters.swap(*group);
+    }
+
+    /**
+     * A write of path has completed: later reads of the paths it may change start a new read
+     */
+    void written(const ::std::string& path) {
+        ::std::vector< ::std::string> paths;
+        writtenPaths(path, paths);
+        ::boost::unique_lock< ::boost::mutex> lock(_mutex);
+        for (::std::vector< ::std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it) {
+            _calls.erase(*it);
+        }
+    }
+
+private:
+    typedef ::boost::unordered_map< ::std::string, Group> Calls;
+
+    ::boost::mutex _mutex;
+    Calls _calls;
+};
+
+}} // namespace ::ezbake::ezdiscovery
+
+#endif /* EZBAKE_EZDISCOVERY_SERVICEDISCOVERYSINGLEFLIGHT_H_ */
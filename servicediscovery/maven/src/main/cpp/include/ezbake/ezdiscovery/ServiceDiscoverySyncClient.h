@@ -23,6 +23,7 @@
 #define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYSYNCCLIENT_H_
 
 #include <ezbake/ezdiscovery/ServiceDiscoveryClient.h>
+#include <ezbake/ezdiscovery/ServiceDiscoverySingleFlight.h>
 
 namespace ezbake { namespace ezdiscovery {
 
@@ -43,11 +44,35 @@ public:
      *@param appName the name of the application that we are registering the service for
      *@param serviceName the name of the service that we are registering
      *@param point the host:port number of a service end point
+     *@param mode IF_ABSENT to leave an end point that is already registered untouched, e.g. when
+     *            re-registering periodically
      *
      *@throws ServiceDiscoveryException for any zookeeper errors
      */
-    void registerEndpoint(const ::std::string& serviceName, const ::std::string& point);
-    void registerEndpoint(const ::std::string& appName, const ::std::string& serviceName, const ::std::string& point);
+    void registerEndpoint(const ::std::string& serviceName, const ::std::string& point,
+            RegistrationMode mode = REPLACE_EXISTING);
+    void registerEndpoint(const ::std::string& appName, const ::std::string& serviceName, const ::std::string& point,
+            RegistrationMode mode = REPLACE_EXISTING);
+
+    /**
+     * Register a service end point that lives as long as this client's session
+     *
+     * The end point goes away when the client is closed or stops talking to zookeeper, so no
+     * heartbeat or purge is needed to clean it up. If the session expires the end point is
+     * registered again on the new session, until it is unregistered.
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *@param point the host:port number of a service end point
+     *@param mode IF_ABSENT to leave an end point that is already registered by this session
+     *            untouched. One registered persistently or by another session is replaced
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    void registerEphemeralEndpoint(const ::std::string& serviceName, const ::std::string& point,
+            RegistrationMode mode = REPLACE_EXISTING);
+    void registerEphemeralEndpoint(const ::std::string& appName, const ::std::string& serviceName,
+            const ::std::string& point, RegistrationMode mode = REPLACE_EXISTING);
 
     /**
      * Unregister a service end point for service discovery
@@ -95,6 +120,86 @@ public:
     ::std::vector< ::std::string> getEndpoints(const ::std::string& serviceName);
     ::std::vector< ::std::string> getEndpoints(const ::std::string& appName, const ::std::string& serviceName);
 
+    /**
+     * Same as getEndpoints, but if the read is lost with the session it is answered with the
+     * end points last read for the service, when last known reads are kept
+     *
+     *@param stale set to true if the end points are the last known ones, which may have
+     *             changed since
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors, or if the read is lost and
+     *        there are no last known end points
+     */
+    ::std::vector< ::std::string> getEndpoints(const ::std::string& appName, const ::std::string& serviceName,
+            bool& stale);
+
+    /**
+     * Keep the children last read of up to maxPaths paths, each for up to maxAgeMs (0 for no
+     * limit), for the getEndpoints that accepts stale results. Nothing is kept by default.
+     */
+    void setLastKnownReads(unsigned int maxPaths, unsigned int maxAgeMs);
+
+    /**
+     * Get the end points for a service in an application as a flat string list
+     *
+     * Prefer this over the vector version for services with many end points; the
+     * list is decoded from the ZooKeeper response with a constant number of allocations.
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *@param endpoints receives the host:port strings for the service end points
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    void getEndpoints(const ::std::string& serviceName, ::org::apache::zookeeper::FlatStringList& endpoints);
+    void getEndpoints(const ::std::string& appName, const ::std::string& serviceName,
+            ::org::apache::zookeeper::FlatStringList& endpoints);
+
+    /**
+     * Get the end points for a service only if they changed since an earlier call
+     *
+     * Costs a single exists request when nothing changed, which makes polling a service with
+     * many end points cheap.
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *@param endpoints receives the host:port strings for the service end points, if they changed
+     *@param version the children version (cversion) seen by the earlier call, -1 for none.
+     *               Updated to the version of the end points returned.
+     *
+     *@return true if the end points changed and endpoints was updated
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    bool getEndpointsIfChanged(const ::std::string& appName, const ::std::string& serviceName,
+            ::std::vector< ::std::string>& endpoints, int32_t& version);
+
+    /**
+     * Get the number of end points for a service in an application without listing them
+     *
+     *@param appName the name of the application that we are registering the service for
+     *@param serviceName the name of the service that we are registering
+     *
+     *@return the number of end points
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    unsigned int getEndpointCount(const ::std::string& serviceName);
+    unsigned int getEndpointCount(const ::std::string& appName, const ::std::string& serviceName);
+
+    /**
+     * Get every application with its services and their end points, e.g. to build a routing
+     * table, with a breadth-first crawl that keeps up to maxConcurrency reads in flight on our
+     * session. It takes about one round trip per level of the tree, rather than one per node.
+     *
+     *@param maxConcurrency the maximum number of getChildren requests kept in flight
+     *
+     *@return the services of each application, with their end points
+     *
+     *@throws ServiceDiscoveryException for any zookeeper errors
+     */
+    RegistrySnapshot getRegistrySnapshot(unsigned int maxConcurrency = DEFAULT_CRAWL_CONCURRENCY);
+
     /**
      * Sets the security Id for an application
      *
@@ -150,8 +255,40 @@ public:
 
 protected:
     virtual bool checkPathExists(const ::std::string& path);
-    virtual void createPath(const ::std::string& path);
+    virtual bool checkPathExists(const ::std::string& path, ::org::apache::zookeeper::data::Stat& stat);
+    virtual void createPath(const ::std::string& path, RegistrationMode mode = REPLACE_EXISTING,
+            ::org::apache::zookeeper::CreateMode::type createMode =
+                    ::org::apache::zookeeper::CreateMode::Persistent);
     virtual ::std::vector< ::std::string> getChildren(const ::std::string& path);
+    virtual void getChildren(const ::std::string& path, ::org::apache::zookeeper::FlatStringList& children);
+
+private:
+    /*
+     * Whether an existing node at path is what creating it with createMode would have made
+     */
+    bool isOurs(const ::std::string& path, ::org::apache::zookeeper::CreateMode::type createMode);
+
+    /*
+     * Create or remove one node, retrying as the retry policy allows
+     *
+     * @param retried set to true if the request was sent more than once, in which case an
+     *                earlier attempt may have made the change already
+     */
+    ::org::apache::zookeeper::ReturnCode::type createNode(const ::std::string& path,
+            ::org::apache::zookeeper::CreateMode::type createMode, bool& retried);
+    ::org::apache::zookeeper::ReturnCode::type removeNode(const ::std::string& path);
+
+    /*
+     * A write of path has completed; later reads must not join reads sent before it
+     */
+    void written(const ::std::string& path);
+
+    /*
+     * Identical reads made concurrently by several threads share one request
+     */
+    SingleFlightReads< ::org::apache::zookeeper::data::Stat> _existsReads;
+    SingleFlightReads< ::std::vector< ::std::string> > _childrenReads;
+    SingleFlightReads< ::org::apache::zookeeper::FlatStringList> _flatReads;
 };
 
 }} //namspace ::ezbake::ezdiscovery
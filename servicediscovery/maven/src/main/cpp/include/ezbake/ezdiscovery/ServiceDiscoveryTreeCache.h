@@ -0,0 +1,342 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryTreeCache.h
+ */
+
+#ifndef EZBAKE_EZDISCOVERY_SERVICEDISCOVERYTREECACHE_H_
+#define EZBAKE_EZDISCOVERY_SERVICEDISCOVERYTREECACHE_H_
+
+#include <ezbake/ezdiscovery/ServiceDiscoveryAsyncClient.h>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <deque>
+#include <map>
+#include <utility>
+
+
+namespace ezbake { namespace ezdiscovery {
+
+/**
+ * In-memory cache of the whole service discovery namespace
+ *
+ * The cache mirrors every application, service, endpoint and security id under the namespace.
+ * start() bootstraps it with a breadth-first crawl that keeps up to maxConcurrency getChildren
+ * requests in flight, and a child watch is left on every node it reads so that the cache
+ * re-reads a node whenever its children change.
+ *
+ * Re-reads are debounced: after a watch fires the node is read again only once refreshIntervalMs
+ * plus a random jitter of up to refreshJitterMs has passed, and a node never has more than one
+ * read in flight. Changes arriving in the meantime are folded into that one read, so a burst of
+ * events costs each client a bounded number of reads, spread out across the clients.
+ *
+ * Every node remembers the children version (cversion) it was read at. validate() checks the whole
+ * cache against the ensemble with one exists request per node, and only lists the children of
+ * nodes whose version moved, e.g. because a change was missed while a watch was not set.
+ *
+ * Readers take a Snapshot: an immutable view of the tree as of the last applied update. Taking a
+ * snapshot is O(1), and snapshots share every unchanged subtree with each other.
+ *
+ * The cache can be saved to a snapshot file on local disk, periodically with persistSnapshot(),
+ * and loaded from it at start up with loadSnapshot(), so that a restarted client can answer
+ * lookups straight away rather than once the crawl completes. The file is versioned by the
+ * highest zxid the cached tree reflects, and laid out so that it can be mapped and read in place.
+ */
+class ServiceDiscoveryTreeCache : public ServiceDiscoveryAsyncClient {
+private:
+    class Node;
+    class Crawler;
+
+public:
+    static const unsigned int DEFAULT_MAX_CONCURRENCY = 64;
+    static const unsigned int DEFAULT_REFRESH_INTERVAL = 250; //ms
+    static const unsigned int DEFAULT_REFRESH_JITTER = 250; //ms
+    static const unsigned int DEFAULT_PERSIST_INTERVAL = 30000; //ms
+
+    /**
+     * Read-only view of the cached namespace. Lookups mirror the ServiceDiscoverySyncClient API,
+     * but are answered from memory; a node missing from the cache reads as empty.
+     */
+    class Snapshot {
+    public:
+        ::std::vector< ::std::string> getApplications() const;
+        ::std::vector< ::std::string> getServices() const;
+        ::std::vector< ::std::string> getServices(const ::std::string& appName) const;
+        ::std::vector< ::std::string> getEndpoints(const ::std::string& serviceName) const;
+        ::std::vector< ::std::string> getEndpoints(const ::std::string& appName,
+                const ::std::string& serviceName) const;
+        size_t getEndpointCount(const ::std::string& serviceName) const;
+        size_t getEndpointCount(const ::std::string& appName, const ::std::string& serviceName) const;
+        ::std::string getSecurityIdForApplication(const ::std::string& applicationName) const;
+        ::std::string getSecurityIdForCommonService(const ::std::string& serviceName) const;
+        bool isServiceCommon(const ::std::string& serviceName) const;
+
+        /**
+         * Get the children of any cached path, relative to the namespace
+         */
+        ::std::vector< ::std::string> getChildren(const ::std::string& path) const;
+
+        /**
+         * Total number of nodes cached below the namespace
+         */
+        size_t size() const;
+
+        /**
+         * The highest zxid of the changes reflected in this view, i.e. of the latest child created
+         * or deleted anywhere in the cached tree
+         */
+        int64_t getZxid() const;
+
+        /**
+         * Whether this view was loaded from a snapshot file, and the crawl has yet to confirm it
+         */
+        bool isStale() const {
+            return _stale;
+        }
+
+    private:
+        friend class Crawler;
+        explicit Snapshot(::boost::shared_ptr<const Node> root, bool stale = false)
+            : _root(root), _stale(stale) {}
+
+        const Node* find(const ::std::string& path) const;
+
+        ::boost::shared_ptr<const Node> _root;
+        bool _stale;
+    };
+
+public:
+    /**
+     * Constructor/Destructor
+     *
+     *@param maxConcurrency the maximum number of getChildren requests kept in flight
+     *@param refreshIntervalMs the minimum delay before re-reading a node after a watch fires
+     *@param refreshJitterMs the maximum random delay added to refreshIntervalMs
+     */
+    explicit ServiceDiscoveryTreeCache(unsigned int maxConcurrency = DEFAULT_MAX_CONCURRENCY,
+            unsigned int refreshIntervalMs = DEFAULT_REFRESH_INTERVAL,
+            unsigned int refreshJitterMs = DEFAULT_REFRESH_JITTER);
+    virtual ~ServiceDiscoveryTreeCache();
+
+    /**
+     * Start crawling the namespace. init() must have been called first.
+     * Calling start() again re-reads the root and retries any node that could not be read.
+     *
+     *@throws ServiceDiscoveryException if the crawl could not be started
+     */
+    void start();
+
+    /**
+     * Stop following the namespace and terminate our connection to zookeeper.
+     * Snapshots already taken stay valid, but the cache cannot be started again.
+     */
+    virtual void close();
+
+    /**
+     * Check every cached node against zookeeper, re-reading only the nodes that changed
+     *
+     *@throws ServiceDiscoveryException if the cache has been closed
+     */
+    void validate();
+
+    /**
+     * Wait for the bootstrap crawl to complete
+     *
+     *@param timeoutMs how long to wait
+     *
+     *@return true if every node has been read at least once, or could not be read for a reason
+     *        other than the connection, see getUnreadablePaths()
+     */
+    bool waitUntilInitialized(unsigned int timeoutMs);
+
+    /**
+     * Get the nodes that could not be read for a reason other than the connection, e.g. NoAuth,
+     * with the error each last failed with. They are not retried until start() is called again.
+     */
+    ::std::map< ::std::string, ::org::apache::zookeeper::ReturnCode::type> getUnreadablePaths() const;
+
+    /**
+     * Get the number of reads the cache has sent to zookeeper so far, e.g. to check how well
+     * bursts of changes are coalesced
+     */
+    uint64_t getRequestCount() const;
+
+    /**
+     * Get a consistent, immutable view of the cached namespace
+     */
+    ::boost::shared_ptr<const Snapshot> getSnapshot() const;
+
+    /**
+     * Load a snapshot file written by saveSnapshot(). Until start() has read every node again,
+     * the cache answers from the snapshot, and its views are stale. Call it before start().
+     *
+     *@param path the snapshot file
+     *
+     *@return false if there is no usable snapshot at path, e.g. it is missing, truncated, corrupt,
+     *        or was written in another format, or if the cache has already read the namespace
+     */
+    bool loadSnapshot(const ::std::string& path);
+
+    /**
+     * Write the cache to a snapshot file. The file is replaced atomically, so a process loading it
+     * meanwhile reads either the previous snapshot or this one.
+     *
+     *@param path the snapshot file
+     *
+     *@return false if nothing was written because the cache is not initialized yet
+     *
+     *@throws ServiceDiscoveryException if the file could not be written
+     */
+    bool saveSnapshot(const ::std::string& path);
+
+    /**
+     * Save the cache to a snapshot file every intervalMs if it changed, and once more when the
+     * cache is closed. Calling it again changes the file and interval.
+     *
+     *@throws ServiceDiscoveryException if the cache has been closed
+     */
+    void persistSnapshot(const ::std::string& path, unsigned int intervalMs = DEFAULT_PERSIST_INTERVAL);
+
+private:
+    /*
+     * Immutable tree node. Children are kept sorted by name; an update copies the nodes along
+     * the path from the root to the changed node and shares everything else.
+     */
+    class Node {
+    public:
+        typedef ::std::pair< ::std::string, ::boost::shared_ptr<const Node> > Child;
+        typedef ::std::vector<Child> Children;
+
+        Node() : size(0), cversion(-1), pzxid(0), zxid(0) {}
+
+        const Node* find(const ::std::string& name) const;
+        ::std::vector< ::std::string> names() const;
+
+        Children children;
+        size_t size; //number of nodes below this one
+        int32_t cversion; //children version the children were read at, -1 if never read
+        int64_t pzxid;
+        int64_t zxid; //highest pzxid in this subtree
+    };
+
+    /*
+     * Runs the crawl and applies watch events. It is both the getChildren callback and the
+     * watcher for every node, so the watch manager holds one watcher for the whole tree.
+     */
+    class Crawler : public ::org::apache::zookeeper::GetChildrenCallback,
+                    public ::org::apache::zookeeper::ExistsCallback,
+                    public ::org::apache::zookeeper::Watch,
+                    public ::boost::enable_shared_from_this<Crawler> {
+    public:
+        Crawler(::org::apache::zookeeper::ZooKeeper& handle, unsigned int maxConcurrency,
+                unsigned int refreshIntervalMs, unsigned int refreshJitterMs);
+        virtual ~Crawler() {}
+
+        void start();
+        void validate();
+        void detach();
+        bool load(const ::std::string& path);
+        bool save(const ::std::string& path);
+        bool waitUntilInitialized(unsigned int timeoutMs);
+        ::boost::shared_ptr<const Snapshot> getSnapshot();
+        ::std::map< ::std::string, ::org::apache::zookeeper::ReturnCode::type> getUnreadable();
+        uint64_t getRequestCount();
+
+        //GetChildren callback
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::std::vector< ::std::string>& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, ::std::vector< ::std::string>&& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+
+        //Exists callback, for version checks
+        virtual void process(::org::apache::zookeeper::ReturnCode::type rc,
+                const ::std::string& path, const ::org::apache::zookeeper::data::Stat& stat);
+
+        //Watch callback
+        virtual void process(::org::apache::zookeeper::WatchEvent::type event,
+                ::org::apache::zookeeper::SessionState::type state, const ::std::string& path);
+
+    private:
+        void refresh(const ::std::string& path, bool delayed, bool check = false);
+        void enqueue(const ::std::string& path, bool check);
+        void finish(::org::apache::zookeeper::ReturnCode::type rc, const ::std::string& path);
+        void refreshTree(const Node& node, const ::std::string& path, ::std::vector< ::std::string>& nodes,
+                bool delayed, bool check);
+        void schedule(const ::std::string& path);
+        void runTimers();
+        void dispatch();
+        void update(const ::std::string& path, ::std::vector< ::std::string>& children,
+                const ::org::apache::zookeeper::data::Stat& stat);
+        void remove(const ::std::string& path);
+        void checkInitialized();
+
+        static bool isLeaf(const ::std::vector< ::std::string>& nodes);
+        static ::std::string childPath(const ::std::string& path, const ::std::string& name);
+        static void serialize(const Node& node, const ::std::string& name, ::std::string& out);
+        static ::boost::shared_ptr<const Node> deserialize(const char*& pos, const char* end,
+                ::std::string& name, size_t depth);
+        static ::boost::shared_ptr<const Node> replace(const ::boost::shared_ptr<const Node>& node,
+                const ::std::vector< ::std::string>& nodes, size_t depth,
+                const ::std::vector< ::std::string>* children,
+                const ::org::apache::zookeeper::data::Stat* stat, ::std::vector< ::std::string>& added);
+
+    private:
+        ::org::apache::zookeeper::ZooKeeper* _handle; //NULL once detached
+        unsigned int _maxConcurrency;
+        unsigned int _refreshIntervalMs;
+        unsigned int _refreshJitterMs;
+        bool _initialized;
+        bool _warm; //the tree was loaded from a snapshot file and has not been read again yet
+        bool _expired; //the session expired, read the whole tree again on the next one
+        uint64_t _requests; //reads sent
+        ::std::deque< ::std::string> _queue; //ready to be read
+        ::boost::unordered_map< ::std::string, bool> _queued; //true for a version check only
+        ::boost::unordered_set< ::std::string> _inFlight;
+        ::boost::unordered_set< ::std::string> _dirty; //changed while in flight, read again
+        ::boost::unordered_set< ::std::string> _failed; //read again once connected
+        ::std::map< ::std::string, ::org::apache::zookeeper::ReturnCode::type> _unreadable;
+        ::std::multimap< ::boost::system_time, ::std::string> _timers; //waiting to be queued
+        ::boost::unordered_set< ::std::string> _scheduled;
+        ::boost::random::mt19937 _random;
+        ::boost::shared_ptr<const Node> _root;
+        ::boost::mutex _mutex;
+        ::boost::condition_variable _cond;
+        ::boost::condition_variable _timerCond;
+        ::boost::thread _timerThread;
+    };
+
+private:
+    void persist();
+
+    ::boost::shared_ptr<Crawler> _crawler;
+    ::boost::mutex _persistMutex;
+    ::std::string _persistPath; //empty unless persisting
+    unsigned int _persistIntervalMs;
+    int64_t _persistedZxid;
+    RetryTimer _persistTimer;
+};
+
+}} // namespace ::ezbake::ezdiscovery
+
+#endif /* EZBAKE_EZDISCOVERY_SERVICEDISCOVERYTREECACHE_H_ */
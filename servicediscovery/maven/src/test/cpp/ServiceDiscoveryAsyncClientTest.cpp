@@ -154,6 +154,38 @@ protected:
         std::vector<std::string>& _nodes;
     };
 
+    class FlatListCallback : public ezbake::ezdiscovery::ServiceDiscoveryFlatListCallback {
+    public:
+        FlatListCallback(bool& response, org::apache::zookeeper::FlatStringList& nodes) :
+            _opResponse(response), _nodes(nodes) {}
+
+        virtual void process(CallbackResponse response, org::apache::zookeeper::FlatStringList& values) {
+            _opResponse = (response == ServiceDiscoveryCallback::OK);
+            _nodes.swap(values);
+            _callbackWait.notifyCompleted();
+        }
+
+    private:
+        bool& _opResponse;
+        org::apache::zookeeper::FlatStringList& _nodes;
+    };
+
+    class RegistryCallback : public ezbake::ezdiscovery::ServiceDiscoveryRegistryCallback {
+    public:
+        RegistryCallback(bool& response, ezbake::ezdiscovery::RegistrySnapshot& registry) :
+            _opResponse(response), _registry(registry) {}
+
+        virtual void process(CallbackResponse response, ezbake::ezdiscovery::RegistrySnapshot& registry) {
+            _opResponse = (response == ServiceDiscoveryCallback::OK);
+            _registry.swap(registry);
+            _callbackWait.notifyCompleted();
+        }
+
+    private:
+        bool& _opResponse;
+        ezbake::ezdiscovery::RegistrySnapshot& _registry;
+    };
+
 };
 
 //Declare the static callback
@@ -237,6 +269,34 @@ TEST_F(ServiceDiscoveryAsyncClientTest, unregisteringEndpointsThatDoNotExist) {
     ASSERT_TRUE(callbackResponse);
 }
 
+TEST_F(ServiceDiscoveryAsyncClientTest, registerEndpointIfAbsent) {
+    using ezbake::ezdiscovery::ServiceDiscoveryClient;
+    bool callbackResponse = false;
+    boost::shared_ptr<OperationCallback> registerCB(new OperationCallback(callbackResponse));
+
+    //the parents are created when the end point is new
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181", registerCB,
+            ServiceDiscoveryClient::IF_ABSENT);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient syncClient;
+    syncClient.init(connectString);
+    std::vector<std::string> endpoints;
+    int32_t version = -1;
+    ASSERT_TRUE(syncClient.getEndpointsIfChanged("seasme_street", "cookie_monster", endpoints, version));
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), endpoints);
+
+    //registering it again leaves it alone
+    callbackResponse = false;
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181", registerCB,
+            ServiceDiscoveryClient::IF_ABSENT);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+    EXPECT_FALSE(syncClient.getEndpointsIfChanged("seasme_street", "cookie_monster", endpoints, version));
+    syncClient.close();
+}
+
 TEST_F(ServiceDiscoveryAsyncClientTest, getApplications) {
     bool callbackResponse = false;
 
@@ -337,6 +397,67 @@ TEST_F(ServiceDiscoveryAsyncClientTest, getEndpointsWithNothingRegistered) {
     EXPECT_EQ(static_cast<unsigned int>(0), endpoints.size());
 }
 
+TEST_F(ServiceDiscoveryAsyncClientTest, getEndpointsFlat) {
+    std::string appName = "seasme_street";
+    std::string serviceName = "count";
+    bool callbackResponse = false;
+
+    boost::shared_ptr<OperationCallback> registerCB(new OperationCallback(callbackResponse));
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181", registerCB);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+    callbackResponse = false;
+    org::apache::zookeeper::FlatStringList endpoints;
+    boost::shared_ptr<FlatListCallback> callback(new FlatListCallback(callbackResponse, endpoints));
+    _client.getEndpoints(appName, serviceName, callback);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+    ASSERT_EQ(static_cast<unsigned int>(1), endpoints.size());
+    EXPECT_EQ("bigbird:2181", endpoints[0].to_string());
+}
+
+TEST_F(ServiceDiscoveryAsyncClientTest, concurrentIdenticalReads) {
+    std::string appName = "seasme_street";
+    std::string serviceName = "count";
+    bool callbackResponse = false;
+
+    boost::shared_ptr<OperationCallback> registerCB(new OperationCallback(callbackResponse));
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181", registerCB);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+    //reads issued back to back share one request, but every callback still gets the result
+    const size_t numReads = 10;
+    bool responses[numReads] = {};
+    bool flatResponses[numReads] = {};
+    std::vector<std::vector<std::string> > endpoints(numReads);
+    std::vector<org::apache::zookeeper::FlatStringList> flatEndpoints(numReads);
+    for (size_t i = 0; i < numReads; ++i) {
+        _client.getEndpoints(appName, serviceName, boost::shared_ptr<ListCallback>(
+                new ListCallback(responses[i], endpoints[i])));
+        _client.getEndpoints(appName, serviceName, boost::shared_ptr<FlatListCallback>(
+                new FlatListCallback(flatResponses[i], flatEndpoints[i])));
+    }
+
+    for (int wait = 0; wait < 100; ++wait) {
+        if (std::count(responses, responses + numReads, true) == static_cast<int>(numReads) &&
+            std::count(flatResponses, flatResponses + numReads, true) == static_cast<int>(numReads)) {
+            break;
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    }
+
+    for (size_t i = 0; i < numReads; ++i) {
+        ASSERT_TRUE(responses[i]);
+        ASSERT_EQ(static_cast<unsigned int>(1), endpoints[i].size());
+        EXPECT_EQ("bigbird:2181", endpoints[i][0]);
+        ASSERT_TRUE(flatResponses[i]);
+        ASSERT_EQ(static_cast<unsigned int>(1), flatEndpoints[i].size());
+        EXPECT_EQ("bigbird:2181", flatEndpoints[i][0].to_string());
+    }
+}
+
 TEST_F(ServiceDiscoveryAsyncClientTest, addForwardSlashInAppFirstChar) {
     std::string appName = "/app";
     std::string serviceName = "soup";
@@ -481,4 +602,39 @@ TEST_F(ServiceDiscoveryAsyncClientTest, isServiceCommon) {
     EXPECT_TRUE(status);
 }
 
+TEST_F(ServiceDiscoveryAsyncClientTest, getRegistrySnapshot) {
+    bool callbackResponse = false;
+
+    boost::shared_ptr<OperationCallback> registerCB(new OperationCallback(callbackResponse));
+    _client.registerEndpoint("App1", "service1", "bigbird:2181", registerCB);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+    callbackResponse = false;
+    _client.registerEndpoint("App1", "service2", "elmo:2181", registerCB);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+    callbackResponse = false;
+    _client.registerEndpoint("App2", "service1", "oscar:2181", registerCB);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+
+    callbackResponse = false;
+    ezbake::ezdiscovery::RegistrySnapshot registry;
+    boost::shared_ptr<RegistryCallback> callback(new RegistryCallback(callbackResponse, registry));
+
+    _client.getRegistrySnapshot(callback);
+    _callbackWait.waitForCompleted();
+    ASSERT_TRUE(callbackResponse);
+
+    ASSERT_EQ(static_cast<unsigned int>(2), registry.size());
+    ASSERT_EQ(static_cast<unsigned int>(2), registry["App1"].size());
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), registry["App1"]["service1"]);
+    EXPECT_EQ(std::vector<std::string>(1, "elmo:2181"), registry["App1"]["service2"]);
+    ASSERT_EQ(static_cast<unsigned int>(1), registry["App2"].size());
+    EXPECT_EQ(std::vector<std::string>(1, "oscar:2181"), registry["App2"]["service1"]);
+}
+
 } //namespace
@@ -20,6 +20,7 @@
  */
 
 #include "contrib/gtest/gtest.h"
+#include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 #include "../resources/ZKLocalTestServer.h"
 #include <ezbake/ezdiscovery/ServiceDiscoveryClient.h>
@@ -86,4 +87,56 @@ TEST_F(ServiceDiscoveryClientTest, ValidateHostAndPort) {
     EXPECT_ANY_THROW(ezbake::ezdiscovery::ServiceDiscoveryClient::validateHostAndPort("www.failtest.com"));
 }
 
+TEST_F(ServiceDiscoveryClientTest, RetryPolicyBacksOffWithinBudget) {
+    namespace ReturnCode = org::apache::zookeeper::ReturnCode;
+    ezbake::ezdiscovery::ExponentialBackoffRetry policy(3, 100, 150, 2);
+    unsigned int delayMs = 0;
+
+    //answers are never retried
+    EXPECT_FALSE(policy.retryAfter(1, ReturnCode::NoNode, delayMs));
+
+    //a lost request is retried until it has been sent maxTries times
+    EXPECT_TRUE(policy.retryAfter(1, ReturnCode::ConnectionLoss, delayMs));
+    EXPECT_GE(100u, delayMs);
+    EXPECT_TRUE(policy.retryAfter(2, ReturnCode::ConnectionLoss, delayMs));
+    EXPECT_GE(150u, delayMs);
+    EXPECT_FALSE(policy.retryAfter(3, ReturnCode::ConnectionLoss, delayMs));
+
+    //the two retries used the budget up, answers earn it back
+    EXPECT_FALSE(policy.retryAfter(1, ReturnCode::SessionExpired, delayMs));
+    for (int i = 0; i < 10; ++i) {
+        policy.onAnswer();
+    }
+    EXPECT_TRUE(policy.retryAfter(1, ReturnCode::OperationTimeout, delayMs));
+    EXPECT_FALSE(policy.retryAfter(1, ReturnCode::OperationTimeout, delayMs));
+}
+
+TEST_F(ServiceDiscoveryClientTest, RetryTimer) {
+    ezbake::ezdiscovery::RetryTimer timer;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<int> fired;
+
+    struct Fire {
+        static void run(boost::mutex& mutex, boost::condition_variable& cond, std::vector<int>& fired, int n) {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fired.push_back(n);
+            cond.notify_all();
+        }
+    };
+    EXPECT_TRUE(timer.schedule(100, boost::bind(&Fire::run, boost::ref(mutex), boost::ref(cond), boost::ref(fired), 2)));
+    EXPECT_TRUE(timer.schedule(0, boost::bind(&Fire::run, boost::ref(mutex), boost::ref(cond), boost::ref(fired), 1)));
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fired.size() < 2) {
+            ASSERT_TRUE(cond.timed_wait(lock, boost::posix_time::seconds(5)));
+        }
+    }
+    EXPECT_EQ(1, fired[0]);
+    EXPECT_EQ(2, fired[1]);
+
+    timer.stop();
+    EXPECT_FALSE(timer.schedule(0, boost::bind(&Fire::run, boost::ref(mutex), boost::ref(cond), boost::ref(fired), 3)));
+}
+
 } //namespace
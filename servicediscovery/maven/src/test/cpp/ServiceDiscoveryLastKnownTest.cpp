@@ -0,0 +1,79 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryLastKnownTest.cpp
+ */
+
+#include "contrib/gtest/gtest.h"
+#include <ezbake/ezdiscovery/ServiceDiscoveryLastKnown.h>
+#include <boost/thread/thread.hpp>
+
+namespace {
+
+using ezbake::ezdiscovery::LastKnownReads;
+namespace ReturnCode = org::apache::zookeeper::ReturnCode;
+
+
+TEST(LastKnownReadsTest, keepsNothingByDefault) {
+    LastKnownReads<std::string> known;
+    std::string result;
+
+    known.record("/app", ReturnCode::Ok, "bigbird:2181");
+    EXPECT_FALSE(known.recall("/app", result));
+}
+
+
+TEST(LastKnownReadsTest, dropsThePathReadLongestAgo) {
+    LastKnownReads<std::string> known;
+    known.configure(2, 0);
+    std::string result;
+
+    known.record("/a", ReturnCode::Ok, "a");
+    known.record("/b", ReturnCode::Ok, "b");
+    known.record("/a", ReturnCode::Ok, "a2");
+    known.record("/c", ReturnCode::Ok, "c");
+
+    EXPECT_FALSE(known.recall("/b", result));
+    ASSERT_TRUE(known.recall("/a", result));
+    EXPECT_EQ("a2", result);
+    ASSERT_TRUE(known.recall("/c", result));
+    EXPECT_EQ("c", result);
+
+    //a path that is gone has no result, and errors tell us nothing
+    known.record("/a", ReturnCode::NoNode, "");
+    known.record("/c", ReturnCode::NoAuth, "");
+    EXPECT_FALSE(known.recall("/a", result));
+    EXPECT_TRUE(known.recall("/c", result));
+
+    //shrinking drops the oldest too
+    known.record("/d", ReturnCode::Ok, "d");
+    known.configure(1, 0);
+    EXPECT_FALSE(known.recall("/c", result));
+    EXPECT_TRUE(known.recall("/d", result));
+}
+
+
+TEST(LastKnownReadsTest, expiresOldResults) {
+    LastKnownReads<std::string> known;
+    known.configure(16, 100);
+    std::string result;
+
+    known.record("/app", ReturnCode::Ok, "bigbird:2181");
+    EXPECT_TRUE(known.recall("/app", result));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    EXPECT_FALSE(known.recall("/app", result));
+}
+
+} //namespace
@@ -0,0 +1,198 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoverySingleFlightTest.cpp
+ */
+
+#include "contrib/gtest/gtest.h"
+#include <ezbake/ezdiscovery/ServiceDiscoverySingleFlight.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace {
+
+using ezbake::ezdiscovery::SingleFlightReads;
+using ezbake::ezdiscovery::SingleFlightCallbacks;
+namespace ReturnCode = org::apache::zookeeper::ReturnCode;
+
+/*
+ * Stands in for the zookeeper handle: counts the reads sent, and holds the first one until
+ * released, so that other reads can be made while it is outstanding
+ */
+class FakeHandle {
+public:
+    FakeHandle() : value("before"), rc(ReturnCode::Ok), reads(0), holding(true) {}
+
+    void waitForReads(unsigned int count) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (reads < count) {
+            cond.wait(lock);
+        }
+    }
+
+    void release() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        holding = false;
+        cond.notify_all();
+    }
+
+    std::string value;
+    ReturnCode::type rc;
+    unsigned int reads;
+    bool holding;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+};
+
+ReturnCode::type readPath(FakeHandle& handle, const std::string& path, std::string& result) {
+    boost::unique_lock<boost::mutex> lock(handle.mutex);
+    //the value is read when the request is sent
+    result = handle.value;
+    if (++handle.reads == 1) {
+        handle.cond.notify_all();
+        while (handle.holding) {
+            handle.cond.wait(lock);
+        }
+    }
+    return handle.rc;
+}
+
+void read(SingleFlightReads<std::string>* reads, FakeHandle* handle, std::string* result) {
+    ezbake::ezdiscovery::NoRetry policy;
+    reads->read(*handle, policy, "/app", *result);
+}
+
+
+TEST(SingleFlightReadsTest, coalescesConcurrentReads) {
+    SingleFlightReads<std::string> reads;
+    FakeHandle handle;
+    const int numReads = 8;
+    std::vector<std::string> results(numReads);
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(read, &reads, &handle, &results[0]));
+    handle.waitForReads(1);
+    for (int i = 1; i < numReads; ++i) {
+        threads.create_thread(boost::bind(read, &reads, &handle, &results[i]));
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    handle.release();
+    threads.join_all();
+
+    //the reads made while the first was outstanding did not send their own
+    EXPECT_GT(static_cast<unsigned int>(numReads), handle.reads);
+    for (int i = 0; i < numReads; ++i) {
+        EXPECT_EQ("before", results[i]);
+    }
+}
+
+
+TEST(SingleFlightReadsTest, readAfterWriteSeesWrite) {
+    SingleFlightReads<std::string> reads;
+    FakeHandle handle;
+    std::string first;
+
+    boost::thread reader(boost::bind(read, &reads, &handle, &first));
+    handle.waitForReads(1);
+
+    //a child of /app is created while the read of /app is outstanding
+    {
+        boost::unique_lock<boost::mutex> lock(handle.mutex);
+        handle.value = "after";
+    }
+    reads.written("/app/service");
+
+    //so a read made after the write does not join the read sent before it
+    std::string second;
+    read(&reads, &handle, &second);
+    EXPECT_EQ("after", second);
+    EXPECT_EQ(static_cast<unsigned int>(2), handle.reads);
+
+    handle.release();
+    reader.join();
+    EXPECT_EQ("before", first);
+
+    //nothing is outstanding any more
+    std::string third;
+    read(&reads, &handle, &third);
+    EXPECT_EQ("after", third);
+    EXPECT_EQ(static_cast<unsigned int>(3), handle.reads);
+}
+
+
+TEST(SingleFlightReadsTest, answersLostReadsWithLastKnown) {
+    SingleFlightReads<std::string> reads;
+    FakeHandle handle;
+    handle.release();
+    ezbake::ezdiscovery::NoRetry policy;
+    reads.keepLastKnown(4, 0);
+
+    std::string result;
+    bool stale = true;
+    EXPECT_EQ(ReturnCode::Ok, reads.read(handle, policy, "/app", result, &stale));
+    EXPECT_FALSE(stale);
+
+    //the session is lost
+    handle.rc = ReturnCode::ConnectionLoss;
+    handle.value = "after";
+    EXPECT_EQ(ReturnCode::Ok, reads.read(handle, policy, "/app", result, &stale));
+    EXPECT_TRUE(stale);
+    EXPECT_EQ("before", result);
+
+    //unless stale results are accepted, the loss is reported
+    EXPECT_EQ(ReturnCode::ConnectionLoss, reads.read(handle, policy, "/app", result));
+    EXPECT_EQ(ReturnCode::ConnectionLoss, reads.read(handle, policy, "/other", result, &stale));
+    EXPECT_FALSE(stale);
+}
+
+
+TEST(SingleFlightCallbacksTest, joinsUntilWritten) {
+    typedef SingleFlightCallbacks<int> Calls;
+    Calls calls;
+    boost::shared_ptr<int> a(new int(1)), b(new int(2)), c(new int(3)), d(new int(4));
+
+    Calls::Group first = calls.join("/app", a);
+    ASSERT_TRUE(first.get() != NULL);
+    EXPECT_FALSE(calls.join("/app", b).get());
+
+    //after a write of the node, a new read is sent, and later callbacks join that one
+    calls.written("/app");
+    Calls::Group second = calls.join("/app", c);
+    ASSERT_TRUE(second.get() != NULL);
+    EXPECT_FALSE(calls.join("/app", d).get());
+
+    Calls::Waiters waiters;
+    calls.complete("/app", first, waiters);
+    ASSERT_EQ(static_cast<unsigned int>(2), waiters.size());
+    EXPECT_EQ(a, waiters[0]);
+    EXPECT_EQ(b, waiters[1]);
+
+    //completing the first read leaves the second alone
+    EXPECT_FALSE(calls.join("/app", a).get());
+    waiters.clear();
+    calls.complete("/app", second, waiters);
+    ASSERT_EQ(static_cast<unsigned int>(3), waiters.size());
+    EXPECT_EQ(c, waiters[0]);
+    EXPECT_EQ(d, waiters[1]);
+    EXPECT_EQ(a, waiters[2]);
+
+    //writes elsewhere do not affect the read
+    Calls::Group third = calls.join("/app", a);
+    ASSERT_TRUE(third.get() != NULL);
+    calls.written("/other/app");
+    EXPECT_FALSE(calls.join("/app", b).get());
+}
+
+} //namespace
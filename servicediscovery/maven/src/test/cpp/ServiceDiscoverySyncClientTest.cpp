@@ -23,10 +23,30 @@
 #include <ezbake/ezdiscovery/ServiceDiscoverySyncClient.h>
 #include "../resources/ZKLocalTestServer.h"
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 
 namespace {
 
+/**
+ * Retries as the default policy does, counting the retries it allows
+ */
+class CountingRetry : public ezbake::ezdiscovery::ExponentialBackoffRetry {
+public:
+    CountingRetry() : ExponentialBackoffRetry(50, 100, 500, 50), retries(0) {}
+
+    virtual bool shouldRetry(unsigned int attempts, org::apache::zookeeper::ReturnCode::type rc,
+            unsigned int& delayMs) {
+        if (!ExponentialBackoffRetry::shouldRetry(attempts, rc, delayMs)) {
+            return false;
+        }
+        ++retries;
+        return true;
+    }
+
+    boost::atomic<unsigned int> retries;
+};
+
 /**
  * Synchronous Service Discovery Test class
  */
@@ -131,6 +151,54 @@ TEST_F(ServiceDiscoverySyncClientTest, getEndpointsWithNothingRegistered) {
     EXPECT_EQ(static_cast<unsigned int>(0), endpoints.size());
 }
 
+TEST_F(ServiceDiscoverySyncClientTest, getEndpointsFlat) {
+    std::string appName = "seasme_street";
+    std::string serviceName = "count";
+    std::vector<std::string> expectedEndpoints;
+    expectedEndpoints.push_back("bigbird:2181");
+    expectedEndpoints.push_back("elmo:2181");
+
+    org::apache::zookeeper::FlatStringList endpoints;
+    _client.getEndpoints(appName, serviceName, endpoints);
+    EXPECT_TRUE(endpoints.empty());
+
+    _client.registerEndpoint(appName, serviceName, expectedEndpoints[0]);
+    _client.registerEndpoint(appName, serviceName, expectedEndpoints[1]);
+
+    _client.getEndpoints(appName, serviceName, endpoints);
+    std::vector<std::string> values = endpoints.toVector();
+    std::sort(values.begin(), values.end());
+    EXPECT_EQ(expectedEndpoints, values);
+}
+
+namespace {
+void readEndpoints(ezbake::ezdiscovery::ServiceDiscoverySyncClient* client, std::vector<std::string>* result) {
+    *result = client->getEndpoints("seasme_street", "count");
+    std::sort(result->begin(), result->end());
+}
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, concurrentIdenticalReads) {
+    std::vector<std::string> expectedEndpoints;
+    expectedEndpoints.push_back("bigbird:2181");
+    expectedEndpoints.push_back("elmo:2181");
+    _client.registerEndpoint("seasme_street", "count", expectedEndpoints[0]);
+    _client.registerEndpoint("seasme_street", "count", expectedEndpoints[1]);
+
+    //readers that coalesce onto another's request all see its result
+    const int numThreads = 16;
+    std::vector<std::vector<std::string> > results(numThreads);
+    boost::thread_group threads;
+    for (int i = 0; i < numThreads; ++i) {
+        threads.create_thread(boost::bind(&readEndpoints, &_client, &results[i]));
+    }
+    threads.join_all();
+
+    for (int i = 0; i < numThreads; ++i) {
+        EXPECT_EQ(expectedEndpoints, results[i]);
+    }
+}
+
 TEST_F(ServiceDiscoverySyncClientTest, addForwardSlashInAppFirstChar) {
     std::string appName = "/app";
     std::string serviceName = "soup";
@@ -201,4 +269,217 @@ TEST_F(ServiceDiscoverySyncClientTest, isServiceCommon) {
     EXPECT_TRUE(_client.isServiceCommon(serviceName));
 }
 
+TEST_F(ServiceDiscoverySyncClientTest, getEndpointCount) {
+    std::string appName = "seasme_street";
+    std::string serviceName = "cookie_monster";
+    EXPECT_EQ(static_cast<unsigned int>(0), _client.getEndpointCount(appName, serviceName));
+
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181");
+    _client.registerEndpoint(appName, serviceName, "elmo:2181");
+    EXPECT_EQ(static_cast<unsigned int>(2), _client.getEndpointCount(appName, serviceName));
+
+    _client.registerEndpoint("telly_monster", "oscar:2181");
+    EXPECT_EQ(static_cast<unsigned int>(1), _client.getEndpointCount("telly_monster"));
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, getRegistrySnapshot) {
+    EXPECT_TRUE(_client.getRegistrySnapshot().empty());
+
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    _client.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+    _client.registerEndpoint("seasme_street", "count", "oscar:2181");
+    _client.setSecurityIdForApplication("seasme_street", "id1");
+    _client.registerEndpoint("telly_monster", "grover:2181");
+
+    //a single read in flight still crawls the whole tree
+    ezbake::ezdiscovery::RegistrySnapshot registry = _client.getRegistrySnapshot(1);
+    ASSERT_EQ(static_cast<unsigned int>(2), registry.size());
+
+    ezbake::ezdiscovery::ServiceEndpoints& services = registry["seasme_street"];
+    ASSERT_EQ(static_cast<unsigned int>(2), services.size());
+    std::vector<std::string> endpoints = services["cookie_monster"];
+    std::sort(endpoints.begin(), endpoints.end());
+    ASSERT_EQ(static_cast<unsigned int>(2), endpoints.size());
+    EXPECT_EQ("bigbird:2181", endpoints[0]);
+    EXPECT_EQ("elmo:2181", endpoints[1]);
+    EXPECT_EQ(std::vector<std::string>(1, "oscar:2181"), services["count"]);
+
+    EXPECT_EQ(std::vector<std::string>(1, "grover:2181"), registry["common_services"]["telly_monster"]);
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, getEndpointsIfChanged) {
+    std::string appName = "seasme_street";
+    std::string serviceName = "cookie_monster";
+    std::vector<std::string> endpoints;
+    int32_t version = -1;
+
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181");
+    EXPECT_TRUE(_client.getEndpointsIfChanged(appName, serviceName, endpoints, version));
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), endpoints);
+
+    //nothing changed, nothing listed
+    endpoints.clear();
+    EXPECT_FALSE(_client.getEndpointsIfChanged(appName, serviceName, endpoints, version));
+    EXPECT_TRUE(endpoints.empty());
+
+    _client.registerEndpoint(appName, serviceName, "elmo:2181");
+    EXPECT_TRUE(_client.getEndpointsIfChanged(appName, serviceName, endpoints, version));
+    EXPECT_EQ(static_cast<unsigned int>(2), endpoints.size());
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, registerEndpointIfAbsent) {
+    using ezbake::ezdiscovery::ServiceDiscoveryClient;
+    std::string appName = "seasme_street";
+    std::string serviceName = "cookie_monster";
+    std::vector<std::string> endpoints;
+    int32_t version = -1;
+
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181", ServiceDiscoveryClient::IF_ABSENT);
+    ASSERT_TRUE(_client.getEndpointsIfChanged(appName, serviceName, endpoints, version));
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), endpoints);
+
+    //an end point that is already registered is left alone
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181", ServiceDiscoveryClient::IF_ABSENT);
+    EXPECT_FALSE(_client.getEndpointsIfChanged(appName, serviceName, endpoints, version));
+
+    //while the default mode replaces it
+    _client.registerEndpoint(appName, serviceName, "bigbird:2181");
+    EXPECT_TRUE(_client.getEndpointsIfChanged(appName, serviceName, endpoints, version));
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), endpoints);
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, registerEphemeralEndpoint) {
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient owner;
+    owner.init(ss.str());
+
+    owner.registerEphemeralEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    owner.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+    std::vector<std::string> endpoints = _client.getEndpoints("seasme_street", "cookie_monster");
+    EXPECT_EQ(static_cast<unsigned int>(2), endpoints.size());
+
+    //the ephemeral end point goes away with its owner's session
+    owner.close();
+    endpoints = _client.getEndpoints("seasme_street", "cookie_monster");
+    ASSERT_EQ(static_cast<unsigned int>(1), endpoints.size());
+    EXPECT_EQ("elmo:2181", endpoints[0]);
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, resumesSession) {
+    using ezbake::ezdiscovery::ServiceDiscoveryClient;
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient owner;
+    owner.init(ss.str());
+    owner.registerEphemeralEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    int64_t sessionId = owner.getSessionId();
+    std::string sessionPassword = owner.getSessionPassword();
+    owner.close();
+
+    //the replacement takes the session over, and the end point with it
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient heir;
+    heir.init(ss.str(), sessionId, sessionPassword);
+    heir.registerEphemeralEndpoint("seasme_street", "cookie_monster", "bigbird:2181",
+            ServiceDiscoveryClient::IF_ABSENT);
+    EXPECT_EQ(sessionId, heir.getSessionId());
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), _client.getEndpoints("seasme_street", "cookie_monster"));
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, initWithoutSessionCreatesNamespace) {
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+
+    //a clean server, on which nothing exists yet
+    ezbake::local::ZKLocalTestServer::stop();
+    ezbake::local::ZKLocalTestServer::start();
+
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient client;
+    client.init(ss.str(), 0, "");
+    client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), client.getEndpoints("seasme_street", "cookie_monster"));
+    client.close();
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, registerEphemeralEndpointIfAbsentReplacesPersistent) {
+    using ezbake::ezdiscovery::ServiceDiscoveryClient;
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+
+    {
+        ezbake::ezdiscovery::ServiceDiscoverySyncClient owner;
+        owner.init(ss.str());
+        owner.registerEphemeralEndpoint("seasme_street", "cookie_monster", "bigbird:2181",
+                ServiceDiscoveryClient::IF_ABSENT);
+        EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), _client.getEndpoints("seasme_street", "cookie_monster"));
+    }
+
+    //the persistent end point was made the owner's, and went away with its session
+    EXPECT_EQ(static_cast<unsigned int>(0), _client.getEndpoints("seasme_street", "cookie_monster").size());
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, reregistersEphemeralEndpointsOnExpiry) {
+    namespace zk = org::apache::zookeeper;
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+    _client.registerEphemeralEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    int64_t sessionId = _client.getSessionId();
+
+    //closing a second handle on our session expires it
+    {
+        zk::ZooKeeper handle;
+        ASSERT_EQ(zk::ReturnCode::Ok, handle.init(ss.str(), 10000, boost::shared_ptr<zk::Watch>(),
+                sessionId, _client.getSessionPassword()));
+        zk::data::Stat stat;
+        ASSERT_EQ(zk::ReturnCode::Ok, handle.exists("/", boost::shared_ptr<zk::Watch>(), stat));
+        handle.close();
+    }
+
+    //the client establishes a new session, and registers the end point on it
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient observer;
+    observer.init(ss.str());
+    std::vector<std::string> endpoints;
+    for (int i = 0; i < 100 && endpoints.empty(); ++i) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        endpoints = observer.getEndpoints("seasme_street", "cookie_monster");
+    }
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), endpoints);
+    EXPECT_NE(sessionId, _client.getSessionId());
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, servesLastKnownReadsWhileDisconnected) {
+    _client.setLastKnownReads(16, 0);
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    bool stale = true;
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"),
+            _client.getEndpoints("seasme_street", "cookie_monster", stale));
+    EXPECT_FALSE(stale);
+
+    //only reads that accept stale results get them
+    ezbake::local::ZKLocalTestServer::stop();
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"),
+            _client.getEndpoints("seasme_street", "cookie_monster", stale));
+    EXPECT_TRUE(stale);
+    EXPECT_ANY_THROW(_client.getEndpoints("seasme_street", "cookie_monster"));
+    EXPECT_ANY_THROW(_client.getEndpoints("seasme_street", "never_read", stale));
+
+    ezbake::local::ZKLocalTestServer::start(false);
+}
+
+TEST_F(ServiceDiscoverySyncClientTest, retriesWritesWhileDisconnected) {
+    boost::shared_ptr<CountingRetry> policy(new CountingRetry());
+    _client.setRetryPolicy(policy);
+
+    //the registration is sent while the server is down, and gets through once it is back
+    ezbake::local::ZKLocalTestServer::stop();
+    boost::thread restart(boost::bind(&ezbake::local::ZKLocalTestServer::start, false));
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    restart.join();
+
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), _client.getEndpoints("seasme_street", "cookie_monster"));
+    //it got through because it was retried, not because it was queued until we reconnected
+    EXPECT_LT(0u, policy->retries.load());
+}
+
 } //namespace
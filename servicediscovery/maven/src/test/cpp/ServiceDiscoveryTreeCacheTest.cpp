@@ -0,0 +1,286 @@
+/*   Copyright (C) 2013-2014 Computer Sciences Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+/*
+ * ServiceDiscoveryTreeCacheTest.cpp
+ */
+
+#include "contrib/gtest/gtest.h"
+#include <ezbake/ezdiscovery/ServiceDiscoveryTreeCache.h>
+#include <ezbake/ezdiscovery/ServiceDiscoverySyncClient.h>
+#include <ezbake/ezdiscovery/SDACL.h>
+#include "../resources/ZKLocalTestServer.h"
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <cstdio>
+#include <map>
+
+namespace {
+
+using ezbake::ezdiscovery::ServiceDiscoveryTreeCache;
+
+/**
+ * Tree Cache Test class
+ */
+class ServiceDiscoveryTreeCacheTest : public ::testing::Test {
+public:
+    ServiceDiscoveryTreeCacheTest() {}
+    virtual ~ServiceDiscoveryTreeCacheTest() {}
+
+    void SetUp() {
+        ezbake::local::ZKLocalTestServer::start();
+
+        std::ostringstream ss;
+        ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+        _client.init(ss.str());
+        _cache.init(ss.str());
+    }
+
+    void TearDown() {
+        _cache.close();
+        _client.close();
+        ezbake::local::ZKLocalTestServer::stop();
+        boost::this_thread::sleep(boost::posix_time::seconds(1)); //wait for 1 sec before starting next test
+    }
+
+protected:
+    /*
+     * Watches are delivered asynchronously; poll the cache until it has the expected endpoints
+     */
+    std::vector<std::string> waitForEndpoints(const std::string& appName, const std::string& serviceName,
+            size_t expected) {
+        std::vector<std::string> endpoints;
+        for (int i = 0; i < 100; ++i) {
+            endpoints = _cache.getSnapshot()->getEndpoints(appName, serviceName);
+            if (endpoints.size() == expected) {
+                break;
+            }
+            boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+        }
+        std::sort(endpoints.begin(), endpoints.end());
+        return endpoints;
+    }
+
+protected:
+    ezbake::ezdiscovery::ServiceDiscoverySyncClient _client;
+    ServiceDiscoveryTreeCache _cache;
+};
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, bootstrap) {
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    _client.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+    _client.registerEndpoint("seasme_street", "count", "oscar:2181");
+    _client.registerEndpoint("street_sweeper", "telly:2181");
+    _client.setSecurityIdForApplication("seasme_street", "abc");
+    _client.setSecurityIdForCommonService("street_sweeper", "xyz");
+
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+
+    boost::shared_ptr<const ServiceDiscoveryTreeCache::Snapshot> snapshot = _cache.getSnapshot();
+
+    std::vector<std::string> applications = _client.getApplications();
+    std::sort(applications.begin(), applications.end());
+    EXPECT_EQ(applications, snapshot->getApplications());
+
+    std::vector<std::string> services = _client.getServices("seasme_street");
+    std::sort(services.begin(), services.end());
+    EXPECT_EQ(services, snapshot->getServices("seasme_street"));
+
+    std::vector<std::string> endpoints = snapshot->getEndpoints("seasme_street", "cookie_monster");
+    ASSERT_EQ(static_cast<unsigned int>(2), endpoints.size());
+    EXPECT_EQ("bigbird:2181", endpoints[0]);
+    EXPECT_EQ("elmo:2181", endpoints[1]);
+    EXPECT_EQ(std::vector<std::string>(1, "oscar:2181"), snapshot->getEndpoints("seasme_street", "count"));
+    EXPECT_EQ(std::vector<std::string>(1, "telly:2181"), snapshot->getEndpoints("street_sweeper"));
+
+    EXPECT_EQ("abc", snapshot->getSecurityIdForApplication("seasme_street"));
+    EXPECT_EQ("xyz", snapshot->getSecurityIdForCommonService("street_sweeper"));
+    EXPECT_TRUE(snapshot->isServiceCommon("street_sweeper"));
+    EXPECT_FALSE(snapshot->isServiceCommon("cookie_monster"));
+
+    EXPECT_TRUE(snapshot->getEndpoints("no_app", "no_service").empty());
+}
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, followsChanges) {
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+    boost::shared_ptr<const ServiceDiscoveryTreeCache::Snapshot> before = _cache.getSnapshot();
+
+    //a new endpoint on a watched service
+    _client.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+    EXPECT_EQ(static_cast<unsigned int>(2), waitForEndpoints("seasme_street", "cookie_monster", 2).size());
+
+    //a new service in a new application is crawled as it appears
+    _client.registerEndpoint("muppets", "kermit", "frog:2181");
+    EXPECT_EQ(std::vector<std::string>(1, "frog:2181"), waitForEndpoints("muppets", "kermit", 1));
+
+    _client.unregisterEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    EXPECT_EQ(std::vector<std::string>(1, "elmo:2181"), waitForEndpoints("seasme_street", "cookie_monster", 1));
+
+    //older snapshots do not change
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), before->getEndpoints("seasme_street", "cookie_monster"));
+    EXPECT_TRUE(before->getServices("muppets").empty());
+}
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, coalescesBursts) {
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+    uint64_t requests = _cache.getRequestCount();
+
+    //a burst of changes inside the refresh interval is picked up by the debounced re-reads
+    for (int i = 0; i < 20; ++i) {
+        std::ostringstream ss;
+        ss << "elmo" << i << ":2181";
+        _client.registerEndpoint("seasme_street", "cookie_monster", ss.str());
+    }
+    EXPECT_EQ(static_cast<unsigned int>(21), waitForEndpoints("seasme_street", "cookie_monster", 21).size());
+
+    //rather than by a read per change
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1000));
+    EXPECT_GE(static_cast<uint64_t>(5), _cache.getRequestCount() - requests);
+}
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, validate) {
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    _client.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+    EXPECT_EQ(static_cast<unsigned int>(2), _cache.getSnapshot()->getEndpointCount("seasme_street", "cookie_monster"));
+
+    //nothing changed: the cache keeps its tree
+    boost::shared_ptr<const ServiceDiscoveryTreeCache::Snapshot> before = _cache.getSnapshot();
+    _cache.validate();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+    EXPECT_EQ(before->size(), _cache.getSnapshot()->size());
+
+    _client.registerEndpoint("seasme_street", "cookie_monster", "oscar:2181");
+    _cache.validate();
+    EXPECT_EQ(static_cast<unsigned int>(3), waitForEndpoints("seasme_street", "cookie_monster", 3).size());
+
+    _cache.close();
+    EXPECT_ANY_THROW(_cache.validate());
+}
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, settlesUnreadableNodes) {
+    namespace zk = org::apache::zookeeper;
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+
+    //an application node nobody may list
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT << "/"
+       << ezbake::ezdiscovery::ServiceDiscoveryClient::NAMESPACE;
+    zk::ZooKeeper handle;
+    ASSERT_EQ(zk::ReturnCode::Ok, handle.init(ss.str(), 10000, boost::shared_ptr<zk::Watch>()));
+    std::string created;
+    ASSERT_EQ(zk::ReturnCode::Ok, handle.create("/locked", "",
+            std::vector<zk::data::ACL>(1, ezbake::ezdiscovery::SDACL("world", "anyone", zk::Permission::Create)),
+            zk::CreateMode::Persistent, created));
+
+    //reconnecting would not help, so the node does not hold up initialization
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+    std::map<std::string, zk::ReturnCode::type> unreadable = _cache.getUnreadablePaths();
+    ASSERT_EQ(static_cast<unsigned int>(1), unreadable.size());
+    EXPECT_EQ("/locked", unreadable.begin()->first);
+    EXPECT_EQ(zk::ReturnCode::NoAuth, unreadable.begin()->second);
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"),
+            _cache.getSnapshot()->getEndpoints("seasme_street", "cookie_monster"));
+
+    //start() tries it again
+    handle.close();
+    _cache.start();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+    EXPECT_EQ(static_cast<unsigned int>(1), _cache.getUnreadablePaths().size());
+}
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, followsChangesAcrossExpiry) {
+    namespace zk = org::apache::zookeeper;
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+    int64_t sessionId = _cache.getSessionId();
+
+    //closing a second handle on the cache's session expires it; the cache holds no ephemerals
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+    {
+        zk::ZooKeeper handle;
+        ASSERT_EQ(zk::ReturnCode::Ok, handle.init(ss.str(), 10000, boost::shared_ptr<zk::Watch>(),
+                sessionId, _cache.getSessionPassword()));
+        zk::data::Stat stat;
+        ASSERT_EQ(zk::ReturnCode::Ok, handle.exists("/", boost::shared_ptr<zk::Watch>(), stat));
+        handle.close();
+    }
+
+    //changes made around the expiry still reach the cache on its new session
+    _client.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+    std::vector<std::string> expected;
+    expected.push_back("bigbird:2181");
+    expected.push_back("elmo:2181");
+    EXPECT_EQ(expected, waitForEndpoints("seasme_street", "cookie_monster", 2));
+    EXPECT_NE(sessionId, _cache.getSessionId());
+
+    _client.unregisterEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    EXPECT_EQ(std::vector<std::string>(1, "elmo:2181"), waitForEndpoints("seasme_street", "cookie_monster", 1));
+}
+
+
+TEST_F(ServiceDiscoveryTreeCacheTest, warmStartFromSnapshot) {
+    const std::string path = "ServiceDiscoveryTreeCacheTest.snapshot";
+    _client.registerEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+
+    //nothing to save until the namespace has been read
+    EXPECT_FALSE(_cache.saveSnapshot(path));
+    _cache.start();
+    ASSERT_TRUE(_cache.waitUntilInitialized(10000));
+    ASSERT_TRUE(_cache.saveSnapshot(path));
+
+    //the snapshot answers before we even connect
+    _client.unregisterEndpoint("seasme_street", "cookie_monster", "bigbird:2181");
+    _client.registerEndpoint("seasme_street", "cookie_monster", "elmo:2181");
+    ServiceDiscoveryTreeCache restarted;
+    ASSERT_TRUE(restarted.loadSnapshot(path));
+    boost::shared_ptr<const ServiceDiscoveryTreeCache::Snapshot> snapshot = restarted.getSnapshot();
+    EXPECT_TRUE(snapshot->isStale());
+    EXPECT_EQ(_cache.getSnapshot()->getZxid(), snapshot->getZxid());
+    EXPECT_EQ(std::vector<std::string>(1, "bigbird:2181"), snapshot->getEndpoints("seasme_street", "cookie_monster"));
+
+    //until the live namespace replaces it
+    std::ostringstream ss;
+    ss << "localhost:" << ezbake::local::ZKLocalTestServer::DEFAULT_PORT;
+    restarted.init(ss.str());
+    restarted.start();
+    ASSERT_TRUE(restarted.waitUntilInitialized(10000));
+    snapshot = restarted.getSnapshot();
+    EXPECT_FALSE(snapshot->isStale());
+    EXPECT_EQ(std::vector<std::string>(1, "elmo:2181"), snapshot->getEndpoints("seasme_street", "cookie_monster"));
+    EXPECT_FALSE(restarted.loadSnapshot(path));
+
+    EXPECT_FALSE(restarted.loadSnapshot("does_not_exist.snapshot"));
+    std::remove(path.c_str());
+}
+
+} //namespace